@@ -0,0 +1,294 @@
+#include "dumageview/ioengine.h"
+#include "dumageview/log.h"
+#include "dumageview/scopeguard.h"
+
+#include <fmt/format.h>
+
+#include <QByteArray>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+  using namespace dumageview;
+
+  namespace fs = boost::filesystem;
+  namespace po = boost::program_options;
+
+  using Clock = std::chrono::steady_clock;
+  using Millis = std::chrono::duration<double, std::milli>;
+
+  struct Config {
+    std::size_t numFiles{10000};
+    std::size_t fileSize{64 << 10};
+    unsigned numThreads{ioengine::Options{}.numThreads};
+    int rounds{3};
+    bool warm{false};  // leave files in the page cache between runs
+    std::optional<fs::path> dir;
+  };
+
+  struct Run {
+    Millis elapsed{0};
+    std::uint64_t bytes{0};
+    std::size_t failed{0};
+  };
+
+  /**
+   * Writes the files, named so that name order is creation order.
+   * Contents are random so nothing below can compress them away.
+   */
+  std::vector<fs::path> makeFiles(fs::path const& dir, Config const& config) {
+    fs::create_directories(dir);
+
+    std::mt19937_64 generator{config.numFiles};
+    std::vector<std::uint64_t> words((config.fileSize + 7) / 8);
+    std::vector<fs::path> paths;
+
+    for (std::size_t i = 0; i < config.numFiles; ++i) {
+      std::generate(words.begin(), words.end(), generator);
+      auto path = dir / fmt::format("{:06}.bin", i);
+
+      std::FILE* file = std::fopen(path.c_str(), "wb");
+      if (!file) {
+        throw std::runtime_error(
+          fmt::format("could not create {}", path.string()));
+      }
+      auto closer = ScopeGuard{[file] { std::fclose(file); }};
+      if (std::fwrite(words.data(), 1, config.fileSize, file)
+          != config.fileSize) {
+        throw std::runtime_error(
+          fmt::format("could not write {}", path.string()));
+      }
+      paths.push_back(std::move(path));
+    }
+    return paths;
+  }
+
+  /**
+   * Drops the files' clean pages from the page cache, which needs no
+   * privileges, so the next run reads from the disk again.
+   */
+  void evict(std::vector<fs::path> const& paths) {
+    ::sync();
+    for (auto const& path : paths) {
+      int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd >= 0) {
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+      }
+    }
+  }
+
+  /**
+   * One file after another on this thread, as a QFile::readAll() would.
+   */
+  Run readBlocking(std::vector<fs::path> const& paths) {
+    Run run;
+    auto start = Clock::now();
+
+    for (auto const& path : paths) {
+      int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0) {
+        ++run.failed;
+        continue;
+      }
+      auto closer = ScopeGuard{[fd] { ::close(fd); }};
+
+      struct stat st {};
+      if (::fstat(fd, &st) != 0) {
+        ++run.failed;
+        continue;
+      }
+      QByteArray data(static_cast<int>(st.st_size), Qt::Uninitialized);
+
+      qint64 done = 0;
+      while (done < data.size()) {
+        auto count = ::pread(fd,
+                             data.data() + done,
+                             static_cast<std::size_t>(data.size() - done),
+                             done);
+        if (count <= 0) {
+          break;
+        }
+        done += count;
+      }
+      if (done == data.size()) {
+        run.bytes += static_cast<std::uint64_t>(done);
+      } else {
+        ++run.failed;
+      }
+    }
+
+    run.elapsed = Clock::now() - start;
+    return run;
+  }
+
+  /**
+   * The whole list as one batch, timed from submission to the last
+   * callback. Setting up the engine is not counted.
+   */
+  Run readEngine(IoEngine& engine, std::vector<fs::path> const& paths) {
+    Run run;
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::size_t remaining = paths.size();
+
+    auto start = Clock::now();
+    engine.read(paths, [&](std::size_t, ioengine::Result&& result) {
+      std::lock_guard lock{mutex};
+      if (result.ok()) {
+        run.bytes += static_cast<std::uint64_t>(result.data.size());
+      } else {
+        ++run.failed;
+      }
+      if (--remaining == 0) {
+        finished.notify_one();
+      }
+    });
+
+    std::unique_lock lock{mutex};
+    finished.wait(lock, [&] { return remaining == 0; });
+    run.elapsed = Clock::now() - start;
+    return run;
+  }
+
+  template<class F>
+  void measure(std::string const& name,
+               std::vector<fs::path> const& paths,
+               Config const& config,
+               F&& readAll) {
+    std::optional<Run> best;
+    for (int round = 0; round < config.rounds; ++round) {
+      if (!config.warm) {
+        evict(paths);
+      }
+      auto run = readAll();
+      if (!best || run.elapsed < best->elapsed) {
+        best = run;
+      }
+    }
+
+    double seconds = best->elapsed.count() / 1000.0;
+    fmt::print("{:<12} {:>9.1f} ms {:>10.0f} files/s {:>9.1f} MiB/s{}\n",
+               name,
+               best->elapsed.count(),
+               static_cast<double>(paths.size()) / seconds,
+               static_cast<double>(best->bytes) / (1 << 20) / seconds,
+               best->failed ? fmt::format(" ({} failed)", best->failed) : "");
+  }
+
+  Config parseArgs(int argc, char** argv) {
+    Config config;
+    po::options_description options{"Options"};
+    options.add_options()
+      ("help,h", "show this help")
+      ("files,n",
+       po::value(&config.numFiles)->default_value(config.numFiles),
+       "number of files to generate")
+      ("size,s",
+       po::value(&config.fileSize)->default_value(config.fileSize),
+       "bytes per file")
+      ("threads,t",
+       po::value(&config.numThreads)->default_value(config.numThreads),
+       "pread workers for the thread pool")
+      ("rounds,r",
+       po::value(&config.rounds)->default_value(config.rounds),
+       "runs per method; the fastest is shown")
+      ("dir,d",
+       po::value<std::string>(),
+       "where to generate the files; a temporary directory if not given")
+      ("warm",
+       po::bool_switch(&config.warm),
+       "keep the files cached instead of evicting them before each run");
+
+    po::variables_map vars;
+    po::store(po::parse_command_line(argc, argv, options), vars);
+    po::notify(vars);
+
+    if (vars.count("help")) {
+      std::cout << "Usage: " << argv[0] << " [options]\n" << options;
+      std::exit(0);
+    }
+    if (vars.count("dir")) {
+      config.dir = vars["dir"].as<std::string>();
+    }
+    config.rounds = std::max(config.rounds, 1);
+    return config;
+  }
+}
+
+/**
+ * Compares the ways ImageController could read files ahead: the IoEngine
+ * through io_uring, the IoEngine's pread pool, and plain blocking reads on
+ * one thread. Generates a directory of files of one size, then reads all
+ * of them with each method a few times and prints the best run. The
+ * engine reads in on-disk order; blocking reads go in name order.
+ */
+int main(int argc, char** argv) {
+  Config config;
+  try {
+    config = parseArgs(argc, argv);
+  } catch (po::error const& error) {
+    std::cerr << error.what() << "\n";
+    return 2;
+  }
+  log::initAppLogger();
+
+  auto dir = config.dir.value_or(
+    fs::temp_directory_path() / fs::unique_path("dumageview-iobench-%%%%%%"));
+  auto remover = ScopeGuard{[&] {
+    if (!config.dir) {
+      boost::system::error_code ignored;
+      fs::remove_all(dir, ignored);
+    }
+  }};
+
+  fmt::print("Writing {} files of {} bytes to {}\n",
+             config.numFiles,
+             config.fileSize,
+             dir.string());
+  auto paths = makeFiles(dir, config);
+  fmt::print("{} cache, best of {}\n\n",
+             config.warm ? "Warm" : "Cold",
+             config.rounds);
+
+  ioengine::Options uringOptions;
+  uringOptions.numThreads = config.numThreads;
+  IoEngine uring{uringOptions};
+  if (uring.getBackend() == ioengine::Backend::ioUring) {
+    measure("io_uring", paths, config, [&] {
+      return readEngine(uring, paths);
+    });
+  } else {
+    fmt::print("{:<12} unavailable\n", "io_uring");
+  }
+
+  auto poolOptions = uringOptions;
+  poolOptions.allowIoUring = false;
+  IoEngine pool{poolOptions};
+  measure(fmt::format("pool x{}", config.numThreads), paths, config, [&] {
+    return readEngine(pool, paths);
+  });
+
+  measure("blocking", paths, config, [&] { return readBlocking(paths); });
+  return 0;
+}
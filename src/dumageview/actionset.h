@@ -21,6 +21,30 @@ namespace dumageview::actionset {
     QAction zoomIn{};
     QAction zoomOut{};
 
+    QAction rotateClockwise{};
+    QAction rotateCounterclockwise{};
+    QAction flipHorizontally{};
+    QAction flipVertically{};
+
+    QAction increaseExposure{};
+    QAction decreaseExposure{};
+    QAction increaseBrightness{};
+    QAction decreaseBrightness{};
+    QAction increaseContrast{};
+    QAction decreaseContrast{};
+    QAction increaseGamma{};
+    QAction decreaseGamma{};
+
+    QAction showAllChannels{};
+    QAction showRed{};
+    QAction showGreen{};
+    QAction showBlue{};
+    QAction showAlpha{};
+    QAction showLuma{};
+
+    QAction showCheckerboard{};
+    QAction resetAdjustments{};
+
     QAction panUp{};
     QAction panDown{};
     QAction panLeft{};
@@ -31,6 +55,7 @@ namespace dumageview::actionset {
 
     QAction prevFrame{};
     QAction nextFrame{};
+    QAction playAnimation{};
 
     QAction fullScreen{};
     QAction exitFullScreen{};
@@ -52,6 +77,30 @@ namespace dumageview::actionset {
       actions.zoomIn,
       actions.zoomOut,
 
+      actions.rotateClockwise,
+      actions.rotateCounterclockwise,
+      actions.flipHorizontally,
+      actions.flipVertically,
+
+      actions.increaseExposure,
+      actions.decreaseExposure,
+      actions.increaseBrightness,
+      actions.decreaseBrightness,
+      actions.increaseContrast,
+      actions.decreaseContrast,
+      actions.increaseGamma,
+      actions.decreaseGamma,
+
+      actions.showAllChannels,
+      actions.showRed,
+      actions.showGreen,
+      actions.showBlue,
+      actions.showAlpha,
+      actions.showLuma,
+
+      actions.showCheckerboard,
+      actions.resetAdjustments,
+
       actions.panUp,
       actions.panDown,
       actions.panLeft,
@@ -62,6 +111,7 @@ namespace dumageview::actionset {
 
       actions.prevFrame,
       actions.nextFrame,
+      actions.playAnimation,
 
       actions.fullScreen,
       actions.exitFullScreen,
@@ -1,13 +1,16 @@
 #include "dumageview/appcontroller.h"
 
 #include "dumageview/application.h"
+#include "dumageview/colorlut.h"
 #include "dumageview/conv_str.h"
 #include "dumageview/filedialogrunner.h"
+#include "dumageview/log.h"
 #include "dumageview/mainwindow.h"
 #include "dumageview/messageboxrunner.h"
 #include "dumageview/qtutil.h"
 
 #include <QDir>
+#include <QFile>
 #include <QKeySequence>
 #include <QMenuBar>
 #include <QString>
@@ -27,8 +30,42 @@ namespace dumageview {
     getMenuMaker().addActions(getMainWindow());
     getMenuMaker().setupMenuBar(getMainWindow().menuBar());
 
-    if (cmdArgs.imagePath) {
-      getImageController().openImage(conv::qstr(cmdArgs.imagePath->string()));
+    imagerenderer::Options rendererOptions;
+    if (cmdArgs.legacyGl) {
+      rendererOptions.pipeline = imagerenderer::Pipeline::legacy;
+    }
+    if (cmdArgs.software) {
+      rendererOptions.pipeline = imagerenderer::Pipeline::software;
+    }
+    rendererOptions.renderThread = cmdArgs.renderThread;
+    if (cmdArgs.driverMipmaps) {
+      rendererOptions.mipmaps = imagerenderer::MipmapSource::driver;
+    }
+    if (cmdArgs.textureCacheMiB) {
+      rendererOptions.residencyBudget = *cmdArgs.textureCacheMiB << 20;
+    }
+    getMainWindow().getImageArea().setRendererOptions(rendererOptions);
+
+    if (cmdArgs.displayProfilePath) {
+      QFile file{conv::qstr(cmdArgs.displayProfilePath->string())};
+      if (!colorlut::isAvailable()) {
+        log::warn("This build cannot read color profiles");
+      } else if (file.open(QIODevice::ReadOnly)) {
+        getImageController().setDisplayProfile(file.readAll());
+      } else {
+        log::warn("Could not read display profile {}: {}",
+                  *cmdArgs.displayProfilePath,
+                  conv::str(file.errorString()));
+      }
+    }
+
+    auto const& paths = cmdArgs.imagePaths;
+
+    if (cmdArgs.fileListPath || paths.size() > 1) {
+      getImageController().openList(paths, cmdArgs.fileListPath);
+      getMainWindow().adjustSize();
+    } else if (!paths.empty()) {
+      getImageController().openImage(conv::qstr(paths.front().string()));
       getMainWindow().adjustSize();
     }
 
@@ -74,6 +111,10 @@ namespace dumageview {
                     &QAction::triggered,
                     &getImageController(),
                     &ImageController::nextFrame);
+    qtutil::connect(&getActions().playAnimation,
+                    &QAction::toggled,
+                    &getImageController(),
+                    &ImageController::setPlaying);
 
     // -- window actions
 
@@ -109,6 +150,64 @@ namespace dumageview {
                     &getImageWidget(),
                     &ImageWidget::zoomToFit);
 
+    // -- orientation actions
+
+    qtutil::connect(&getActions().rotateClockwise,
+                    &QAction::triggered,
+                    &getImageWidget(),
+                    &ImageWidget::rotateClockwise);
+    qtutil::connect(&getActions().rotateCounterclockwise,
+                    &QAction::triggered,
+                    &getImageWidget(),
+                    &ImageWidget::rotateCounterclockwise);
+    qtutil::connect(&getActions().flipHorizontally,
+                    &QAction::triggered,
+                    &getImageWidget(),
+                    &ImageWidget::flipHorizontally);
+    qtutil::connect(&getActions().flipVertically,
+                    &QAction::triggered,
+                    &getImageWidget(),
+                    &ImageWidget::flipVertically);
+
+    // -- display adjustment actions
+
+    auto& widget = getImageWidget();
+    auto step = [&](QAction& action, void (ImageWidget::*func)(int), int n) {
+      qtutil::connect(
+        &action, &QAction::triggered, &widget, [&widget, func, n] {
+          (widget.*func)(n);
+        });
+    };
+    step(getActions().increaseExposure, &ImageWidget::stepExposure, 1);
+    step(getActions().decreaseExposure, &ImageWidget::stepExposure, -1);
+    step(getActions().increaseBrightness, &ImageWidget::stepBrightness, 1);
+    step(getActions().decreaseBrightness, &ImageWidget::stepBrightness, -1);
+    step(getActions().increaseContrast, &ImageWidget::stepContrast, 1);
+    step(getActions().decreaseContrast, &ImageWidget::stepContrast, -1);
+    step(getActions().increaseGamma, &ImageWidget::stepGamma, 1);
+    step(getActions().decreaseGamma, &ImageWidget::stepGamma, -1);
+
+    auto channel = [&](QAction& action, Channel which) {
+      qtutil::connect(&action, &QAction::triggered, &widget, [&widget, which] {
+        widget.showChannel(which);
+      });
+    };
+    channel(getActions().showAllChannels, Channel::all);
+    channel(getActions().showRed, Channel::red);
+    channel(getActions().showGreen, Channel::green);
+    channel(getActions().showBlue, Channel::blue);
+    channel(getActions().showAlpha, Channel::alpha);
+    channel(getActions().showLuma, Channel::luma);
+
+    qtutil::connect(&getActions().showCheckerboard,
+                    &QAction::triggered,
+                    &widget,
+                    &ImageWidget::showCheckerboard);
+    qtutil::connect(&getActions().resetAdjustments,
+                    &QAction::triggered,
+                    &widget,
+                    &ImageWidget::resetDisplayAdjustments);
+
     // -- image controller signals
 
     qtutil::connect(&getImageController(),
@@ -119,6 +218,18 @@ namespace dumageview {
                     &ImageController::imageChanged,
                     &getMenuMaker(),
                     &MenuMaker::enableImageActions);
+    qtutil::connect(&getImageController(),
+                    &ImageController::imageInfoChanged,
+                    &getMainWindow(),
+                    &MainWindow::updateInfo);
+    qtutil::connect(&getImageController(),
+                    &ImageController::playingChanged,
+                    &getActions().playAnimation,
+                    &QAction::setChecked);
+    qtutil::connect(&getImageController(),
+                    &ImageController::playbackStatsChanged,
+                    &getMainWindow(),
+                    &MainWindow::setPlaybackStats);
     qtutil::connect(
       &getImageController(),
       &ImageController::openFailed,
@@ -150,13 +261,19 @@ namespace dumageview {
   // Dialogs
   //
 
-  QString AppController::dialogFilter() const {
+  QString AppController::dialogFilter(bool withArchives) const {
     using ES = FileDialogRunner::ExtensionSet;
     auto const& exts = getImageController().getValidFileExtensions();
     auto imgFilter = FileDialogRunner::makeSelectionFilter(
       "Images"s,
       ES(std::begin(exts), std::end(exts))
     );
+    if (withArchives) {
+      imgFilter += ";;" + FileDialogRunner::makeSelectionFilter(
+        "Archives"s,
+        ES{"cbt", "cbz", "tar", "zip"}
+      );
+    }
     return imgFilter + ";;All Files (*)";
   }
 
@@ -171,7 +288,7 @@ namespace dumageview {
                                       &getMainWindow(),
                                       "Open Image",
                                       getImageController().getDialogDir(),
-                                      dialogFilter());
+                                      dialogFilter(true));
   }
 
   void AppController::saveImage() {
@@ -185,6 +302,6 @@ namespace dumageview {
                                       &getMainWindow(),
                                       "Save Image",
                                       getImageController().getDialogDir(),
-                                      dialogFilter());
+                                      dialogFilter(false));
   }
 }
@@ -26,7 +26,7 @@ namespace dumageview {
    private:
     void setupConnections();
 
-    QString dialogFilter() const;
+    QString dialogFilter(bool withArchives) const;
 
     //
     // Private accessors
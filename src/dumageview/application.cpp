@@ -37,7 +37,8 @@ namespace dumageview::application {
     auto surfaceFormat = QSurfaceFormat::defaultFormat();
     surfaceFormat.setRenderableType(QSurfaceFormat::OpenGL);
     surfaceFormat.setVersion(2, 1);
-    surfaceFormat.setSwapInterval(0);
+    // sync to the display; ImageWidget paces frames on the swaps
+    surfaceFormat.setSwapInterval(1);
     QSurfaceFormat::setDefaultFormat(surfaceFormat);
 
     setApplicationName("Dumageview");
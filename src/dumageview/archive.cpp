@@ -0,0 +1,413 @@
+#include "dumageview/archive.h"
+
+#include "dumageview/conv_str.h"
+#include "dumageview/log.h"
+#include "dumageview/scopeguard.h"
+
+#include <fmt/format.h>
+#include <fmt/ostream.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <locale>
+#include <optional>
+#include <string_view>
+
+#include <zlib.h>
+
+namespace dumageview::archive {
+  namespace {
+    using namespace std::literals;
+
+    //
+    // Zip record layouts (little-endian)
+    //
+
+    constexpr std::uint32_t zipEndSig = 0x06054b50;
+    constexpr std::uint32_t zip64EndSig = 0x06064b50;
+    constexpr std::uint32_t zip64LocatorSig = 0x07064b50;
+    constexpr std::uint32_t zipCentralSig = 0x02014b50;
+    constexpr std::uint32_t zipLocalSig = 0x04034b50;
+
+    constexpr std::uint64_t zipEndSize = 22;
+    constexpr std::uint64_t zip64LocatorSize = 20;
+    constexpr std::uint64_t zip64EndSize = 56;
+    constexpr std::uint64_t zipCentralSize = 46;
+    constexpr std::uint64_t zipLocalSize = 30;
+    constexpr std::uint64_t zipMaxComment = 0xffff;
+
+    constexpr std::uint16_t zip64ExtraId = 0x0001;
+
+    //
+    // Tar layout
+    //
+
+    constexpr std::uint64_t tarBlock = 512;
+
+    std::uint64_t readLE(uchar const* p, int numBytes) {
+      std::uint64_t value = 0;
+      for (int i = numBytes - 1; i >= 0; --i) {
+        value = (value << 8) | p[i];
+      }
+      return value;
+    }
+
+    std::uint16_t read16(uchar const* p) {
+      return static_cast<std::uint16_t>(readLE(p, 2));
+    }
+
+    std::uint32_t read32(uchar const* p) {
+      return static_cast<std::uint32_t>(readLE(p, 4));
+    }
+
+    std::uint64_t read64(uchar const* p) {
+      return readLE(p, 8);
+    }
+
+    std::string_view tarString(uchar const* p, std::size_t maxLen) {
+      auto const* s = reinterpret_cast<char const*>(p);
+      return {s, ::strnlen(s, maxLen)};
+    }
+
+    std::uint64_t tarNumber(uchar const* p, std::size_t len) {
+      // GNU base-256 for values that do not fit in octal
+      if (p[0] & 0x80) {
+        std::uint64_t value = p[0] & 0x7f;
+        for (std::size_t i = 1; i < len; ++i) {
+          value = (value << 8) | p[i];
+        }
+        return value;
+      }
+
+      std::uint64_t value = 0;
+      for (std::size_t i = 0; i < len; ++i) {
+        if (p[i] >= '0' && p[i] <= '7') {
+          value = (value << 3) | static_cast<std::uint64_t>(p[i] - '0');
+        } else if (p[i] != ' ' || value != 0) {
+          break;
+        }
+      }
+      return value;
+    }
+
+    std::uint64_t tarPadded(std::uint64_t size) {
+      return (size + tarBlock - 1) / tarBlock * tarBlock;
+    }
+
+    /**
+     * Finds "path" in a pax extended header.
+     */
+    std::optional<std::string> paxPath(std::string_view records) {
+      // each record is "<len> <key>=<value>\n"
+      while (!records.empty()) {
+        auto space = records.find(' ');
+        if (space == std::string_view::npos) {
+          break;
+        }
+        std::size_t len = 0;
+        for (char c : records.substr(0, space)) {
+          len = len * 10 + static_cast<std::size_t>(c - '0');
+        }
+        if (len <= space || len > records.size()) {
+          break;
+        }
+
+        auto record = records.substr(space + 1, len - space - 2);
+        if (boost::starts_with(record, "path="sv)) {
+          return std::string(record.substr(5));
+        }
+        records.remove_prefix(len);
+      }
+      return std::nullopt;
+    }
+
+    std::string lowerExtension(Path const& path) {
+      auto ext = path.extension().string();
+      boost::to_lower(ext, std::locale::classic());
+      return ext;
+    }
+  }
+
+  bool Archive::isArchive(Path const& path) {
+    auto ext = lowerExtension(path);
+    return ext == ".zip" || ext == ".cbz" || ext == ".tar" || ext == ".cbt";
+  }
+
+  Archive::Archive(Path const& path)
+      : path_(path), file_(conv::qstr(path.string())) {
+    if (!file_.open(QIODevice::ReadOnly)) {
+      throw Error(conv::str(file_.errorString()));
+    }
+
+    size_ = static_cast<std::uint64_t>(file_.size());
+    if (size_ > 0) {
+      map_ = file_.map(0, file_.size());
+      if (!map_) {
+        throw Error(conv::str(file_.errorString()));
+      }
+    }
+
+    auto ext = lowerExtension(path);
+    isZip_ = (ext == ".zip" || ext == ".cbz");
+
+    if (isZip_) {
+      indexZip();
+    } else {
+      indexTar();
+    }
+
+    DUMAGEVIEW_LOG_DEBUG("Indexed {} members in {}", members_.size(), path_);
+  }
+
+  Archive::~Archive() {
+    if (map_) {
+      file_.unmap(map_);
+    }
+  }
+
+  uchar const* Archive::at(std::uint64_t offset, std::uint64_t length) const {
+    if (offset > size_ || length > size_ - offset) {
+      throw Error("archive is truncated or corrupt");
+    }
+    return map_ + offset;
+  }
+
+  //
+  // Indexing
+  //
+
+  void Archive::indexZip() {
+    // end record sits before an optional comment of up to 64 KiB
+    if (size_ < zipEndSize) {
+      throw Error("not a zip archive");
+    }
+    std::uint64_t endPos = size_ - zipEndSize;
+    std::uint64_t stop = (endPos > zipMaxComment) ? endPos - zipMaxComment : 0;
+
+    while (read32(at(endPos, 4)) != zipEndSig) {
+      if (endPos == stop) {
+        throw Error("zip end of central directory not found");
+      }
+      --endPos;
+    }
+
+    auto const* end = at(endPos, zipEndSize);
+    std::uint64_t numEntries = read16(end + 10);
+    std::uint64_t dirOffset = read32(end + 16);
+
+    // zip64 keeps the real values in a separate record
+    if (numEntries == 0xffff || dirOffset == 0xffffffff) {
+      if (endPos < zip64LocatorSize) {
+        throw Error("zip64 locator missing");
+      }
+      auto const* locator = at(endPos - zip64LocatorSize, zip64LocatorSize);
+      if (read32(locator) != zip64LocatorSig) {
+        throw Error("zip64 locator missing");
+      }
+      auto const* end64 = at(read64(locator + 8), zip64EndSize);
+      if (read32(end64) != zip64EndSig) {
+        throw Error("zip64 end of central directory not found");
+      }
+      numEntries = read64(end64 + 32);
+      dirOffset = read64(end64 + 48);
+    }
+
+    members_.reserve(
+      std::min<std::uint64_t>(numEntries, size_ / zipCentralSize));
+
+    std::uint64_t pos = dirOffset;
+    for (std::uint64_t i = 0; i < numEntries; ++i) {
+      auto const* header = at(pos, zipCentralSize);
+      if (read32(header) != zipCentralSig) {
+        throw Error("bad zip central directory entry");
+      }
+
+      std::uint16_t flags = read16(header + 8);
+      std::uint16_t method = read16(header + 10);
+      std::uint64_t compressedSize = read32(header + 20);
+      std::uint64_t size = read32(header + 24);
+      std::uint16_t nameLen = read16(header + 28);
+      std::uint16_t extraLen = read16(header + 30);
+      std::uint16_t commentLen = read16(header + 32);
+      std::uint64_t offset = read32(header + 42);
+
+      auto const* name = at(pos + zipCentralSize, nameLen);
+      auto const* extra = at(pos + zipCentralSize + nameLen, extraLen);
+      pos += zipCentralSize + nameLen + extraLen + commentLen;
+
+      // zip64 extra field holds only the values that overflowed, in order
+      for (std::uint64_t e = 0; e + 4 <= extraLen;) {
+        std::uint16_t id = read16(extra + e);
+        std::uint16_t len = read16(extra + e + 2);
+        if (id == zip64ExtraId) {
+          auto const* field = extra + e + 4;
+          auto const* fieldEnd =
+            field + std::min<std::uint64_t>(len, extraLen - e - 4);
+          for (auto* value : {&size, &compressedSize, &offset}) {
+            if (*value == 0xffffffff && field + 8 <= fieldEnd) {
+              *value = read64(field);
+              field += 8;
+            }
+          }
+        }
+        e += 4 + len;
+      }
+
+      Member member;
+      member.name.assign(reinterpret_cast<char const*>(name), nameLen);
+      member.offset = offset;
+      member.compressedSize = compressedSize;
+      member.size = size;
+
+      bool encrypted = flags & 0x1;
+      if (encrypted) {
+        member.method = Method::unsupported;
+      } else if (method == 0 && size == compressedSize) {
+        member.method = Method::stored;
+      } else if (method == 8) {
+        member.method = Method::deflated;
+      } else {
+        member.method = Method::unsupported;
+      }
+
+      if (!boost::ends_with(member.name, "/")) {
+        members_.push_back(std::move(member));
+      }
+    }
+  }
+
+  void Archive::indexTar() {
+    std::optional<std::string> longName;
+
+    std::uint64_t pos = 0;
+    while (pos + tarBlock <= size_) {
+      auto const* header = at(pos, tarBlock);
+
+      // two zero blocks mark the end; one is enough to stop
+      auto isZero = [](uchar c) { return c == 0; };
+      if (std::all_of(header, header + tarBlock, isZero)) {
+        break;
+      }
+
+      std::uint64_t size = tarNumber(header + 124, 12);
+      char type = static_cast<char>(header[156]);
+      std::uint64_t dataPos = pos + tarBlock;
+      pos = dataPos + tarPadded(size);
+
+      auto const* data = at(dataPos, size);
+      auto dataView =
+        std::string_view(reinterpret_cast<char const*>(data), size);
+
+      switch (type) {
+        case 'L':  // GNU long name for the next entry
+          longName = std::string(tarString(data, size));
+          continue;
+
+        case 'x':  // pax header for the next entry
+          if (auto path = paxPath(dataView)) {
+            longName = std::move(path);
+          }
+          continue;
+
+        case '0':
+        case '\0':
+        case '7':
+          break;
+
+        default:
+          longName.reset();
+          continue;
+      }
+
+      Member member;
+      if (longName) {
+        member.name = std::move(*longName);
+        longName.reset();
+      } else {
+        auto name = tarString(header, 100);
+        auto prefix = tarString(header + 345, 155);
+        bool ustar = tarString(header + 257, 6).substr(0, 5) == "ustar"sv;
+
+        if (ustar && !prefix.empty()) {
+          member.name = fmt::format("{}/{}", prefix, name);
+        } else {
+          member.name = std::string(name);
+        }
+      }
+
+      member.offset = dataPos;
+      member.compressedSize = size;
+      member.size = size;
+      member.method = Method::stored;
+      members_.push_back(std::move(member));
+    }
+  }
+
+  //
+  // Reading
+  //
+
+  QByteArray Archive::read(Member const& member) const {
+    if (member.size > INT_MAX || member.compressedSize > INT_MAX) {
+      throw Error(fmt::format("member too large: {}", member.name));
+    }
+
+    std::uint64_t dataPos = member.offset;
+
+    if (isZip_) {
+      // local header may carry a different extra field than the central one
+      auto const* local = at(member.offset, zipLocalSize);
+      if (read32(local) != zipLocalSig) {
+        throw Error(fmt::format("bad local header: {}", member.name));
+      }
+      dataPos += zipLocalSize + read16(local + 26) + read16(local + 28);
+    }
+
+    auto const* data = at(dataPos, member.compressedSize);
+
+    switch (member.method) {
+      case Method::stored:
+        // the view must not reach past what was bounds-checked above
+        if (member.size != member.compressedSize) {
+          throw Error(fmt::format("bad stored size: {}", member.name));
+        }
+        // zero-copy view into the mapping
+        return QByteArray::fromRawData(reinterpret_cast<char const*>(data),
+                                       static_cast<int>(member.size));
+
+      case Method::deflated: {
+        QByteArray out(static_cast<int>(member.size), Qt::Uninitialized);
+
+        z_stream zs{};
+        if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+          throw Error("could not initialize zlib");
+        }
+        auto guard = ScopeGuard{[&] { inflateEnd(&zs); }};
+
+        zs.next_in = const_cast<Bytef*>(data);
+        zs.avail_in = static_cast<uInt>(member.compressedSize);
+        zs.next_out = reinterpret_cast<Bytef*>(out.data());
+        zs.avail_out = static_cast<uInt>(member.size);
+
+        int rc = inflate(&zs, Z_FINISH);
+        if (rc != Z_STREAM_END) {
+          throw Error(fmt::format("could not inflate {}: {}",
+                                  member.name,
+                                  zs.msg ? zs.msg : "bad data"));
+        }
+        // a short stream would leave the end of out uninitialized
+        if (zs.total_out != member.size) {
+          throw Error(fmt::format("inflated size mismatch: {}", member.name));
+        }
+        return out;
+      }
+
+      case Method::unsupported:
+        break;
+    }
+    throw Error(fmt::format("unsupported compression: {}", member.name));
+  }
+}
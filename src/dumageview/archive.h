@@ -0,0 +1,98 @@
+#ifndef DUMAGEVIEW_ARCHIVE_H_
+#define DUMAGEVIEW_ARCHIVE_H_
+
+#include <QByteArray>
+#include <QFile>
+
+#include <boost/filesystem.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace dumageview::archive {
+  using Path = boost::filesystem::path;
+
+  class Error : public virtual std::runtime_error {
+   public:
+    using std::runtime_error::runtime_error;
+  };
+
+  enum class Method {
+    stored,
+    deflated,
+    unsupported,
+  };
+
+  struct Member {
+    std::string name;
+    std::uint64_t offset{0};  // zip: local header; tar: data
+    std::uint64_t compressedSize{0};
+    std::uint64_t size{0};
+    Method method{Method::stored};
+  };
+
+  /**
+   * Read-only view of a zip (cbz) or tar archive.
+   *
+   * The archive is memory-mapped and its index is built once on construction.
+   * Stored members are returned as views of the mapping without copying, so
+   * the archive must outlive any data read from it.
+   */
+  class Archive {
+   public:
+    /**
+     * Guesses from the extension whether path names a supported archive.
+     */
+    static bool isArchive(Path const& path);
+
+    /**
+     * Maps and indexes the archive. Throws Error on failure.
+     */
+    explicit Archive(Path const& path);
+
+    ~Archive();
+
+    Path const& getPath() const {
+      return path_;
+    }
+
+    std::vector<Member> const& getMembers() const {
+      return members_;
+    }
+
+    /**
+     * Returns the contents of a member. Throws Error on failure.
+     */
+    QByteArray read(Member const& member) const;
+
+   private:
+    Archive(Archive const&) = delete;
+    Archive& operator=(Archive const&) = delete;
+
+    void indexZip();
+    void indexTar();
+
+    uchar const* at(std::uint64_t offset, std::uint64_t length) const;
+
+    //
+    // Private data
+    //
+
+    Path path_;
+    QFile file_;
+    uchar* map_ = nullptr;
+    std::uint64_t size_ = 0;
+    bool isZip_ = false;
+
+    std::vector<Member> members_;
+  };
+}
+
+namespace dumageview {
+  using archive::Archive;
+}
+
+#endif  // DUMAGEVIEW_ARCHIVE_H_
@@ -4,18 +4,60 @@
 #include <fmt/ostream.h>
 
 #include <string>
+#include <vector>
+
+#include <glob.h>
 
 namespace dumageview::cmdline {
+  namespace {
+    /**
+     * Expands a glob pattern the shell left alone (e.g. because it was
+     * quoted). Patterns with no matches are kept as-is, so they fail later
+     * with a useful message.
+     */
+    void expandGlob(std::string const& pattern, std::vector<Path>& out) {
+      if (pattern.find_first_of("*?[") == std::string::npos) {
+        out.emplace_back(pattern);
+        return;
+      }
+
+      glob_t matches{};
+      int flags = GLOB_NOCHECK | GLOB_TILDE;
+      if (::glob(pattern.c_str(), flags, nullptr, &matches) != 0) {
+        out.emplace_back(pattern);
+      } else {
+        for (std::size_t i = 0; i < matches.gl_pathc; ++i) {
+          out.emplace_back(matches.gl_pathv[i]);
+        }
+      }
+      ::globfree(&matches);
+    }
+  }
+
   Parser::Parser(int argc, char** argv)
       : parser_(argc, argv) {
-    generalOpts_.add_options()("help,h", "display help message");
-
-    hiddenOpts_.add_options()("input", po::value<std::string>(), "input image");
+    generalOpts_.add_options()("help,h", "display help message")(
+      "files-from",
+      po::value<std::string>()->value_name("FILE"),
+      "read image paths from FILE, one per line ('-' for stdin)")(
+      "legacy-gl", "draw with fixed-function OpenGL instead of shaders")(
+      "software", "draw on the CPU instead of with OpenGL")(
+      "render-thread", "draw with OpenGL on a thread of its own")(
+      "driver-mipmaps", "let the OpenGL driver build mipmaps")(
+      "texture-cache",
+      po::value<std::size_t>()->value_name("MIB"),
+      "keep up to MIB of textures for recently shown images")(
+      "display-profile",
+      po::value<std::string>()->value_name("FILE"),
+      "convert colors to the ICC profile in FILE instead of sRGB");
+
+    hiddenOpts_.add_options()(
+      "input", po::value<std::vector<std::string>>(), "input images");
 
     visibleOpts_.add(generalOpts_);
     allOpts_.add(generalOpts_).add(hiddenOpts_);
 
-    positionalArgs_.add("input", 1);
+    positionalArgs_.add("input", -1);
 
     parser_.options(allOpts_);
     parser_.positional(positionalArgs_);
@@ -36,17 +78,48 @@ namespace dumageview::cmdline {
       throw HelpError("Usage:");
     }
 
-    // check input image path
-    std::optional<Path> imagePath;
+    // check input image paths
+    std::vector<Path> imagePaths;
 
     if (varMap.find("input") != varMap.end()) {
-      std::string inputArg = varMap.at("input").as<std::string>();
-
       // TODO: check for existence
-      imagePath.emplace(inputArg);
+      for (auto const& arg : varMap.at("input").as<std::vector<std::string>>()) {
+        expandGlob(arg, imagePaths);
+      }
+    }
+
+    std::optional<Path> fileListPath;
+
+    if (varMap.find("files-from") != varMap.end()) {
+      fileListPath.emplace(varMap.at("files-from").as<std::string>());
+    }
+
+    bool legacyGl = varMap.find("legacy-gl") != varMap.end();
+    bool software = varMap.find("software") != varMap.end();
+    bool renderThread = varMap.find("render-thread") != varMap.end();
+    bool driverMipmaps = varMap.find("driver-mipmaps") != varMap.end();
+
+    std::optional<std::size_t> textureCacheMiB;
+
+    if (varMap.find("texture-cache") != varMap.end()) {
+      textureCacheMiB = varMap.at("texture-cache").as<std::size_t>();
+    }
+
+    std::optional<Path> displayProfilePath;
+
+    if (varMap.find("display-profile") != varMap.end()) {
+      displayProfilePath.emplace(
+        varMap.at("display-profile").as<std::string>());
     }
 
-    return {imagePath};
+    return {imagePaths,
+            fileListPath,
+            legacyGl,
+            software,
+            renderThread,
+            driverMipmaps,
+            textureCacheMiB,
+            displayProfilePath};
   }
 
   void Parser::printUsage() {
@@ -4,7 +4,9 @@
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
 
+#include <cstddef>
 #include <optional>
+#include <vector>
 
 namespace dumageview::cmdline {
   namespace po = boost::program_options;
@@ -12,7 +14,14 @@ namespace dumageview::cmdline {
   using Path = boost::filesystem::path;
 
   struct Args {
-    std::optional<Path> imagePath;
+    std::vector<Path> imagePaths;  // globs already expanded
+    std::optional<Path> fileListPath;  // "-" for stdin
+    bool legacyGl = false;
+    bool software = false;
+    bool renderThread = false;
+    bool driverMipmaps = false;
+    std::optional<std::size_t> textureCacheMiB;
+    std::optional<Path> displayProfilePath;
   };
 
   class Parser {
@@ -0,0 +1,229 @@
+#include "dumageview/colorlut.h"
+
+#include "dumageview/log.h"
+
+#include <QtGlobal>
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+#include <QColorSpace>
+#include <QColorTransform>
+#include <QRgba64>
+#endif
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace dumageview::colorlut {
+  namespace {
+    // 33 points per axis put a grid point on every eighth 8-bit value,
+    // which is what color management engines commonly use
+    constexpr int lutSize = 33;
+
+    // fewer rows than this are not worth a thread
+    constexpr int minRowsPerBand = 64;
+
+    /**
+     * The table as floats in 8-bit units, four per point, so a point is
+     * one load.
+     */
+    std::vector<float> toFloats(ColorLut const& lut) {
+      std::vector<float> floats;
+      floats.reserve(lut.table.size() / 3 * 4);
+      for (std::size_t i = 0; i < lut.table.size(); i += 3) {
+        for (std::size_t c = 0; c < 3; ++c) {
+          floats.push_back(lut.table[i + c] * (255.0f / 65535.0f));
+        }
+        floats.push_back(0.0f);
+      }
+      return floats;
+    }
+
+    /**
+     * Interpolates within the tetrahedron of the grid cell that holds the
+     * color: the one whose corners step along the axes in order of how far
+     * the color is along each.
+     */
+    QRgb lookup(QRgb color, float const* table, int size) {
+      int steps[3] = {4, 4 * size, 4 * size * size};
+      int channels[3] = {qRed(color), qGreen(color), qBlue(color)};
+
+      int base = 0;
+      float fracs[3];
+      int offsets[3];
+      for (int c = 0; c < 3; ++c) {
+        int pos = channels[c] * (size - 1);
+        int index = std::min(pos / 255, size - 2);
+        fracs[c] = static_cast<float>(pos - index * 255) / 255.0f;
+        offsets[c] = steps[c];
+        base += index * steps[c];
+      }
+
+      // largest fraction first
+      auto order = [&](int a, int b) {
+        if (fracs[a] < fracs[b]) {
+          std::swap(fracs[a], fracs[b]);
+          std::swap(offsets[a], offsets[b]);
+        }
+      };
+      order(0, 1);
+      order(1, 2);
+      order(0, 1);
+
+      float const* v0 = table + base;
+      float const* v1 = v0 + offsets[0];
+      float const* v2 = v1 + offsets[1];
+      float const* v3 = v2 + offsets[2];
+      float w0 = 1.0f - fracs[0];
+      float w1 = fracs[0] - fracs[1];
+      float w2 = fracs[1] - fracs[2];
+      float w3 = fracs[2];
+
+#if defined(__SSE2__)
+      auto sum = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(_mm_set1_ps(w0), _mm_loadu_ps(v0)),
+                   _mm_mul_ps(_mm_set1_ps(w1), _mm_loadu_ps(v1))),
+        _mm_add_ps(_mm_mul_ps(_mm_set1_ps(w2), _mm_loadu_ps(v2)),
+                   _mm_mul_ps(_mm_set1_ps(w3), _mm_loadu_ps(v3))));
+      auto ints = _mm_cvttps_epi32(_mm_add_ps(sum, _mm_set1_ps(0.5f)));
+      auto words = _mm_packs_epi32(ints, ints);
+      auto bytes = _mm_packus_epi16(words, words);
+      auto rgb = static_cast<unsigned>(_mm_cvtsi128_si32(bytes));
+      return qRgba(static_cast<int>(rgb & 0xff),
+                   static_cast<int>((rgb >> 8) & 0xff),
+                   static_cast<int>((rgb >> 16) & 0xff),
+                   qAlpha(color));
+#else
+      int out[3];
+      for (int c = 0; c < 3; ++c) {
+        float value = w0 * v0[c] + w1 * v1[c] + w2 * v2[c] + w3 * v3[c];
+        out[c] = std::clamp(static_cast<int>(value + 0.5f), 0, 255);
+      }
+      return qRgba(out[0], out[1], out[2], qAlpha(color));
+#endif
+    }
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    std::shared_ptr<ColorLut const> makeLut(QByteArray const& source,
+                                            QByteArray const& display) {
+      auto from = QColorSpace::fromIccProfile(source);
+      auto to = display.isEmpty() ? QColorSpace{QColorSpace::SRgb}
+                                  : QColorSpace::fromIccProfile(display);
+      if (!from.isValid() || !to.isValid()) {
+        log::warn("Could not use color profile; showing colors as stored");
+        return nullptr;
+      }
+      if (from == to) {
+        return nullptr;
+      }
+
+      auto transform = from.transformationToColorSpace(to);
+      auto lut = std::make_shared<ColorLut>();
+      lut->size = lutSize;
+      lut->table.reserve(std::size_t{lutSize * lutSize * lutSize * 3});
+
+      auto toUnit = [](int i) {
+        return static_cast<quint16>((i * 65535 + (lutSize - 1) / 2)
+                                    / (lutSize - 1));
+      };
+      for (int b = 0; b < lutSize; ++b) {
+        for (int g = 0; g < lutSize; ++g) {
+          for (int r = 0; r < lutSize; ++r) {
+            auto mapped = transform.map(
+              QRgba64::fromRgba64(toUnit(r), toUnit(g), toUnit(b), 65535));
+            lut->table.push_back(mapped.red());
+            lut->table.push_back(mapped.green());
+            lut->table.push_back(mapped.blue());
+          }
+        }
+      }
+
+      DUMAGEVIEW_LOG_DEBUG("Built {0}x{0}x{0} color LUT for {1}",
+                           lutSize,
+                           from.description().toStdString());
+      return lut;
+    }
+#endif
+  }
+
+  bool isAvailable() {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  QByteArray getProfile(QImage const& image) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    return image.colorSpace().iccProfile();
+#else
+    Q_UNUSED(image);
+    return {};
+#endif
+  }
+
+  QImage setProfile(QImage image, QByteArray const& profile) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    if (!profile.isEmpty()) {
+      image.setColorSpace(QColorSpace::fromIccProfile(profile));
+    }
+#else
+    Q_UNUSED(profile);
+#endif
+    return image;
+  }
+
+  std::shared_ptr<ColorLut const> getLut(QByteArray const& source,
+                                         QByteArray const& display) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    if (source.isEmpty()) {
+      return nullptr;
+    }
+
+    // there are only ever a few profiles about, so nothing is evicted
+    static std::mutex mutex;
+    static std::map<std::pair<QByteArray, QByteArray>,
+                    std::shared_ptr<ColorLut const>>
+      cache;
+
+    std::lock_guard lock{mutex};
+    auto [it, added] = cache.try_emplace({source, display});
+    if (added) {
+      it->second = makeLut(source, display);
+    }
+    return it->second;
+#else
+    Q_UNUSED(source);
+    Q_UNUSED(display);
+    return nullptr;
+#endif
+  }
+
+  QImage apply(QImage const& image, ColorLut const& lut, WorkerPool& pool) {
+    auto src = image.convertToFormat(QImage::Format_ARGB32);
+    QImage dst(src.size(), QImage::Format_ARGB32);
+    if (src.isNull() || dst.isNull()) {
+      return dst;
+    }
+
+    auto table = toFloats(lut);
+    auto doRows = [&](int begin, int end) {
+      for (int y = begin; y < end; ++y) {
+        auto const* in = reinterpret_cast<QRgb const*>(src.constScanLine(y));
+        auto* out = reinterpret_cast<QRgb*>(dst.scanLine(y));
+        for (int x = 0; x < src.width(); ++x) {
+          out[x] = lookup(in[x], table.data(), lut.size);
+        }
+      }
+    };
+
+    pool.forBands(src.height(), minRowsPerBand, doRows);
+    return dst;
+  }
+}
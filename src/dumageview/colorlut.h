@@ -0,0 +1,59 @@
+#ifndef DUMAGEVIEW_COLORLUT_H_
+#define DUMAGEVIEW_COLORLUT_H_
+
+#include "dumageview/workerpool.h"
+
+#include <QByteArray>
+#include <QImage>
+
+#include <memory>
+#include <vector>
+
+namespace dumageview::colorlut {
+  /**
+   * A conversion from one ICC profile to another, sampled on a grid of
+   * RGB values. The GPU interpolates it as a 3D texture; the CPU does so
+   * tetrahedrally.
+   */
+  struct ColorLut {
+    int size = 0;  // grid points along each axis
+    std::vector<quint16> table;  // RGB per point; red varies fastest
+  };
+
+  /**
+   * Whether this build can read profiles, which takes Qt 5.14.
+   */
+  bool isAvailable();
+
+  /**
+   * The ICC profile an image was tagged with when it was read, if any.
+   */
+  QByteArray getProfile(QImage const& image);
+
+  /**
+   * Tags an image with an ICC profile, for writers that embed one. Pixels
+   * are not changed.
+   */
+  QImage setProfile(QImage image, QByteArray const& profile);
+
+  /**
+   * Converts from the source profile to the display's; an empty display
+   * profile means sRGB. Null if the two are the same, or either cannot be
+   * used. Made once per pair of profiles, from any thread.
+   */
+  std::shared_ptr<ColorLut const> getLut(QByteArray const& source,
+                                         QByteArray const& display);
+
+  /**
+   * Maps an image's colors on the CPU, for when there is no shader to do
+   * it. Alpha is kept; the result is ARGB32. Rows are split across the
+   * pool.
+   */
+  QImage apply(QImage const& image, ColorLut const& lut, WorkerPool& pool);
+}
+
+namespace dumageview {
+  using colorlut::ColorLut;
+}
+
+#endif  // DUMAGEVIEW_COLORLUT_H_
@@ -0,0 +1,90 @@
+#include "dumageview/damage.h"
+
+#include <QRect>
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace dumageview::damage {
+  namespace {
+    // small enough to leave out most of what did not change, large enough
+    // that a region is a handful of rectangles
+    constexpr int blockSize = 32;
+
+    bool bytesEqual(uchar const* a, uchar const* b, std::size_t n) {
+      std::size_t i = 0;
+
+#if defined(__SSE2__)
+      for (; i + 16 <= n; i += 16) {
+        auto va = _mm_loadu_si128(reinterpret_cast<__m128i const*>(a + i));
+        auto vb = _mm_loadu_si128(reinterpret_cast<__m128i const*>(b + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xffff) {
+          return false;
+        }
+      }
+#endif
+
+      return std::memcmp(a + i, b + i, n - i) == 0;
+    }
+
+    /**
+     * Whether equal indices mean equal colors: one table is the start of
+     * the other. An index past the shorter table cannot appear in that
+     * image, so it always shows up as a change.
+     */
+    bool sharesColors(QImage const& before, QImage const& after) {
+      auto a = before.colorTable();
+      auto b = after.colorTable();
+      auto n = std::min(a.size(), b.size());
+      return std::equal(a.begin(), a.begin() + n, b.begin());
+    }
+  }
+
+  std::optional<QRegion> findChanges(QImage const& before,
+                                     QImage const& after) {
+    if (before.size() != after.size() || before.format() != after.format()
+        || !sharesColors(before, after) || before.depth() < 8) {
+      return std::nullopt;
+    }
+
+    int width = after.width();
+    int height = after.height();
+    int pixelBytes = after.depth() / 8;
+
+    QRegion changes;
+    for (int top = 0; top < height; top += blockSize) {
+      int rows = std::min(blockSize, height - top);
+
+      // runs of changed blocks in a band become one rectangle
+      int runStart = -1;
+      for (int left = 0; left < width; left += blockSize) {
+        int cols = std::min(blockSize, width - left);
+        auto offset = static_cast<std::size_t>(left * pixelBytes);
+        auto bytes = static_cast<std::size_t>(cols * pixelBytes);
+
+        bool changed = false;
+        for (int y = top; y < top + rows && !changed; ++y) {
+          changed = !bytesEqual(before.constScanLine(y) + offset,
+                                after.constScanLine(y) + offset,
+                                bytes);
+        }
+
+        if (changed && runStart < 0) {
+          runStart = left;
+        } else if (!changed && runStart >= 0) {
+          changes += QRect(runStart, top, left - runStart, rows);
+          runStart = -1;
+        }
+      }
+      if (runStart >= 0) {
+        changes += QRect(runStart, top, width - runStart, rows);
+      }
+    }
+
+    return changes;
+  }
+}
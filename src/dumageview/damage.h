@@ -0,0 +1,19 @@
+#ifndef DUMAGEVIEW_DAMAGE_H_
+#define DUMAGEVIEW_DAMAGE_H_
+
+#include <QImage>
+#include <QRegion>
+
+#include <optional>
+
+namespace dumageview::damage {
+  /**
+   * Where after differs from before, in blocks of a few dozen pixels.
+   * Returns nothing if the two cannot be compared pixel for pixel: their
+   * sizes or formats differ, or neither color table starts the other.
+   */
+  std::optional<QRegion> findChanges(QImage const& before,
+                                     QImage const& after);
+}
+
+#endif  // DUMAGEVIEW_DAMAGE_H_
@@ -0,0 +1,134 @@
+#include "dumageview/diskorder.h"
+
+#include "dumageview/log.h"
+#include "dumageview/scopeguard.h"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <fstream>
+#include <numeric>
+#include <optional>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+namespace dumageview::diskorder {
+  namespace {
+    std::optional<std::uint64_t> firstExtent(int fd) {
+#if defined(FS_IOC_FIEMAP)
+      // room for the header plus a single extent
+      alignas(struct fiemap) char
+        buffer[sizeof(struct fiemap) + sizeof(struct fiemap_extent)]{};
+      auto* map = reinterpret_cast<struct fiemap*>(buffer);
+
+      map->fm_start = 0;
+      map->fm_length = FIEMAP_MAX_OFFSET;
+      map->fm_extent_count = 1;
+
+      if (ioctl(fd, FS_IOC_FIEMAP, map) != 0) {
+        return std::nullopt;
+      }
+      if (map->fm_mapped_extents == 0) {
+        return std::nullopt;
+      }
+
+      // delayed allocation and inline data have no meaningful address
+      auto const& extent = map->fm_extents[0];
+      constexpr auto unusable =
+        FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC | FIEMAP_EXTENT_DATA_INLINE;
+      if (extent.fe_flags & unusable) {
+        return std::nullopt;
+      }
+      return extent.fe_physical;
+#else
+      return std::nullopt;
+#endif
+    }
+
+    bool readRotationalFlag(std::string const& sysPath) {
+      std::ifstream file{sysPath};
+      int flag = 0;
+      return (file >> flag) && flag != 0;
+    }
+  }
+
+  Location locate(Path const& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return {};
+    }
+    auto guard = ScopeGuard{[fd] { ::close(fd); }};
+
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+      return {};
+    }
+
+    Location loc;
+    loc.device = st.st_dev;
+
+    if (auto extent = firstExtent(fd)) {
+      loc.offset = *extent;
+      loc.physical = true;
+    } else {
+      loc.offset = st.st_ino;
+    }
+    return loc;
+  }
+
+  bool isRotational(Path const& path) {
+    struct stat st {};
+    if (::stat(path.c_str(), &st) != 0) {
+      return false;
+    }
+
+    // partitions keep the queue info on their parent device
+    auto devDir =
+      fmt::format("/sys/dev/block/{}:{}", major(st.st_dev), minor(st.st_dev));
+    return readRotationalFlag(devDir + "/queue/rotational")
+           || readRotationalFlag(devDir + "/../queue/rotational");
+  }
+
+  std::vector<std::size_t> physicalOrder(std::vector<Path> const& paths,
+                                         Policy policy,
+                                         std::size_t window) {
+    std::vector<std::size_t> order(paths.size());
+    std::iota(order.begin(), order.end(), std::size_t{0});
+
+    if (paths.size() < 2 || policy == Policy::never) {
+      return order;
+    }
+    if (policy == Policy::automatic && !isRotational(paths.front())) {
+      return order;
+    }
+
+    std::vector<Location> locations;
+    locations.reserve(paths.size());
+    for (auto const& path : paths) {
+      locations.push_back(locate(path));
+    }
+
+    window = std::max(window, std::size_t{1});
+    for (std::size_t begin = 0; begin < order.size(); begin += window) {
+      auto end = std::min(begin + window, order.size());
+      std::stable_sort(order.begin() + begin,
+                       order.begin() + end,
+                       [&](auto a, auto b) {
+                         return locations[a].key() < locations[b].key();
+                       });
+    }
+
+    DUMAGEVIEW_LOG_DEBUG("Ordered {} files by disk location", paths.size());
+    return order;
+  }
+}
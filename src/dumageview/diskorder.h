@@ -0,0 +1,129 @@
+#ifndef DUMAGEVIEW_DISKORDER_H_
+#define DUMAGEVIEW_DISKORDER_H_
+
+#include <boost/filesystem.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+/**
+ * \file
+ * Orders batch file reads by where the data lives on disk.
+ *
+ * Reading a directory in name order makes rotational drives seek between
+ * every file. Batch readers can ask for a physical read order here and still
+ * hand their results out in logical order.
+ */
+
+namespace dumageview::diskorder {
+  using Path = boost::filesystem::path;
+
+  /**
+   * Approximate on-disk location of the start of a file's data.
+   * If no extent info is available, the inode number is used instead, which
+   * tracks allocation order well enough on most filesystems.
+   */
+  struct Location {
+    std::uint64_t device{0};
+    std::uint64_t offset{0};
+    bool physical{false};  // offset is a byte address, not an inode number
+
+    auto key() const {
+      // extent-mapped files sort before inode-ordered ones on each device
+      return std::tuple{device, !physical, offset};
+    }
+  };
+
+  /**
+   * How far, in logical order, a batch may be read ahead of the first file
+   * not yet delivered. Bounds what InOrderDelivery holds back.
+   */
+  inline constexpr std::size_t defaultWindow{256};
+
+  enum class Policy {
+    automatic,  // sort only when the first file is on a rotational device
+    always,
+    never,
+  };
+
+  /**
+   * Looks up the location of one file. Never throws; unreadable files get a
+   * default location so they keep their relative order.
+   */
+  Location locate(Path const& path);
+
+  /**
+   * Whether the block device holding path reports itself as rotational.
+   * Returns false if unknown.
+   */
+  bool isRotational(Path const& path);
+
+  /**
+   * Returns a permutation of indices into paths in on-disk order, within
+   * each run of window paths in logical order, so that reading in this
+   * order never gets a window ahead of delivering. The sort is stable, so
+   * files with unknown location stay in logical order.
+   */
+  std::vector<std::size_t> physicalOrder(std::vector<Path> const& paths,
+                                         Policy policy = Policy::automatic,
+                                         std::size_t window = defaultWindow);
+
+  /**
+   * Buffers results that complete out of order and releases them in logical
+   * order.
+   */
+  template<class T>
+  class InOrderDelivery {
+   public:
+    template<class D>
+    void put(std::size_t index, T&& value, D&& deliver) {
+      pending_.emplace(index, std::move(value));
+
+      for (auto it = pending_.begin();
+           it != pending_.end() && it->first == next_;
+           it = pending_.erase(it)) {
+        deliver(next_, std::move(it->second));
+        ++next_;
+      }
+    }
+
+    std::size_t numPending() const {
+      return pending_.size();
+    }
+
+    /**
+     * Index of the next result to deliver; all before it are out.
+     */
+    std::size_t getNext() const {
+      return next_;
+    }
+
+   private:
+    std::size_t next_ = 0;
+    std::map<std::size_t, T> pending_;
+  };
+
+  /**
+   * Calls read on each path in physical order and deliver on each result in
+   * logical order. Fewer than window results are held back at a time.
+   */
+  template<class Read, class Deliver>
+  void forEachInPhysicalOrder(std::vector<Path> const& paths,
+                              Read&& read,
+                              Deliver&& deliver,
+                              Policy policy = Policy::automatic,
+                              std::size_t window = defaultWindow) {
+    using Result = decltype(read(paths.front()));
+    InOrderDelivery<Result> delivery;
+
+    for (std::size_t index : physicalOrder(paths, policy, window)) {
+      delivery.put(index, read(paths[index]), deliver);
+    }
+  }
+}
+
+#endif  // DUMAGEVIEW_DISKORDER_H_
@@ -0,0 +1,200 @@
+#include "dumageview/filelist.h"
+
+#include "dumageview/conv_str.h"
+#include "dumageview/log.h"
+
+#include <fmt/format.h>
+#include <fmt/ostream.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+
+namespace dumageview::filelist {
+  namespace {
+    constexpr std::size_t parseChunkEntries = 1 << 16;
+    constexpr std::size_t readChunkBytes = 1 << 20;
+  }
+
+  FileList::FileList(std::vector<Path> paths, std::optional<Path> const& listFile)
+      : paths_(std::move(paths)) {
+    if (!listFile) {
+      return;
+    }
+    complete_ = false;
+    eof_ = false;
+
+    bool opened = false;
+    if (listFile->string() == "-") {
+      opened = file_.open(stdin, QIODevice::ReadOnly);
+    } else {
+      file_.setFileName(conv::qstr(listFile->string()));
+      opened = file_.open(QIODevice::ReadOnly);
+    }
+
+    if (!opened) {
+      throw Error(fmt::format(
+        "could not open {}: {}", *listFile, conv::str(file_.errorString())));
+    }
+
+    // pipes and empty files cannot be mapped; those are read on reader_
+    if (!file_.isSequential() && file_.size() > 0) {
+      map_ = file_.map(0, file_.size());
+      eof_ = (map_ != nullptr);
+    }
+    if (!map_) {
+      if (::pipe(stopPipe_) != 0) {
+        throw Error(fmt::format(
+          "could not read {}: {}", *listFile, std::strerror(errno)));
+      }
+      reader_ = std::thread{[this, fd = file_.handle()] { readStream(fd); }};
+    }
+    DUMAGEVIEW_LOG_DEBUG("Reading file list {} ({})",
+                         *listFile,
+                         map_ ? "mapped" : "streamed");
+  }
+
+  FileList::~FileList() {
+    if (reader_.joinable()) {
+      char stop = 0;
+      [[maybe_unused]] auto written = ::write(stopPipe_[1], &stop, 1);
+      reader_.join();
+      ::close(stopPipe_[0]);
+      ::close(stopPipe_[1]);
+    }
+    if (map_) {
+      file_.unmap(map_);
+    }
+  }
+
+  //
+  // Parsing
+  //
+
+  std::string_view FileList::data() const {
+    if (map_) {
+      return {reinterpret_cast<char const*>(map_),
+              static_cast<std::size_t>(file_.size())};
+    }
+    return buffer_;
+  }
+
+  /**
+   * Takes what the reader has sent since last time. Never waits for more.
+   */
+  bool FileList::readChunk() {
+    if (eof_) {
+      return false;
+    }
+    std::lock_guard lock{mutex_};
+    if (incoming_.empty()) {
+      eof_ = readerDone_;
+      return false;
+    }
+    buffer_.append(incoming_);
+    incoming_.clear();
+    return true;
+  }
+
+  void FileList::readStream(int fd) {
+    std::vector<char> chunk(readChunkBytes);
+    pollfd fds[] = {{fd, POLLIN, 0}, {stopPipe_[0], POLLIN, 0}};
+
+    while (true) {
+      if (::poll(fds, 2, -1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        log::warn("Could not wait for file list: {}", std::strerror(errno));
+        break;
+      }
+      if (fds[1].revents != 0) {
+        break;
+      }
+
+      auto count = ::read(fd, chunk.data(), chunk.size());
+      if (count < 0 && (errno == EINTR || errno == EAGAIN)) {
+        continue;
+      }
+      if (count < 0) {
+        log::warn("Could not read file list: {}", std::strerror(errno));
+      }
+      if (count <= 0) {
+        break;
+      }
+
+      std::lock_guard lock{mutex_};
+      incoming_.append(chunk.data(), static_cast<std::size_t>(count));
+    }
+
+    std::lock_guard lock{mutex_};
+    readerDone_ = true;
+  }
+
+  bool FileList::parseMore(std::size_t maxEntries) {
+    std::size_t added = 0;
+    waiting_ = false;
+
+    while (!complete_ && added < maxEntries) {
+      auto view = data();
+      auto end = view.find('\n', parsePos_);
+
+      if (end == std::string_view::npos) {
+        if (readChunk()) {
+          continue;  // buffer may have moved
+        }
+        if (!eof_) {
+          waiting_ = true;  // the rest of the line has not arrived
+          break;
+        }
+        // last line may lack a newline
+        end = view.size();
+        if (parsePos_ >= end) {
+          complete_ = true;
+          break;
+        }
+      }
+
+      auto offset = parsePos_;
+      auto line = view.substr(offset, end - offset);
+      parsePos_ = end + 1;
+
+      if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+      }
+      if (line.empty()) {
+        continue;
+      }
+      entries_.push_back({offset, static_cast<std::uint32_t>(line.size())});
+      ++added;
+    }
+
+    if (complete_) {
+      DUMAGEVIEW_LOG_DEBUG("File list complete: {} entries", size());
+    }
+    return !complete_;
+  }
+
+  bool FileList::parseThrough(std::size_t index) {
+    while (index >= size() && parseMore(parseChunkEntries) && !waiting_) {
+    }
+    return index < size();
+  }
+
+  //
+  // Access
+  //
+
+  Path FileList::at(std::size_t index) const {
+    if (index < paths_.size()) {
+      return paths_[index];
+    }
+    auto const& entry = entries_.at(index - paths_.size());
+    return std::string(data().substr(entry.offset, entry.length));
+  }
+}
@@ -0,0 +1,123 @@
+#ifndef DUMAGEVIEW_FILELIST_H_
+#define DUMAGEVIEW_FILELIST_H_
+
+#include <QFile>
+
+#include <boost/filesystem.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace dumageview::filelist {
+  using Path = boost::filesystem::path;
+
+  class Error : public virtual std::runtime_error {
+   public:
+    using std::runtime_error::runtime_error;
+  };
+
+  /**
+   * Navigation list of image paths, parsed incrementally.
+   *
+   * Explicit paths come first, followed by the lines of an optional list
+   * file. Regular list files are memory-mapped and entries are kept as
+   * offsets into the mapping, so a list of millions of frames costs a few
+   * bytes per entry and the first entry is usable before the rest is parsed.
+   * Pipes are read on a thread of their own, so parsing never waits on them;
+   * it just stops until more has arrived.
+   */
+  class FileList {
+   public:
+    /**
+     * Creates a list from explicit paths and an optional list file.
+     * A list file of "-" reads from stdin. Throws Error if it cannot be opened.
+     */
+    FileList(std::vector<Path> paths, std::optional<Path> const& listFile);
+
+    ~FileList();
+
+    /**
+     * Parses up to maxEntries more entries, fewer if a stream has not sent
+     * them yet. Returns true if there may be more left.
+     */
+    bool parseMore(std::size_t maxEntries);
+
+    /**
+     * Parses until index is available, the list is exhausted, or a stream
+     * has nothing more yet.
+     */
+    bool parseThrough(std::size_t index);
+
+    bool isComplete() const {
+      return complete_;
+    }
+
+    /**
+     * True if the last parse stopped for want of input from a stream.
+     */
+    bool isWaiting() const {
+      return waiting_;
+    }
+
+    /**
+     * Number of entries parsed so far.
+     */
+    std::size_t size() const {
+      return paths_.size() + entries_.size();
+    }
+
+    Path at(std::size_t index) const;
+
+   private:
+    FileList(FileList const&) = delete;
+    FileList& operator=(FileList const&) = delete;
+
+    struct Entry {
+      std::uint64_t offset;
+      std::uint32_t length;
+    };
+
+    std::string_view data() const;
+    bool readChunk();
+
+    void readStream(int fd);  // on reader_
+
+    //
+    // Private data
+    //
+
+    std::vector<Path> paths_;
+    std::vector<Entry> entries_;
+
+    QFile file_;
+    uchar* map_ = nullptr;  // whole file, if it could be mapped
+    std::string buffer_;  // otherwise, what has been read so far
+    bool eof_ = true;
+
+    std::uint64_t parsePos_ = 0;
+    bool complete_ = true;
+    bool waiting_ = false;
+
+    // guarded by mutex_; filled by reader_ for buffer_ to take
+    std::mutex mutex_;
+    std::string incoming_;
+    bool readerDone_ = false;
+
+    int stopPipe_[2] = {-1, -1};  // written to make reader_ return
+    std::thread reader_;
+  };
+}
+
+namespace dumageview {
+  using filelist::FileList;
+}
+
+#endif  // DUMAGEVIEW_FILELIST_H_
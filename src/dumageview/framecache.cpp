@@ -0,0 +1,51 @@
+#include "dumageview/framecache.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+
+namespace dumageview::framecache {
+  namespace {
+    constexpr std::size_t budgetBytes = std::size_t{256} << 20;
+
+    std::size_t bytesOf(QImage const& image) {
+      return static_cast<std::size_t>(image.sizeInBytes());
+    }
+  }
+
+  FrameCache::FrameCache() : budget_(budgetBytes) {}
+
+  void FrameCache::clear() {
+    frames_.clear();
+    bytes_ = 0;
+  }
+
+  QImage const* FrameCache::find(int frame) const {
+    auto it = frames_.find(frame);
+    return it != frames_.end() ? &it->second : nullptr;
+  }
+
+  void FrameCache::insert(int frame, QImage const& image) {
+    if (!frames_.try_emplace(frame, image).second) {
+      return;
+    }
+    bytes_ += bytesOf(image);
+
+    // the furthest is always at one end or the other
+    while (bytes_ > budget_ && frames_.size() > 1) {
+      auto first = frames_.begin();
+      auto last = std::prev(frames_.end());
+      auto victim = (std::abs(frame - first->first)
+                     >= std::abs(last->first - frame))
+                      ? first
+                      : last;
+      bytes_ -= bytesOf(victim->second);
+      frames_.erase(victim);
+    }
+  }
+
+  int FrameCache::getCapacity(QImage const& sample) const {
+    auto frameBytes = std::max(bytesOf(sample), std::size_t{1});
+    return static_cast<int>(std::max(budget_ / frameBytes, std::size_t{1}));
+  }
+}
@@ -0,0 +1,44 @@
+#ifndef DUMAGEVIEW_FRAMECACHE_H_
+#define DUMAGEVIEW_FRAMECACHE_H_
+
+#include <QImage>
+
+#include <cstddef>
+#include <map>
+
+namespace dumageview::framecache {
+  /**
+   * Decoded frames of one animation, so stepping back and forth through it
+   * does not decode them again. Over its budget, the frames furthest from
+   * the one last added go first.
+   */
+  class FrameCache {
+   public:
+    FrameCache();
+
+    void clear();
+
+    /**
+     * Null if the frame is not held.
+     */
+    QImage const* find(int frame) const;
+
+    void insert(int frame, QImage const& image);
+
+    /**
+     * How many frames the size of sample fit in the budget, at least one.
+     */
+    int getCapacity(QImage const& sample) const;
+
+   private:
+    std::size_t budget_;
+    std::size_t bytes_ = 0;
+    std::map<int, QImage> frames_;
+  };
+}
+
+namespace dumageview {
+  using framecache::FrameCache;
+}
+
+#endif  // DUMAGEVIEW_FRAMECACHE_H_
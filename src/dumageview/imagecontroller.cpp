@@ -1,17 +1,27 @@
 #include "dumageview/imagecontroller.h"
 
+#include "dumageview/colorlut.h"
 #include "dumageview/conv_str.h"
+#include "dumageview/damage.h"
 #include "dumageview/enumutil.h"
 #include "dumageview/log.h"
 #include "dumageview/math.h"
+#include "dumageview/orientation.h"
+#include "dumageview/qtutil.h"
+#include "dumageview/tilesource.h"
+#include "dumageview/ycbcr.h"
 
 #include <fmt/format.h>
 #include <fmt/ostream.h>
 
+#include <QBuffer>
 #include <QDir>
+#include <QFile>
 #include <QImageReader>
 #include <QImageWriter>
+#include <QMetaObject>
 #include <QString>
+#include <QVector>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/hana.hpp>
@@ -19,7 +29,11 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <iterator>
+#include <limits>
+#include <unordered_map>
+#include <utility>
 
 namespace dumageview::imagecontroller {
   namespace {
@@ -47,11 +61,159 @@ namespace dumageview::imagecontroller {
       "xbm"sv,
       "xpm"sv,
     };
+
+    // number of images on each side of the current one to read ahead
+    constexpr std::size_t prefetchRadius = 2;
+
+    // file list entries parsed per idle tick
+    constexpr std::size_t listParseChunk = 1 << 16;
+
+    // milliseconds between looks at a list stream that has sent nothing new
+    constexpr int listWaitInterval = 20;
+
+    // larger images are shown from a preview plus tiles decoded on demand
+    constexpr qint64 maxDecodeBytes = qint64{1} << 30;
+    constexpr int previewSize = 2048;
+
+    /**
+     * The file's size and modification time, which tell its contents apart
+     * from what was read from it before.
+     */
+    QString fileStamp(Path const& path) {
+      boost::system::error_code sizeError;
+      boost::system::error_code timeError;
+      auto size = fs::file_size(path, sizeError);
+      auto time = fs::last_write_time(path, timeError);
+      if (sizeError || timeError) {
+        return {};
+      }
+      return "%1@%2"_qstr.arg(size).arg(static_cast<qint64>(time));
+    }
+
+    bool isTooLarge(QSize const& size) {
+      return size.isValid()
+             && qint64{size.width()} * size.height() * 4 > maxDecodeBytes;
+    }
+
+    std::shared_ptr<TileSource const> makeTileSource(QImageReader& reader,
+                                                     QSize const& size) {
+      if (!TileSource::canDecodeTiles(reader)) {
+        return nullptr;
+      }
+      if (!reader.fileName().isEmpty()) {
+        return std::make_shared<TileSource const>(reader.fileName(), size);
+      }
+      if (auto* buffer = qobject_cast<QBuffer*>(reader.device())) {
+        return std::make_shared<TileSource const>(
+          buffer->data(), reader.format(), size);
+      }
+      return nullptr;
+    }
+
+    /**
+     * Decodes a JPEG to YCbCr planes, leaving color conversion to the GPU.
+     */
+    std::shared_ptr<YCbCrPlanes const> readPlanes(QImageReader& reader) {
+      if (!ycbcr::isAvailable() || reader.format() != "jpeg") {
+        return nullptr;
+      }
+
+      // outlives data, which may be a view of its mapping
+      QFile file;
+
+      QByteArray data;
+      if (auto* buffer = qobject_cast<QBuffer*>(reader.device())) {
+        data = buffer->data();
+      } else {
+        // decoded straight from the page cache rather than read again
+        file.setFileName(reader.fileName());
+        if (!file.open(QIODevice::ReadOnly) || file.size() <= 0
+            || file.size() > std::numeric_limits<int>::max()) {
+          return nullptr;
+        }
+        auto* map = file.map(0, file.size());
+        if (!map) {
+          return nullptr;
+        }
+        data = QByteArray::fromRawData(reinterpret_cast<char const*>(map),
+                                       static_cast<int>(file.size()));
+      }
+
+      auto planes = ycbcr::decodeJpeg(data);
+      if (!planes) {
+        return nullptr;
+      }
+      return std::make_shared<YCbCrPlanes const>(std::move(*planes));
+    }
+
+    /**
+     * Qt composites GIF frames into 32-bit images. A frame whose colors
+     * still fit in a palette, with alpha fully on or off, goes back to one
+     * byte per pixel; anything else is returned as it is.
+     *
+     * Colors in palette keep their indices and new ones are appended, so
+     * frames indexed against the one before share its table as far as it
+     * goes, and damage can be found from their indices. If the frame does
+     * not fit, it is indexed again from scratch.
+     */
+    QImage toIndexed(QImage const& image, QVector<QRgb> const& palette = {}) {
+      if (image.format() != QImage::Format_ARGB32
+          && image.format() != QImage::Format_RGB32) {
+        return image;
+      }
+
+      QImage indexed(image.size(), QImage::Format_Indexed8);
+      QVector<QRgb> colors = palette.mid(0, 256);
+      std::unordered_map<QRgb, uchar> indices;
+      for (int i = 0; i < colors.size(); ++i) {
+        indices.try_emplace(colors[i], static_cast<uchar>(i));
+      }
+
+      for (int y = 0; y < image.height(); ++y) {
+        auto const* src = reinterpret_cast<QRgb const*>(image.constScanLine(y));
+        auto* dst = indexed.scanLine(y);
+
+        // frames are mostly runs of one color, which skip the lookup
+        QRgb runColor = 0;
+        int runIndex = -1;
+
+        for (int x = 0; x < image.width(); ++x) {
+          QRgb color = src[x];
+          int alpha = qAlpha(color);
+          if (alpha == 0) {
+            color = 0;
+          } else if (alpha != 255) {
+            return image;
+          }
+
+          if (color != runColor || runIndex < 0) {
+            auto [it, added] =
+              indices.try_emplace(color, static_cast<uchar>(colors.size()));
+            if (added) {
+              if (colors.size() == 256) {
+                return palette.isEmpty() ? image : toIndexed(image);
+              }
+              colors.push_back(color);
+            }
+            runColor = color;
+            runIndex = it->second;
+          }
+          dst[x] = static_cast<uchar>(runIndex);
+        }
+      }
+
+      indexed.setColorTable(colors);
+      return indexed;
+    }
   }
 
   ImageController::ImageController()
       : QObject{}, validExtensions_(defaultFileExtenions.begin(),
                                     defaultFileExtenions.end()) {
+    qtutil::connect(&listParseTimer_,
+                    &QTimer::timeout,
+                    this,
+                    &ImageController::parseListChunk);
   }
 
   //
@@ -60,15 +222,52 @@ namespace dumageview::imagecontroller {
 
   auto ImageController::tryRead(QImageReader& reader,
                                 ImageInfo const& info) -> std::variant<QString, OpenSuccess> {
-    QImage image = reader.read();
+    std::shared_ptr<TileSource const> tileSource;
+
+    // orientation is applied by the view, so pixels are read as stored
+    reader.setAutoTransform(false);
+
+    QSize fullSize = reader.size();
+    if (isTooLarge(fullSize)) {
+      tileSource = makeTileSource(reader, fullSize);
+      if (!tileSource) {
+        return "Image is too large to decode (%1 x %2)"_qstr.arg(
+          fullSize.width()).arg(fullSize.height());
+      }
+
+      reader.setScaledSize(
+        fullSize.scaled(previewSize, previewSize, Qt::KeepAspectRatio));
+    }
+
+    std::shared_ptr<YCbCrPlanes const> planes;
+    if (!tileSource) {
+      planes = readPlanes(reader);
+    }
+
+    QImage image = planes ? planes->y : reader.read();
     if (image.isNull()) {
       return reader.errorString();
     }
+    auto profile = planes ? planes->iccProfile : colorlut::getProfile(image);
+    if (reader.format() == "gif") {
+      // later frames extend the palette of the one shown before them
+      bool laterFrame = reader.currentImageNumber() > 0 && image_;
+      image = toIndexed(image, laterFrame ? image_->colorTable()
+                                          : QVector<QRgb>{});
+    }
+
+    setPlaying(false);
 
     image_ = image;
     imageInfo_ = info;
+    imageInfo_->damage.reset();
     imageInfo_->frame = reader.currentImageNumber();
     imageInfo_->numFrames = reader.imageCount();
+    imageInfo_->orientation =
+      orientation::fromTransformations(reader.transformation());
+    imageInfo_->tileSource = std::move(tileSource);
+    imageInfo_->planes = std::move(planes);
+    imageInfo_->colorLut = colorlut::getLut(profile, displayProfile_);
 
     return OpenSuccess{};
   }
@@ -82,12 +281,22 @@ namespace dumageview::imagecontroller {
       auto qpath = conv::qstr(absPath.string());
       auto qname = conv::qstr(absPath.filename().string());
 
-      auto reader = std::make_unique<QImageReader>(qpath);
-      reader->setAutoTransform(true);
+      ImageInfo info{qname, qpath, fileStamp(absPath)};
 
-      auto result = tryRead(*reader, {qname, qpath});
+      // decode from memory if the file was read ahead and is unchanged
+      if (auto it = prefetched_.find(absPath); it != prefetched_.end()) {
+        if (it->second.stamp == info.stamp) {
+          return tryOpenData(it->second.data, absPath, info);
+        }
+        prefetched_.erase(it);
+      }
+
+      auto reader = std::make_unique<QImageReader>(qpath);
+      auto result = tryRead(*reader, info);
       if (std::holds_alternative<OpenSuccess>(result)) {
         reader_ = std::move(reader);
+        device_.reset();
+        frameCache_.clear();
       }
       return result;
     } catch (fs::filesystem_error const& error) {
@@ -95,16 +304,53 @@ namespace dumageview::imagecontroller {
     }
   }
 
+  auto ImageController::tryOpenData(QByteArray const& data,
+                                    Path const& name,
+                                    ImageInfo const& info)
+    -> std::variant<QString, OpenSuccess> {
+    auto buffer = std::make_unique<QBuffer>();
+    buffer->setData(data);
+    buffer->open(QIODevice::ReadOnly);
+
+    // some handlers cannot detect their format from content alone
+    auto format = name.extension().string();
+    boost::trim_left_if(format, [](char c) { return c == '.'; });
+    boost::to_lower(format, std::locale::classic());
+
+    auto reader = std::make_unique<QImageReader>(
+      buffer.get(), QByteArray::fromStdString(format));
+
+    auto result = tryRead(*reader, info);
+    if (std::holds_alternative<OpenSuccess>(result)) {
+      reader_ = std::move(reader);
+      device_ = std::move(buffer);
+
+      // even for the same path, which may have been rewritten
+      frameCache_.clear();
+    }
+    return result;
+  }
+
   void ImageController::openImage(QString const& path) {
+    if (Archive::isArchive(conv::str(path))) {
+      openArchive(path);
+      return;
+    }
+
     std::visit(
       hana::overload(
         [this](OpenSuccess) {
           DUMAGEVIEW_ASSERT(image_);
           DUMAGEVIEW_ASSERT(imageInfo_);
 
+          listInfo_.reset();
+          listParseTimer_.stop();
+          archiveInfo_.reset();
+
           loadDir();
           updateImageDirInfo();
           imageChanged(*image_, *imageInfo_);
+          prefetchNeighbors();
         },
         [&](QString const& error) {
           auto msg = "Could not open image: %1: %2"_qstr.arg(path, error);
@@ -115,17 +361,50 @@ namespace dumageview::imagecontroller {
     );
   }
 
+  void ImageController::openList(std::vector<Path> paths,
+                                 std::optional<Path> const& listFile) {
+    std::shared_ptr<FileList> list;
+    try {
+      list = std::make_shared<FileList>(std::move(paths), listFile);
+    } catch (filelist::Error const& error) {
+      openFailed("Could not read file list: %1"_qstr.arg(error.what()));
+      return;
+    }
+
+    // the current image may still be reading from an archive, so keep the
+    // old state alive until something opens
+    ListSeek seek;
+    seek.previousDir = std::exchange(dirInfo_, std::nullopt);
+    seek.previousArchive = std::exchange(archiveInfo_, std::nullopt);
+    listInfo_ = ListInfo{list, 0, std::move(seek)};
+
+    // open the first usable entry, once it has arrived; the rest is parsed
+    // while idle
+    continueListSeek();
+    scheduleListParse();
+  }
+
   //
   // Multi-part images
   //
 
   void ImageController::changeFrame(Direction direction) {
-    if (!reader_ || !imageInfo_) {
+    if (!reader_ || !image_ || !imageInfo_) {
       return;
     }
 
     int newFrame = math::mod(imageInfo_->frame + enumutil::cast(direction),
                              imageInfo_->numFrames);
+    frameCache_.insert(imageInfo_->frame, *image_);
+
+    // handlers mostly seek backward by decoding from the start again
+    if (!frameCache_.find(newFrame) && newFrame < imageInfo_->frame) {
+      rewindTo(newFrame);
+    }
+    if (auto const* cached = frameCache_.find(newFrame)) {
+      showFrame(newFrame, *cached);
+      return;
+    }
 
     bool jumpOK = reader_->jumpToImage(newFrame);
     if (!jumpOK) {
@@ -133,6 +412,7 @@ namespace dumageview::imagecontroller {
       return;
     }
 
+    auto previous = image_;
     auto handler = hana::overload(
       [&](QString const& error) {
         log::warn("Could not read frame {}: {}", newFrame, conv::str(error));
@@ -140,12 +420,75 @@ namespace dumageview::imagecontroller {
       [&](OpenSuccess) {
         DUMAGEVIEW_ASSERT(image_);
         DUMAGEVIEW_ASSERT(imageInfo_);
+
+        // so the renderer can update only what changed
+        if (previous) {
+          imageInfo_->damage = damage::findChanges(*previous, *image_);
+        }
         imageChanged(*image_, *imageInfo_);
       }
     );
     std::visit(handler, tryRead(*reader_, *imageInfo_));
   }
 
+  /**
+   * Reads from the first frame to the given one with a new reader, keeping
+   * as many of the last frames read as the cache holds. reader_ is left
+   * after the frame, as if it had been read.
+   */
+  bool ImageController::rewindTo(int frame) {
+    auto buffer = std::unique_ptr<QBuffer>{};
+    auto reader = std::unique_ptr<QImageReader>{};
+    if (!reader_->fileName().isEmpty()) {
+      reader = std::make_unique<QImageReader>(reader_->fileName());
+    } else if (auto* old = qobject_cast<QBuffer*>(device_.get())) {
+      buffer = std::make_unique<QBuffer>();
+      buffer->setData(old->data());
+      buffer->open(QIODevice::ReadOnly);
+      reader = std::make_unique<QImageReader>(buffer.get(), reader_->format());
+    } else {
+      return false;
+    }
+    reader->setAutoTransform(false);
+
+    bool isGif = reader_->format() == "gif";
+    auto palette = image_->colorTable();  // so kept frames extend it
+    int firstKept = frame - frameCache_.getCapacity(*image_) + 1;
+    for (int i = 0; i <= frame; ++i) {
+      QImage image = reader->read();
+      if (image.isNull()) {
+        log::warn("Could not read frame {}: {}",
+                  i,
+                  conv::str(reader->errorString()));
+        return false;
+      }
+      if (i >= firstKept) {
+        if (isGif) {
+          image = toIndexed(image, palette);
+          palette = image.colorTable();
+        }
+        frameCache_.insert(i, image);
+      }
+    }
+
+    DUMAGEVIEW_LOG_DEBUG("Rewound to frame {}", frame);
+    reader_ = std::move(reader);
+    device_ = std::move(buffer);
+    return true;
+  }
+
+  void ImageController::showFrame(int frame, QImage const& image) {
+    DUMAGEVIEW_ASSERT(image_);
+    DUMAGEVIEW_ASSERT(imageInfo_);
+    setPlaying(false);
+
+    // as tryRead() would leave it, but the rest of the info stays the same
+    auto previous = std::exchange(*image_, image);
+    imageInfo_->frame = frame;
+    imageInfo_->damage = damage::findChanges(previous, image);
+    imageChanged(*image_, *imageInfo_);
+  }
+
   void ImageController::nextFrame() {
     changeFrame(Direction::forward);
   }
@@ -154,6 +497,66 @@ namespace dumageview::imagecontroller {
     changeFrame(Direction::backward);
   }
 
+  void ImageController::setPlaying(bool playing) {
+    if (playing == (player_ != nullptr)) {
+      return;
+    }
+
+    if (!playing) {
+      player_.reset();
+      playbackStatsChanged(std::nullopt);
+      playingChanged(false);
+      return;
+    }
+
+    if (!reader_ || !image_ || !imageInfo_ || imageInfo_->numFrames < 2) {
+      playingChanged(false);
+      return;
+    }
+
+    playback::Source source{reader_->fileName(), {}, reader_->format()};
+    if (auto* buffer = qobject_cast<QBuffer*>(device_.get())) {
+      // archive members are views of a mapping the player may outlive
+      auto const& data = buffer->data();
+      source.data = QByteArray(data.constData(), data.size());
+    }
+
+    playback::Convert convert;
+    if (reader_->format() == "gif") {
+      // each frame extends the palette of the one before it
+      convert = [palette = image_->colorTable()](QImage const& frame) mutable {
+        auto indexed = toIndexed(frame, palette);
+        palette = indexed.colorTable();
+        return indexed;
+      };
+    }
+
+    int firstFrame = (imageInfo_->frame + 1) % imageInfo_->numFrames;
+    player_ = std::make_unique<Player>(
+      std::move(source),
+      *image_,
+      firstFrame,
+      std::move(convert),
+      [this](playback::Frame&& frame) { showPlayedFrame(std::move(frame)); },
+      [this](playback::Stats const& stats) { playbackStatsChanged(stats); },
+      [this] {
+        // not from within the player's own timer
+        QMetaObject::invokeMethod(
+          this, [this] { setPlaying(false); }, Qt::QueuedConnection);
+      });
+    playingChanged(true);
+  }
+
+  void ImageController::showPlayedFrame(playback::Frame&& frame) {
+    DUMAGEVIEW_ASSERT(imageInfo_);
+
+    image_ = std::move(frame.image);
+    imageInfo_->frame = frame.index;
+    frameCache_.insert(frame.index, *image_);
+    imageInfo_->damage = std::move(frame.damage);
+    imageChanged(*image_, *imageInfo_);
+  }
+
   //
   // Dir iteration
   //
@@ -197,6 +600,7 @@ namespace dumageview::imagecontroller {
         updateImageDirInfo();
 
         imageChanged(*image_, *imageInfo_);
+        prefetchNeighbors();
         return;
       }
 
@@ -209,6 +613,7 @@ namespace dumageview::imagecontroller {
       nextIter = wrapIter(badIter);
       DUMAGEVIEW_ASSERT(nextIter != badIter);
 
+      prefetched_.erase(path);
       set.erase(badIter);
 
       if (direction == Direction::forward) {
@@ -220,11 +625,23 @@ namespace dumageview::imagecontroller {
   }
 
   void ImageController::nextImage() {
-    changeWithinDir(Direction::forward);
+    if (archiveInfo_) {
+      changeWithinArchive(Direction::forward);
+    } else if (listInfo_) {
+      changeWithinList(Direction::forward);
+    } else {
+      changeWithinDir(Direction::forward);
+    }
   }
 
   void ImageController::prevImage() {
-    changeWithinDir(Direction::backward);
+    if (archiveInfo_) {
+      changeWithinArchive(Direction::backward);
+    } else if (listInfo_) {
+      changeWithinList(Direction::backward);
+    } else {
+      changeWithinDir(Direction::backward);
+    }
   }
 
   void ImageController::loadDir() {
@@ -245,15 +662,7 @@ namespace dumageview::imagecontroller {
       // add entries with ok filenames
       for (auto const& entry : fs::directory_iterator(dirPath)) {
         auto const& p = entry.path();
-        if (!fs::is_regular_file(p)) {
-          continue;
-        }
-
-        auto ext = p.extension().string();
-        boost::trim_left_if(ext, [](char c) { return c == '.'; });
-        boost::to_lower(ext, std::locale::classic());
-
-        if (validExtensions_.count(ext) == 0) {
+        if (!fs::is_regular_file(p) || !hasValidExtension(p)) {
           continue;
         }
         dirInfo_->set.insert(p.filename());
@@ -277,7 +686,30 @@ namespace dumageview::imagecontroller {
     }
   }
 
+  bool ImageController::hasValidExtension(Path const& path) const {
+    auto ext = path.extension().string();
+    boost::trim_left_if(ext, [](char c) { return c == '.'; });
+    boost::to_lower(ext, std::locale::classic());
+
+    return validExtensions_.count(ext) != 0;
+  }
+
   void ImageController::updateImageDirInfo() {
+    if (archiveInfo_) {
+      DUMAGEVIEW_ASSERT(imageInfo_);
+      imageInfo_->dirIndex = boost::numeric_cast<int>(archiveInfo_->index);
+      imageInfo_->dirSize =
+        boost::numeric_cast<int>(archiveInfo_->images.size());
+      return;
+    }
+
+    if (listInfo_) {
+      DUMAGEVIEW_ASSERT(imageInfo_);
+      imageInfo_->dirIndex = boost::numeric_cast<int>(listInfo_->index);
+      imageInfo_->dirSize = boost::numeric_cast<int>(listInfo_->list->size());
+      return;
+    }
+
     if (!dirInfo_) {
       return;
     }
@@ -287,6 +719,406 @@ namespace dumageview::imagecontroller {
     imageInfo_->dirSize = boost::numeric_cast<int>(dirInfo_->set.size());
   }
 
+  //
+  // Archive iteration
+  //
+
+  void ImageController::openArchive(QString const& path) {
+    ArchiveInfo info;
+    try {
+      info.archive = std::make_shared<Archive>(fs::absolute(conv::str(path)));
+    } catch (archive::Error const& error) {
+      openFailed("Could not open archive: %1: %2"_qstr.arg(path, error.what()));
+      return;
+    } catch (fs::filesystem_error const& error) {
+      openFailed("Could not open archive: %1: %2"_qstr.arg(path, error.what()));
+      return;
+    }
+
+    auto const& members = info.archive->getMembers();
+    for (std::size_t i = 0; i < members.size(); ++i) {
+      if (hasValidExtension(members[i].name)) {
+        info.images.push_back(i);
+      }
+    }
+    std::sort(info.images.begin(), info.images.end(), [&](auto a, auto b) {
+      return members[a].name < members[b].name;
+    });
+
+    // keep the current state if nothing in the archive opens
+    auto previous = std::move(archiveInfo_);
+    archiveInfo_ = std::move(info);
+
+    auto numImages = archiveInfo_->images.size();
+    for (std::size_t index = 0; index < numImages; ++index) {
+      if (openArchiveEntry(index)) {
+        dirInfo_.reset();
+        listInfo_.reset();
+        listParseTimer_.stop();
+        return;
+      }
+    }
+
+    archiveInfo_ = std::move(previous);
+    openFailed("Could not open any image in archive: %1"_qstr.arg(path));
+  }
+
+  bool ImageController::openArchiveEntry(std::size_t index) {
+    DUMAGEVIEW_ASSERT(archiveInfo_);
+
+    auto const& archive = *archiveInfo_->archive;
+    auto memberIndex = archiveInfo_->images.at(index);
+    auto const& member = archive.getMembers().at(memberIndex);
+    auto name = conv::qstr(member.name);
+
+    auto stamp = fileStamp(archive.getPath());
+
+    // deflated members may have been inflated ahead
+    QByteArray data;
+    auto it = prefetched_.find(archive.getPath() / member.name);
+    if (it != prefetched_.end() && it->second.stamp == stamp) {
+      data = it->second.data;
+    } else {
+      try {
+        data = archive.read(member);
+      } catch (archive::Error const& error) {
+        log::warn("Could not read {}: {}", member.name, error.what());
+        return false;
+      }
+    }
+
+    auto path = conv::qstr(archive.getPath().string()) + "/" + name;
+    ImageInfo info{name, path, stamp};
+    auto result = tryOpenData(data, member.name, info);
+
+    if (std::holds_alternative<QString>(result)) {
+      log::warn("Could not open image: {}: {}",
+                member.name,
+                conv::str(std::get<QString>(result)));
+      return false;
+    }
+    DUMAGEVIEW_ASSERT(image_);
+    DUMAGEVIEW_ASSERT(imageInfo_);
+
+    archiveInfo_->index = index;
+    updateImageDirInfo();
+
+    imageChanged(*image_, *imageInfo_);
+    prefetchNeighbors();
+    return true;
+  }
+
+  void ImageController::changeWithinArchive(Direction direction) {
+    DUMAGEVIEW_ASSERT(archiveInfo_);
+
+    auto size = archiveInfo_->images.size();
+    auto index = archiveInfo_->index;
+
+    for (std::size_t tries = 1; tries < size; ++tries) {
+      if (direction == Direction::forward) {
+        index = (index + 1) % size;
+      } else {
+        index = (index + size - 1) % size;
+      }
+
+      if (openArchiveEntry(index)) {
+        return;
+      }
+    }
+  }
+
+  //
+  // List iteration
+  //
+
+  bool ImageController::openListEntry(std::size_t index) {
+    DUMAGEVIEW_ASSERT(listInfo_);
+
+    auto path = listInfo_->list->at(index);
+    auto result = tryOpen(conv::qstr(path.string()));
+
+    if (std::holds_alternative<QString>(result)) {
+      log::warn("Could not open image: {}: {}",
+                path,
+                conv::str(std::get<QString>(result)));
+      return false;
+    }
+    DUMAGEVIEW_ASSERT(image_);
+    DUMAGEVIEW_ASSERT(imageInfo_);
+
+    listInfo_->index = index;
+    updateImageDirInfo();
+
+    imageChanged(*image_, *imageInfo_);
+    prefetchNeighbors();
+    return true;
+  }
+
+  void ImageController::changeWithinList(Direction direction) {
+    DUMAGEVIEW_ASSERT(listInfo_);
+
+    auto& info = *listInfo_;
+    if (info.seek && !info.seek->start) {
+      return;  // nothing from the list is shown yet
+    }
+
+    // replaces any move still waiting for the list
+    ListSeek seek{direction};
+    seek.start = info.index;
+    if (direction == Direction::forward) {
+      seek.next = info.index + 1;
+    } else if (info.index == 0) {
+      seek.wrapping = true;
+    } else {
+      seek.next = info.index - 1;
+    }
+    info.seek = std::move(seek);
+
+    continueListSeek();
+    scheduleListParse();
+  }
+
+  /**
+   * Tries entries until one opens or the move comes back to where it began.
+   * Returns early, keeping the seek, if the entry it needs is not parsed
+   * yet; parseListChunk() calls it again once more has been.
+   */
+  void ImageController::continueListSeek() {
+    DUMAGEVIEW_ASSERT(listInfo_);
+    DUMAGEVIEW_ASSERT(listInfo_->seek);
+
+    auto& list = *listInfo_->list;
+    auto& seek = *listInfo_->seek;
+
+    // unlike directories, bad entries are skipped but kept
+    while (true) {
+      if (seek.wrapping) {
+        // wrapping backward needs the whole list
+        if (!list.isComplete()) {
+          return;
+        }
+        seek.next = list.size() - 1;
+        seek.wrapping = false;
+      } else if (!list.parseThrough(seek.next)) {
+        if (!list.isComplete()) {
+          return;
+        }
+        if (!seek.start) {
+          dirInfo_ = std::move(seek.previousDir);
+          archiveInfo_ = std::move(seek.previousArchive);
+          listInfo_.reset();
+          openFailed("Could not open any image from the file list");
+          return;
+        }
+        seek.next = 0;
+        continue;
+      }
+
+      auto index = seek.next;
+      if (index == seek.start || openListEntry(index)) {
+        listInfo_->seek.reset();
+        return;
+      }
+
+      if (seek.direction == Direction::forward) {
+        ++seek.next;
+      } else if (index == 0) {
+        seek.wrapping = true;
+      } else {
+        --seek.next;
+      }
+    }
+  }
+
+  void ImageController::parseListChunk() {
+    if (!listInfo_) {
+      listParseTimer_.stop();
+      return;
+    }
+
+    listInfo_->list->parseMore(listParseChunk);
+    if (listInfo_->seek) {
+      continueListSeek();
+    }
+
+    // the image shown is not from the list until its first entry opens
+    bool opening = listInfo_ && listInfo_->seek && !listInfo_->seek->start;
+    if (listInfo_ && !opening && imageInfo_) {
+      updateImageDirInfo();
+      imageInfoChanged(*imageInfo_);
+    }
+    scheduleListParse();
+  }
+
+  void ImageController::scheduleListParse() {
+    if (!listInfo_ || listInfo_->list->isComplete()) {
+      listParseTimer_.stop();
+      return;
+    }
+    listParseTimer_.start(listInfo_->list->isWaiting() ? listWaitInterval
+                                                       : 0);
+  }
+
+  //
+  // Read-ahead
+  //
+
+  std::vector<Path> ImageController::neighborPaths() const {
+    std::vector<Path> paths;
+
+    if (archiveInfo_) {
+      // stored members are views of the mapping; only inflating costs time
+      auto const& archive = *archiveInfo_->archive;
+      auto const& images = archiveInfo_->images;
+      auto index = archiveInfo_->index;
+      auto size = images.size();
+
+      for (std::size_t i = 1; i <= prefetchRadius && i < size; ++i) {
+        for (auto neighbor : {(index + i) % size, (index + size - i) % size}) {
+          auto const& member = archive.getMembers().at(images[neighbor]);
+          if (member.method == archive::Method::deflated) {
+            paths.push_back(archive.getPath() / member.name);
+          }
+        }
+      }
+    } else if (listInfo_) {
+      auto const& list = *listInfo_->list;
+      auto index = listInfo_->index;
+      auto size = list.size();
+
+      for (std::size_t i = 1; i <= prefetchRadius && i < size; ++i) {
+        paths.push_back(fs::absolute(list.at((index + i) % size)));
+
+        // only wrap backward once the true end of the list is known
+        if (index >= i || list.isComplete()) {
+          paths.push_back(fs::absolute(list.at((index + size - i) % size)));
+        }
+      }
+    } else if (dirInfo_) {
+      auto const& set = dirInfo_->set;
+      auto fwd = dirInfo_->current;
+      auto back = dirInfo_->current;
+
+      for (std::size_t i = 0; i < prefetchRadius; ++i) {
+        if (++fwd == set.end()) {
+          fwd = set.begin();
+        }
+        if (back == set.begin()) {
+          back = set.end();
+        }
+        --back;
+
+        paths.push_back(dirInfo_->path / *fwd);
+        paths.push_back(dirInfo_->path / *back);
+      }
+    }
+    return paths;
+  }
+
+  void ImageController::prefetchNeighbors() {
+    if (!imageInfo_) {
+      return;
+    }
+    Path current = conv::str(imageInfo_->filePath);
+
+    PathSet wanted;
+    for (auto& path : neighborPaths()) {
+      if (path != current) {
+        wanted.insert(std::move(path));
+      }
+    }
+
+    // drop what is no longer adjacent, then fetch what is missing
+    for (auto it = prefetched_.begin(); it != prefetched_.end();) {
+      it = wanted.count(it->first) ? std::next(it) : prefetched_.erase(it);
+    }
+
+    std::vector<Path> missing;
+    for (auto const& path : wanted) {
+      if (!prefetched_.count(path) && !prefetchWanted_.count(path)) {
+        missing.push_back(path);
+      }
+    }
+    prefetchWanted_ = std::move(wanted);
+
+    if (missing.empty()) {
+      return;
+    }
+
+    auto handler = [this](std::size_t, ioengine::Result&& result) {
+      if (!result.ok()) {
+        return;
+      }
+      // runs on an I/O thread; hand off to ours
+      Prefetched prefetched{std::move(result.data), fileStamp(result.path)};
+      QMetaObject::invokeMethod(
+        this,
+        [this,
+         path = std::move(result.path),
+         prefetched = std::move(prefetched)] {
+          storePrefetched(path, prefetched);
+        },
+        Qt::QueuedConnection
+      );
+    };
+    if (archiveInfo_) {
+      inflateAhead(missing);
+    } else {
+      ioEngine_.read(std::move(missing), handler);
+    }
+  }
+
+  void ImageController::inflateAhead(std::vector<Path> const& paths) {
+    DUMAGEVIEW_ASSERT(archiveInfo_);
+    auto archive = archiveInfo_->archive;
+
+    std::vector<std::pair<Path, archive::Member>> jobs;
+    for (auto memberIndex : archiveInfo_->images) {
+      auto const& member = archive->getMembers().at(memberIndex);
+      auto path = archive->getPath() / member.name;
+      if (std::find(paths.begin(), paths.end(), path) != paths.end()) {
+        jobs.emplace_back(std::move(path), member);
+      }
+    }
+
+    auto done = [](auto const& future) {
+      return future.wait_for(0s) == std::future_status::ready;
+    };
+    inflating_.erase(
+      std::remove_if(inflating_.begin(), inflating_.end(), done),
+      inflating_.end());
+
+    // the archive is shared so it outlives a switch to another one
+    inflating_.push_back(std::async(
+      std::launch::async,
+      [this, archive = std::move(archive), jobs = std::move(jobs)] {
+        for (auto const& [path, member] : jobs) {
+          Prefetched prefetched;
+          try {
+            prefetched.data = archive->read(member);
+          } catch (archive::Error const&) {
+            continue;  // reported if it is opened
+          }
+          prefetched.stamp = fileStamp(archive->getPath());
+          QMetaObject::invokeMethod(
+            this,
+            [this, path = path, prefetched = std::move(prefetched)] {
+              storePrefetched(path, prefetched);
+            },
+            Qt::QueuedConnection
+          );
+        }
+      }));
+  }
+
+  void ImageController::storePrefetched(Path const& path,
+                                       Prefetched const& prefetched) {
+    // the user may have moved on while this was in flight
+    if (prefetchWanted_.count(path)) {
+      prefetched_.emplace(path, prefetched);
+    }
+  }
+
   //
   // Other slots
   //
@@ -299,8 +1131,19 @@ namespace dumageview::imagecontroller {
       return;
     }
 
+    // pixels are written as stored, with the profile they were read with
+    QImage image = imageInfo_ && imageInfo_->planes
+                     ? colorlut::setProfile(imageInfo_->planes->toRgb(),
+                                            imageInfo_->planes->iccProfile)
+                     : *image_;
+
+    // the metadata that turned it is not written, so the pixels are turned
+    if (imageInfo_) {
+      image = orientation::apply(image, imageInfo_->orientation);
+    }
+
     QImageWriter writer(path);
-    bool writeOK = writer.write(*image_);
+    bool writeOK = writer.write(image);
 
     if (!writeOK) {
       saveFailed("Could not save image: %1: %2"_qstr.arg(path, writer.errorString()));
@@ -310,12 +1153,24 @@ namespace dumageview::imagecontroller {
     log::debug("saved image: {}", conv::str(path));
   }
 
+  void ImageController::setDisplayProfile(QByteArray const& profile) {
+    displayProfile_ = profile;
+  }
+
   void ImageController::closeImage() {
+    setPlaying(false);
     image_.reset();
     imageInfo_.reset();
     dirInfo_.reset();
+    listInfo_.reset();
+    listParseTimer_.stop();
 
     reader_.reset();
+    device_.reset();
+    archiveInfo_.reset();
+
+    prefetchWanted_.clear();
+    prefetched_.clear();
 
     imageRemoved();
   }
@@ -330,8 +1185,14 @@ namespace dumageview::imagecontroller {
   }
 
   QString ImageController::getDialogDir() const {
-    if (dirInfo_) {
+    if (archiveInfo_) {
+      auto const& archivePath = archiveInfo_->archive->getPath();
+      return conv::qstr(archivePath.parent_path().string());
+    } else if (dirInfo_) {
       return conv::qstr(dirInfo_->path.string());
+    } else if (imageInfo_) {
+      fs::path filePath = conv::str(imageInfo_->filePath);
+      return conv::qstr(filePath.parent_path().string());
     } else {
       return QDir::currentPath();
     }
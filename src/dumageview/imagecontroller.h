@@ -1,15 +1,25 @@
 #ifndef DUMAGEVIEW_IMAGECONTROLLER_H_
 #define DUMAGEVIEW_IMAGECONTROLLER_H_
 
+#include "dumageview/archive.h"
+#include "dumageview/filelist.h"
+#include "dumageview/framecache.h"
 #include "dumageview/imageinfo.h"
+#include "dumageview/ioengine.h"
+#include "dumageview/playback.h"
 
+#include <QByteArray>
+#include <QIODevice>
 #include <QImage>
 #include <QImageReader>
 #include <QObject>
 #include <QString>
+#include <QTimer>
 
 #include <boost/filesystem.hpp>
 
+#include <future>
+#include <map>
 #include <memory>
 #include <optional>
 #include <set>
@@ -32,11 +42,45 @@ namespace dumageview::imagecontroller {
     int index{0};
   };
 
+  struct ArchiveInfo {
+    std::shared_ptr<Archive> archive;
+    std::vector<std::size_t> images;  // member indices, sorted by name
+    std::size_t index{0};  // into images
+  };
+
+  /**
+   * File contents read ahead, and the file's stamp once they were read.
+   */
+  struct Prefetched {
+    QByteArray data;
+    QString stamp;
+  };
+
   enum class Direction : int {
     backward = -1,
     forward = 1,
   };
 
+  /**
+   * A move through a file list, kept while it waits for more of the list.
+   */
+  struct ListSeek {
+    Direction direction{Direction::forward};
+    std::size_t next{0};  // entry to try next
+    bool wrapping{false};  // next is the last entry, once that is known
+    std::optional<std::size_t> start;  // where it began; none while opening
+
+    // shown before the list, and restored if nothing in it opens
+    std::optional<DirInfo> previousDir;
+    std::optional<ArchiveInfo> previousArchive;
+  };
+
+  struct ListInfo {
+    std::shared_ptr<FileList> list;
+    std::size_t index{0};
+    std::optional<ListSeek> seek;
+  };
+
   using FileExtensionSet = std::set<std::string_view>;
 
   class ImageController : public QObject {
@@ -47,22 +91,40 @@ namespace dumageview::imagecontroller {
     virtual ~ImageController() = default;
 
     void openImage(QString const& path);
+    void openList(std::vector<Path> paths, std::optional<Path> const& listFile);
     void saveImage(QString const& path);
     void closeImage();
 
+    /**
+     * The ICC profile images are converted to for display. Empty means
+     * sRGB. Applies to images opened after this.
+     */
+    void setDisplayProfile(QByteArray const& profile);
+
     void nextImage();
     void prevImage();
 
     void nextFrame();
     void prevFrame();
 
+    /**
+     * Plays the current animation from the frame after the one shown, at
+     * the rate the file asks for. Stops when another image or frame is
+     * opened.
+     */
+    void setPlaying(bool playing);
+
     QString getDialogDir() const;
     FileExtensionSet const& getValidFileExtensions() const;
 
    Q_SIGNALS:
     void imageChanged(QImage const& image, ImageInfo const& info);
+    void imageInfoChanged(ImageInfo const& info);
     void imageRemoved();
 
+    void playingChanged(bool playing);
+    void playbackStatsChanged(std::optional<playback::Stats> const& stats);
+
     void openFailed(QString const& message);
     void saveFailed(QString const& message);
 
@@ -74,12 +136,36 @@ namespace dumageview::imagecontroller {
 
     std::variant<QString, OpenSuccess> tryOpen(QString const& path);
 
+    std::variant<QString, OpenSuccess> tryOpenData(QByteArray const& data,
+                                                   Path const& name,
+                                                   ImageInfo const& info);
+
+    bool hasValidExtension(Path const& path) const;
+
     void loadDir();
     void updateImageDirInfo();
 
+    std::vector<Path> neighborPaths() const;
+    void prefetchNeighbors();
+    void inflateAhead(std::vector<Path> const& paths);
+    void storePrefetched(Path const& path, Prefetched const& prefetched);
+
     void changeFrame(Direction direction);
+    bool rewindTo(int frame);
+    void showFrame(int frame, QImage const& image);
+    void showPlayedFrame(playback::Frame&& frame);
     void changeWithinDir(Direction direction);
 
+    void openArchive(QString const& path);
+    bool openArchiveEntry(std::size_t index);
+    void changeWithinArchive(Direction direction);
+
+    bool openListEntry(std::size_t index);
+    void changeWithinList(Direction direction);
+    void continueListSeek();
+    void parseListChunk();
+    void scheduleListParse();
+
     //
     // Private data
     //
@@ -88,9 +174,34 @@ namespace dumageview::imagecontroller {
     std::optional<ImageInfo> imageInfo_;
     std::optional<DirInfo> dirInfo_;
 
+    // replaces dirInfo_ when navigating an explicit list of files
+    std::optional<ListInfo> listInfo_;
+    QTimer listParseTimer_;
+
+    // replaces dirInfo_ when browsing an archive; must outlive device_
+    std::optional<ArchiveInfo> archiveInfo_;
+
+    // reader_ may read from device_, so it must be destroyed first
+    std::unique_ptr<QIODevice> device_;
     std::unique_ptr<QImageReader> reader_;
 
+    // frames of the current image, as tryRead() would give them
+    FrameCache frameCache_;
+
+    // decodes with a reader of its own; reader_ stays where it was
+    std::unique_ptr<Player> player_;
+
     FileExtensionSet validExtensions_;
+
+    QByteArray displayProfile_;
+
+    // file contents of neighboring images, read ahead in the background
+    IoEngine ioEngine_;
+    PathSet prefetchWanted_;
+    std::map<Path, Prefetched> prefetched_;
+
+    // archive members being inflated ahead; waited for before the rest goes
+    std::vector<std::future<void>> inflating_;
   };
 
   class Error : virtual public std::runtime_error {
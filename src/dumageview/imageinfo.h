@@ -1,8 +1,26 @@
 #ifndef DUMAGEVIEW_IMAGEINFO_H_
 #define DUMAGEVIEW_IMAGEINFO_H_
 
+#include "dumageview/orientation.h"
+
+#include <QRegion>
 #include <QString>
 
+#include <memory>
+#include <optional>
+
+namespace dumageview::colorlut {
+  struct ColorLut;
+}
+
+namespace dumageview::tilesource {
+  class TileSource;
+}
+
+namespace dumageview::ycbcr {
+  struct Planes;
+}
+
 namespace dumageview {
   /**
    * Image metadata that is not included in QImage.
@@ -11,11 +29,32 @@ namespace dumageview {
     QString fileName;
     QString filePath;  // absolute
 
+    // changes when the file is rewritten; empty if unknown
+    QString stamp;
+
     int frame{0};
     int numFrames{1};
 
+    // set when this frame was compared with the one read before it; where
+    // the two differ
+    std::optional<QRegion> damage;
+
+    // from the file's metadata; the pixels are as stored
+    Orientation orientation;
+
     int dirIndex{0};  // zero-based; add one when displaying
     int dirSize{1};
+
+    // set when the image is too large to decode whole; the QImage is then
+    // only a preview and full resolution comes from here
+    std::shared_ptr<tilesource::TileSource const> tileSource;
+
+    // set when a JPEG was decoded without color conversion; the QImage is
+    // then its luma plane
+    std::shared_ptr<ycbcr::Planes const> planes;
+
+    // set when the image has a color profile other than the display's
+    std::shared_ptr<colorlut::ColorLut const> colorLut;
   };
 }
 
@@ -1,18 +1,22 @@
 #include "dumageview/imagerenderer.h"
 
 #include "dumageview/assert.h"
+#include "dumageview/conv_str.h"
 #include "dumageview/conv_vec.h"
-#include "dumageview/imagewidget.h"
 #include "dumageview/log.h"
-#include "dumageview/math.h"
+#include "dumageview/mipmap.h"
 #include "dumageview/qtutil.h"
 #include "dumageview/renderview_inl.h"
 #include "dumageview/scopeguard.h"
+#include "dumageview/tilegrid.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_precision.hpp>
 
+#include <fmt/format.h>
+
+#include <QOffscreenSurface>
 #include <QOpenGLContext>
 #include <QOpenGLFunctions_2_1>
 #include <QPoint>
@@ -21,30 +25,260 @@
 #include <QSize>
 
 #include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <functional>
+#include <limits>
+#include <map>
+#include <string>
 #include <tuple>
 #include <type_traits>
 #include <utility>
 
 namespace dumageview::imagerenderer::detail {
   namespace {
-    constexpr double zoomFactor{1.1};
+    // Tiles overlap by this many pixels, so each mip level up to
+    // tileGutterLevels still has a texel of its neighbor to filter with.
+    constexpr int tileGutterLevels = 5;
+    constexpr int tileGutter = 1 << tileGutterLevels;
+
+    // Texture data streamed per frame; the rest waits for the next one.
+    constexpr int uploadBytesPerFrame = 8 << 20;
+
+    // Frames in an atlas are padded by this many pixels on each side, and
+    // start on a multiple of it, for mip levels up to atlasGutterLevels.
+    constexpr int atlasGutterLevels = 3;
+    constexpr int atlasGutter = 1 << atlasGutterLevels;
+
+    // larger pages would hold a lot of memory before most frames are in
+    constexpr int atlasPageSize = 4096;
+
+    double toMillis(qint64 nanos) {
+      return static_cast<double>(nanos) / 1e6;
+    }
+
+    // native-endian 0xAARRGGBB words
+    constexpr PixelLayout bgraLayout{
+      GL_RGBA8, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, 4, false};
+
+    // also used for chroma planes
+    constexpr PixelLayout lumaLayout{
+      GL_LUMINANCE8, GL_LUMINANCE, GL_UNSIGNED_BYTE, 1, false};
+
+    // palette indices; the shader that looks them up premultiplies
+    constexpr PixelLayout indexLayout{
+      GL_LUMINANCE8, GL_LUMINANCE, GL_UNSIGNED_BYTE, 1, true};
+
+    constexpr int paletteSize = 256;
+
+    /**
+     * Layout to upload an image in. QImage formats GL can read directly are
+     * uploaded as they are, at their own precision; anything else is
+     * converted to the 32-bit format Qt handles fastest.
+     */
+    std::pair<QImage, PixelLayout> toUploadable(QImage image) {
+      switch (image.format()) {
+        case QImage::Format_RGB32:
+        case QImage::Format_ARGB32:
+          return {std::move(image), bgraLayout};
+        case QImage::Format_ARGB32_Premultiplied: {
+          auto layout = bgraLayout;
+          layout.premultiplied = true;
+          return {std::move(image), layout};
+        }
+
+        // R, G, B, A bytes
+        case QImage::Format_RGBX8888:
+        case QImage::Format_RGBA8888:
+          return {std::move(image),
+                  {GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4, false}};
+        case QImage::Format_RGBA8888_Premultiplied:
+          return {std::move(image),
+                  {GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4, true}};
+
+        // luminance textures sample as gray with opaque alpha
+        case QImage::Format_Grayscale8:
+          return {std::move(image), lumaLayout};
+
+        case QImage::Format_Indexed8:
+          return {std::move(image), indexLayout};
+        case QImage::Format_Mono:
+        case QImage::Format_MonoLSB:
+          return {image.convertToFormat(QImage::Format_Indexed8), indexLayout};
+        case QImage::Format_Grayscale16:
+          return {std::move(image),
+                  {GL_LUMINANCE16, GL_LUMINANCE, GL_UNSIGNED_SHORT, 2, false}};
+
+        case QImage::Format_RGB888:
+          return {std::move(image),
+                  {GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE, 3, false}};
+
+        // native-endian 16-bit R, G, B, A
+        case QImage::Format_RGBX64:
+        case QImage::Format_RGBA64:
+          return {std::move(image),
+                  {GL_RGBA16, GL_RGBA, GL_UNSIGNED_SHORT, 8, false}};
+        case QImage::Format_RGBA64_Premultiplied:
+          return {std::move(image),
+                  {GL_RGBA16, GL_RGBA, GL_UNSIGNED_SHORT, 8, true}};
+
+        default:
+          break;
+      }
+
+      DUMAGEVIEW_LOG_DEBUG("Converting image format {} for upload",
+                           static_cast<int>(image.format()));
+      if (image.hasAlphaChannel()) {
+        auto layout = bgraLayout;
+        layout.premultiplied = true;
+        return {image.convertToFormat(QImage::Format_ARGB32_Premultiplied),
+                layout};
+      }
+      return {image.convertToFormat(QImage::Format_RGB32), bgraLayout};
+    }
+
+    char const* formatName(GLenum internalFormat) {
+      switch (internalFormat) {
+        case GL_LUMINANCE8:
+          return "L8";
+        case GL_LUMINANCE16:
+          return "L16";
+        case GL_RGB8:
+          return "RGB8";
+        case GL_RGBA8:
+          return "RGBA8";
+        case GL_RGBA16:
+          return "RGBA16";
+        default:
+          return "other";
+      }
+    }
+
+    std::size_t areaBytes(QRect const& area, PixelLayout const& layout) {
+      return static_cast<std::size_t>(area.width())
+             * static_cast<std::size_t>(area.height())
+             * static_cast<std::size_t>(layout.pixelSize);
+    }
 
-    auto contextGuard(ImageWidget& widget) {
-      widget.makeCurrent();
-      return ScopeGuard{[&] { widget.doneCurrent(); }};
+    std::vector<Surface> getSurfaces(ImageState const& state) {
+      std::vector<Surface> surfaces;
+      for (auto const& tile : state.tiles) {
+        surfaces.push_back({tile, state.image, state.layout});
+      }
+      if (state.planes) {
+        DUMAGEVIEW_ASSERT(state.chroma.size() == 2);
+        surfaces.push_back({state.chroma[0], state.planes->cb, lumaLayout});
+        surfaces.push_back({state.chroma[1], state.planes->cr, lumaLayout});
+      }
+      return surfaces;
+    }
+
+    /**
+     * How many of a surface's levels a chain has uploaded so far.
+     */
+    std::size_t levelsUploaded(MipChain const& chain,
+                               std::size_t surfaceIndex) {
+      if (surfaceIndex < chain.surfaceIndex) {
+        return chain.levels[surfaceIndex].size();
+      }
+      return surfaceIndex == chain.surfaceIndex ? chain.levelIndex : 0;
+    }
+
+    /**
+     * Texture memory the mip levels above the base add to an image;
+     * a third of the base.
+     */
+    std::size_t mipLevelBytes(ImageState const& state) {
+      std::size_t bytes = 0;
+      for (auto const& surface : getSurfaces(state)) {
+        bytes += areaBytes(surface.tile.area, surface.layout) / 3;
+      }
+      return bytes;
+    }
+
+    /**
+     * Texture coordinates of a tile's core within its area.
+     */
+    QRectF coreTexRect(Tile const& tile) {
+      QRectF core(tile.core);
+      QRectF area(tile.area);
+      return {(core.left() - area.left()) / area.width(),
+              (core.top() - area.top()) / area.height(),
+              core.width() / area.width(),
+              core.height() / area.height()};
+    }
+
+    /**
+     * Surrounds a frame with copies of its edge pixels, atlasGutter wide.
+     */
+    QImage padFrame(QImage const& frame, int pixelSize) {
+      int w = frame.width();
+      int h = frame.height();
+      QImage padded(w + 2 * atlasGutter, h + 2 * atlasGutter, frame.format());
+
+      auto px = static_cast<std::size_t>(pixelSize);
+      auto rowBytes = static_cast<std::size_t>(w) * px;
+      auto gutterBytes = static_cast<std::size_t>(atlasGutter) * px;
+
+      for (int y = 0; y < padded.height(); ++y) {
+        auto const* src =
+          frame.constScanLine(std::clamp(y - atlasGutter, 0, h - 1));
+        auto* dst = padded.scanLine(y);
+
+        for (int x = 0; x < atlasGutter; ++x) {
+          auto offset = static_cast<std::size_t>(x) * px;
+          std::memcpy(dst + offset, src, px);
+          std::memcpy(
+            dst + gutterBytes + rowBytes + offset, src + rowBytes - px, px);
+        }
+        std::memcpy(dst + gutterBytes, src, rowBytes);
+      }
+      return padded;
+    }
+
+    auto contextGuard(Host& host) {
+      host.makeCurrent();
+      return ScopeGuard{[&] { host.doneCurrent(); }};
     }
   }
 
+  bool isAvailable() {
+    QOpenGLContext context;
+    if (!context.create()) {
+      return false;
+    }
+
+    QOffscreenSurface surface;
+    surface.setFormat(context.format());
+    surface.create();
+    if (!context.makeCurrent(&surface)) {
+      return false;
+    }
+
+    bool available =
+      context.versionFunctions<QOpenGLFunctions_2_1>() != nullptr;
+    context.doneCurrent();
+    return available;
+  }
+
+  MipChain::~MipChain() {
+    // the builder finishes its current level, then the future's destructor
+    // waits for it
+    cancelled = true;
+  }
+
   //
   // ImageRenderer member functions
   //
 
   ImageRenderer::ImageRenderer(
-    ImageWidget& widget,
-    QMetaObject::Connection&& contextDestroyConnection)
-      : widget_(widget),
-        contextDestroyConnection_(std::move(contextDestroyConnection)) {
+    Host& host,
+    QMetaObject::Connection&& contextDestroyConnection,
+    Options const& options)
+      : host_(host),
+        contextDestroyConnection_(std::move(contextDestroyConnection)),
+        mipmapSource_(options.mipmaps),
+        residencyBudget_(options.residencyBudget) {
     auto* context = QOpenGLContext::currentContext();
     if (!context) {
       throw Error("Null context returned.");
@@ -72,6 +306,25 @@ namespace dumageview::imagerenderer::detail {
       throw Error("OpenGL functions (compatible with version 2.1) not available.");
     }
 
+    gl_->glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize_);
+    DUMAGEVIEW_LOG_DEBUG("Max texture size: {}", maxTextureSize_);
+
+    if (uploadBuffer_.create()) {
+      uploadBuffer_.setUsagePattern(QOpenGLBuffer::StreamDraw);
+    } else {
+      log::warn("Could not create pixel buffer; uploading from client memory");
+    }
+
+    if (options.pipeline == Pipeline::shader) {
+      try {
+        quadBatch_ = std::make_unique<QuadBatch>(*gl_);
+      } catch (quadbatch::Error const& error) {
+        log::warn("Using legacy rendering; shaders failed: {}", error.what());
+      }
+    }
+    DUMAGEVIEW_LOG_DEBUG("Rendering with {} pipeline",
+                         quadBatch_ ? "shader" : "legacy");
+
     gl_->glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
     gl_->glEnable(GL_BLEND);
@@ -81,6 +334,14 @@ namespace dumageview::imagerenderer::detail {
   ImageRenderer::~ImageRenderer() {
     DUMAGEVIEW_LOG_TRACE("this = {}", this);
     removeImage();
+    {
+      auto guard = contextGuard(host_);
+      resident_.clear();
+      frameAtlas_.reset();
+      lutTexture_.reset();
+      quadBatch_.reset();
+      uploadBuffer_.destroy();
+    }
     qtutil::disconnect(contextDestroyConnection_);
   }
 
@@ -88,94 +349,1010 @@ namespace dumageview::imagerenderer::detail {
   // Image management
   //
 
-  void ImageRenderer::setImage(QImage image) {
-    auto guard = contextGuard(widget_);
+  bool ImageRenderer::setImage(QImage image,
+                               QString const& key,
+                               std::shared_ptr<TileSource const> tileSource,
+                               std::shared_ptr<YCbCrPlanes const> planes,
+                               FrameRef const& frame) {
+    auto guard = contextGuard(host_);
 
-    // TODO: Test against GL_MAX_TEXTURE_SIZE
-    imageState_.reset(
-      new ImageState{image, QOpenGLTexture{image}, ZoomToFitView{}}
-    );
+    // damage is against the frame before, which is only up once uploaded
+    bool wasUploading = pendingUpload_ != nullptr;
+    pendingUpload_.reset();
 
-    auto& tex = imageState_->texture;
-    tex.setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
-    tex.setMagnificationFilter(QOpenGLTexture::Linear);
+    // reshowing the current image changes nothing
+    if (!key.isEmpty() && imageState_ && imageState_->key == key
+        && imageState_->imageSize == image.size()) {
+      return true;
+    }
 
-    tex.setBorderColor(0.0f, 0.0f, 0.0f, 1.0f);
-    tex.setWrapMode(QOpenGLTexture::ClampToBorder);
+    if (auto state = takeResident(key, image.size())) {
+      DUMAGEVIEW_LOG_DEBUG("Reusing resident textures for {}",
+                           conv::str(key));
+      state->navigator.resize(getScreenSize());
+      makeResident(std::exchange(imageState_, std::move(state)));
+      evictResident();
+      gl_->glEnable(GL_TEXTURE_2D);
+      return true;
+    }
 
-    gl_->glEnable(GL_TEXTURE_2D);
+    auto upload = std::make_unique<PendingUpload>();
+    upload->timer.start();
+
+    // the fixed-function path cannot convert, and tiles would need their
+    // own chroma
+    if (planes) {
+      bool fits = image.width() <= maxTextureSize_
+                  && image.height() <= maxTextureSize_;
+      if (!quadBatch_ || !fits) {
+        DUMAGEVIEW_LOG_DEBUG("Converting YCbCr planes on the CPU");
+        image = planes->toRgb();
+        planes.reset();
+      }
+    }
+
+    // nor can it look up palettes
+    bool indexed = image.format() == QImage::Format_Indexed8
+                   || image.format() == QImage::Format_Mono
+                   || image.format() == QImage::Format_MonoLSB;
+    if (indexed && !quadBatch_) {
+      image = image.convertToFormat(QImage::Format_ARGB32);
+      indexed = false;
+    }
+
+    auto& state = upload->state = std::make_unique<ImageState>();
+    state->key = key;
+    state->sequence = frame.sequence;
+    std::tie(state->image, state->layout) = toUploadable(std::move(image));
+    state->imageSize = state->image.size();
+    state->size = tileSource ? tileSource->getSize() : state->imageSize;
+    state->tileScale = {
+      static_cast<double>(state->size.width()) / state->image.width(),
+      static_cast<double>(state->size.height()) / state->image.height()};
+    state->navigator.reset(conv::dvec(state->size));
+    state->navigator.resize(getScreenSize());
+
+    // animation frames that fit an atlas are shown as soon as they are in
+    auto atlas = (tileSource || planes)
+                   ? nullptr
+                   : getAtlas(frame, state->image, state->layout);
+    if (atlas) {
+      if (!atlas->filled[static_cast<std::size_t>(frame.index)]) {
+        insertFrame(*atlas, frame.index, state->image);
+      }
+      state->atlas = atlas;
+      state->atlasFrame = frame.index;
+
+      if (indexed) {
+        state->palette = makePalette(state->image);
+        state->textureBytes += paletteSize * 4;
+      }
+
+      // the next frame of the same animation carries on where this left off
+      bool sameAnimation = imageState_ && imageState_->atlas == atlas;
+      if (sameAnimation) {
+        state->navigator.restore(imageState_->navigator);
+      }
+
+      makeResident(std::exchange(imageState_, std::move(state)));
+      evictResident();
+      gl_->glEnable(GL_TEXTURE_2D);
+      return sameAnimation;
+    }
+
+    // other frames rewrite only what changed, when that is little
+    if (frame.damage && !wasUploading && !tileSource && !planes
+        && updateFrame(*state, *frame.damage)) {
+      return true;
+    }
+
+    if (tileSource) {
+      state->virtualTexture = std::make_unique<VirtualTexture>(
+        *gl_, std::move(tileSource), host_.makeWake());
+      state->textureBytes += state->virtualTexture->getTextureBytes();
+    }
+
+    // split images that exceed GL_MAX_TEXTURE_SIZE
+    auto grid = tilegrid::makeTileGrid(
+      state->image.size(), maxTextureSize_, tileGutter);
+    bool tiled = grid.size() > 1;
+
+    // storage only; pixels are streamed in by draw()
+    for (auto const& rect : grid) {
+      auto tex = makeTexture(rect.area.size(), state->layout);
+
+      // coarser levels would blend across the gutter
+      int mipLevels = tex->maximumMipLevels();
+      if (tiled) {
+        mipLevels = std::min(mipLevels, tileGutterLevels + 1);
+      }
+
+      // indices cannot be blended; the shader filters after lookup
+      if (indexed) {
+        tex->setMinMagFilters(QOpenGLTexture::Nearest,
+                              QOpenGLTexture::Nearest);
+      }
+
+      state->tiles.push_back({rect.core, rect.area, std::move(tex), mipLevels});
+      state->textureBytes += areaBytes(rect.area, state->layout);
+    }
+
+    if (indexed) {
+      state->palette = makePalette(state->image);
+      state->textureBytes += paletteSize * 4;
+    }
+
+    if (planes) {
+      for (auto const* plane : {&planes->cb, &planes->cr}) {
+        auto tex = makeTexture(plane->size(), lumaLayout);
+        int mipLevels = tex->maximumMipLevels();
+        state->chroma.push_back(
+          {plane->rect(), plane->rect(), std::move(tex), mipLevels});
+        state->textureBytes += areaBytes(plane->rect(), lumaLayout);
+      }
+      state->planes = std::move(planes);
+    }
+
+    if (tiled) {
+      DUMAGEVIEW_LOG_DEBUG("Split {}x{} image into {} tiles",
+                           state->image.width(),
+                           state->image.height(),
+                           state->tiles.size());
+    }
+
+    // the current image stays up until this one is complete
+    pendingUpload_ = std::move(upload);
+    return false;
+  }
+
+  std::unique_ptr<QOpenGLTexture> ImageRenderer::makeTexture(
+    QSize const& size,
+    PixelLayout const& layout) {
+    auto tex = std::make_unique<QOpenGLTexture>(QOpenGLTexture::Target2D);
+    tex->setSize(size.width(), size.height());
+
+    // Only the base level until the image is minified. Allocated here
+    // rather than by QOpenGLTexture, which would make immutable storage
+    // where it can, leaving no room for mip levels later; it also knows no
+    // luminance formats.
+    tex->create();
+    tex->bind();
+    gl_->glTexImage2D(GL_TEXTURE_2D,
+                      0,
+                      static_cast<GLint>(layout.internalFormat),
+                      size.width(),
+                      size.height(),
+                      0,
+                      layout.format,
+                      layout.type,
+                      nullptr);
+    tex->setMipMaxLevel(0);
+
+    tex->setMinificationFilter(QOpenGLTexture::Linear);
+    tex->setMagnificationFilter(QOpenGLTexture::Linear);
+    tex->setWrapMode(QOpenGLTexture::ClampToEdge);
+    return tex;
+  }
+
+  std::unique_ptr<QOpenGLTexture> ImageRenderer::makePalette(
+    QImage const& image) {
+    // indices past the color table show as transparent
+    auto colors = image.colorTable();
+    colors.resize(paletteSize);
+
+    auto tex = makeTexture({paletteSize, 1}, bgraLayout);
+    tex->setMinMagFilters(QOpenGLTexture::Nearest, QOpenGLTexture::Nearest);
+    gl_->glTexSubImage2D(GL_TEXTURE_2D,
+                         0,
+                         0,
+                         0,
+                         paletteSize,
+                         1,
+                         bgraLayout.format,
+                         bgraLayout.type,
+                         colors.constData());
+    return tex;
   }
 
   void ImageRenderer::removeImage() {
-    auto guard = contextGuard(widget_);
+    auto guard = contextGuard(host_);
+    pendingUpload_.reset();
     imageState_.reset();
+    frameAtlas_.reset();
     gl_->glDisable(GL_TEXTURE_2D);
   }
 
   //
-  // Convenience accessor-like functions
+  // Residency
   //
 
-  glm::dvec2 ImageRenderer::getImageSize() const {
-    DUMAGEVIEW_ASSERT(imageState_);
-    return conv::dvec(imageState_->image.size());
+  std::unique_ptr<ImageState> ImageRenderer::takeResident(QString const& key,
+                                                          QSize const& size) {
+    if (key.isEmpty()) {
+      return nullptr;
+    }
+
+    auto it = std::find_if(resident_.begin(), resident_.end(), [&](auto& s) {
+      return s->key == key;
+    });
+    if (it == resident_.end()) {
+      return nullptr;
+    }
+
+    auto state = std::move(*it);
+    resident_.erase(it);
+    residentBytes_ -= state->textureBytes;
+
+    // same name, different contents
+    if (state->imageSize != size) {
+      return nullptr;
+    }
+    return state;
   }
 
-  glm::dvec2 ImageRenderer::getScreenSize() const {
-    return conv::dvec(widget_.size());
+  void ImageRenderer::makeResident(std::unique_ptr<ImageState> state) {
+    // atlas frames are cheap to make again while the atlas is around
+    if (!state || state->key.isEmpty() || state->atlas) {
+      return;
+    }
+
+    // the textures hold all of it, so host memory is not kept uncounted;
+    // mipmaps not yet in are left for the driver to make if needed again
+    state->image = QImage{};
+    state->mipImages.clear();
+    state->mipChain.reset();
+
+    residentBytes_ += state->textureBytes;
+    resident_.push_front(std::move(state));
   }
 
-  SizeInfo ImageRenderer::getSizeInfo() const {
-    DUMAGEVIEW_ASSERT(imageState_);
-    return {getImageSize(), getScreenSize()};
+  void ImageRenderer::evictResident() {
+    std::size_t shownBytes = imageState_ ? imageState_->textureBytes : 0;
+    if (frameAtlas_) {
+      shownBytes += frameAtlas_->textureBytes;
+    }
+
+    while (!resident_.empty()
+           && shownBytes + residentBytes_ > residencyBudget_) {
+      DUMAGEVIEW_LOG_DEBUG("Evicting textures for {}",
+                           conv::str(resident_.back()->key));
+      residentBytes_ -= resident_.back()->textureBytes;
+      resident_.pop_back();
+    }
+
+    logResidency();
   }
 
-  ViewMod<View> ImageRenderer::getViewMod() const {
-    DUMAGEVIEW_ASSERT(imageState_);
-    return ViewMod(imageState_->view, getSizeInfo());
+  void ImageRenderer::logResidency() const {
+    std::map<std::string, std::size_t> bytesByFormat;
+
+    auto add = [&](ImageState const& state) {
+      for (auto const& surface : getSurfaces(state)) {
+        auto bytes = areaBytes(surface.tile.area, surface.layout);
+        if (state.mipmapped) {
+          bytes += bytes / 3;
+        }
+        bytesByFormat[formatName(surface.layout.internalFormat)] += bytes;
+      }
+
+      // tile cache is always RGBA8
+      if (state.virtualTexture) {
+        bytesByFormat[formatName(GL_RGBA8)] +=
+          state.virtualTexture->getTextureBytes();
+      }
+    };
+
+    if (imageState_) {
+      add(*imageState_);
+    }
+    for (auto const& state : resident_) {
+      add(*state);
+    }
+    if (frameAtlas_) {
+      bytesByFormat[formatName(frameAtlas_->layout.internalFormat)] +=
+        frameAtlas_->textureBytes;
+    }
+
+    std::string summary;
+    for (auto const& [name, bytes] : bytesByFormat) {
+      summary += fmt::format(
+        " {} {:.1f} MiB", name, static_cast<double>(bytes) / (1 << 20));
+    }
+    log::debug("Texture memory by format:{}", summary);
   }
 
   //
-  // Input events
+  // Mipmaps
   //
 
-  void ImageRenderer::move(QPoint const& dPos) {
-    if (!imageState_) {
+  void ImageRenderer::startMipmaps(ImageState& state) {
+    // resident images have let go of their pixels
+    if (mipmapSource_ == MipmapSource::driver || state.image.isNull()) {
+      QElapsedTimer timer;
+      timer.start();
+
+      for (auto const& surface : getSurfaces(state)) {
+        auto& tex = *surface.tile.texture;
+        tex.setMipMaxLevel(surface.tile.mipLevels - 1);
+        tex.generateMipMaps();
+        tex.setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
+      }
+
+      // wait for the driver, to compare against the CPU path
+      gl_->glFinish();
+      log::debug("Driver built mipmaps for {}x{} image in {:.1f} ms",
+                 state.imageSize.width(),
+                 state.imageSize.height(),
+                 toMillis(timer.nsecsElapsed()));
+
+      state.textureBytes += mipLevelBytes(state);
+      state.mipmapped = true;
       return;
     }
-    auto vm = getViewMod();
-    vm.modify([&](auto& v) {
-      v.position += conv::dvec(dPos);
-    });
-    imageState_->view = vm.normalize().getView();
+
+    auto chain = std::make_unique<MipChain>();
+    chain->timer.start();
+
+    std::vector<std::tuple<QImage, QRect, int>> jobs;
+    for (auto const& surface : getSurfaces(state)) {
+      jobs.emplace_back(
+        surface.image, surface.tile.area, surface.tile.mipLevels);
+    }
+
+    chain->building = std::async(
+      std::launch::async,
+      [jobs = std::move(jobs),
+       &cancelled = chain->cancelled,
+       &pool = mipPool_,
+       wake = host_.makeWake()] {
+        std::vector<std::vector<QImage>> levels;
+        for (auto const& [image, area, numLevels] : jobs) {
+          auto base = (area == image.rect()) ? image : image.copy(area);
+          levels.push_back(
+            mipmap::buildChain(base, numLevels, pool, cancelled));
+        }
+        wake();
+        return levels;
+      });
+
+    state.mipChain = std::move(chain);
   }
 
-  void ImageRenderer::zoomRel(int steps, QPointF const& pos) {
-    if (!imageState_) {
+  void ImageRenderer::advanceMipmaps(ImageState& state) {
+    DUMAGEVIEW_ASSERT(state.mipChain);
+    auto& chain = *state.mipChain;
+    auto surfaces = getSurfaces(state);
+
+    if (chain.building.valid()) {
+      using namespace std::chrono_literals;
+      if (chain.building.wait_for(0s) != std::future_status::ready) {
+        return;
+      }
+      chain.levels = chain.building.get();
+      log::debug("CPU built mipmaps for {}x{} image in {:.1f} ms",
+                 state.imageSize.width(),
+                 state.imageSize.height(),
+                 toMillis(chain.timer.nsecsElapsed()));
+
+      // built from a frame shown before this one
+      for (std::size_t i = 0; i < surfaces.size(); ++i) {
+        redoMipRects(surfaces[i], chain.levels[i], chain.damage, 0);
+      }
+      chain.damage = {};
+    }
+
+    // a level at a time; each is usable as soon as it is in
+    qint64 budget = uploadBytesPerFrame;
+    while (budget > 0 && chain.surfaceIndex < surfaces.size()) {
+      auto const& surface = surfaces[chain.surfaceIndex];
+      auto const& levels = chain.levels[chain.surfaceIndex];
+
+      if (chain.levelIndex == levels.size()) {
+        ++chain.surfaceIndex;
+        chain.levelIndex = 0;
+        continue;
+      }
+
+      auto const& level = levels[chain.levelIndex];
+      int levelNum = static_cast<int>(chain.levelIndex) + 1;
+      auto const& layout = surface.layout;
+      auto& tex = *surface.tile.texture;
+
+      tex.bind();
+      gl_->glTexImage2D(GL_TEXTURE_2D,
+                        levelNum,
+                        static_cast<GLint>(layout.internalFormat),
+                        level.width(),
+                        level.height(),
+                        0,
+                        layout.format,
+                        layout.type,
+                        level.constBits());
+
+      tex.setMipMaxLevel(levelNum);
+      tex.setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
+
+      budget -= level.sizeInBytes();
+      ++chain.levelIndex;
+    }
+
+    if (chain.surfaceIndex < surfaces.size()) {
+      host_.requestFrame();
       return;
     }
-    auto vm = getViewMod().reified();
-    vm.setZoom(vm.getView().scale * math::ipow(zoomFactor, steps),
-               conv::dvec(pos));
 
-    imageState_->view = vm.getView();
+    log::debug("Uploaded mipmaps {:.1f} ms after they were needed",
+               toMillis(chain.timer.nsecsElapsed()));
+
+    // the next frame of an animation redoes only the parts that changed
+    if (!state.sequence.isEmpty()) {
+      state.mipImages = std::move(chain.levels);
+    }
+
+    state.mipChain.reset();
+    state.textureBytes += mipLevelBytes(state);
+    state.mipmapped = true;
   }
 
-  void ImageRenderer::zoomAbs(double scale, QPointF const& pos) {
-    if (!imageState_) {
+  //
+  // Animation frames
+  //
+
+  std::shared_ptr<FrameAtlas> ImageRenderer::getAtlas(
+    FrameRef const& frame,
+    QImage const& image,
+    PixelLayout const& layout) {
+    if (frame.sequence.isEmpty() || frame.count < 2 || frame.index < 0
+        || frame.index >= frame.count) {
+      return nullptr;
+    }
+
+    if (frameAtlas_ && frameAtlas_->sequence == frame.sequence) {
+      // frames that differ from the first are uploaded on their own
+      bool fits = frameAtlas_->frameSize == image.size()
+                  && frameAtlas_->indexed
+                       == (image.format() == QImage::Format_Indexed8)
+                  && frameAtlas_->layout.internalFormat == layout.internalFormat
+                  && frameAtlas_->layout.format == layout.format
+                  && frameAtlas_->layout.type == layout.type
+                  && frameAtlas_->layout.premultiplied == layout.premultiplied;
+      return fits ? frameAtlas_ : nullptr;
+    }
+
+    // one animation at a time
+    frameAtlas_.reset();
+
+    auto roundUp = [](int n) {
+      return (n + atlasGutter - 1) / atlasGutter * atlasGutter;
+    };
+    QSize cell{roundUp(image.width() + 2 * atlasGutter),
+               roundUp(image.height() + 2 * atlasGutter)};
+
+    int pageSize = std::min(maxTextureSize_, atlasPageSize);
+    int across = std::min(pageSize / cell.width(), frame.count);
+    int down = pageSize / cell.height();
+    if (across == 0 || down == 0) {
+      return nullptr;
+    }
+    down = std::min(down, (frame.count + across - 1) / across);
+
+    int perPage = across * down;
+    int numPages = (frame.count + perPage - 1) / perPage;
+
+    // pages hold every frame in the end, so they have to fit with room
+    // for the shown image
+    std::size_t cellBytes = areaBytes(QRect({}, cell), layout);
+    std::size_t totalBytes = cellBytes * static_cast<std::size_t>(frame.count);
+    if (totalBytes + totalBytes / 3 > residencyBudget_ / 2) {
+      DUMAGEVIEW_LOG_DEBUG("{} frames of {}x{} are too large for an atlas",
+                           frame.count,
+                           image.width(),
+                           image.height());
+      return nullptr;
+    }
+
+    auto atlas = std::make_shared<FrameAtlas>();
+    atlas->sequence = frame.sequence;
+    atlas->frameSize = image.size();
+    atlas->layout = layout;
+    atlas->indexed = image.format() == QImage::Format_Indexed8;
+    atlas->cell = cell;
+    atlas->grid = {across, down};
+    atlas->pages.resize(static_cast<std::size_t>(numPages));
+    atlas->mipsStale.resize(static_cast<std::size_t>(numPages), false);
+    atlas->filled.resize(static_cast<std::size_t>(frame.count), false);
+
+    DUMAGEVIEW_LOG_DEBUG("Atlas for {} frames of {}x{}: {} pages of {}x{}",
+                         frame.count,
+                         image.width(),
+                         image.height(),
+                         numPages,
+                         across,
+                         down);
+
+    frameAtlas_ = atlas;
+    return atlas;
+  }
+
+  void ImageRenderer::insertFrame(FrameAtlas& atlas,
+                                  int index,
+                                  QImage const& image) {
+    int perPage = atlas.grid.width() * atlas.grid.height();
+    auto page = static_cast<std::size_t>(index / perPage);
+    int cellIndex = index % perPage;
+
+    auto& texture = atlas.pages[page];
+    if (!texture) {
+      // the last page only has the rows it needs
+      int numFrames = std::min(
+        perPage, static_cast<int>(atlas.filled.size()) - index + cellIndex);
+      int rows = (numFrames + atlas.grid.width() - 1) / atlas.grid.width();
+      QSize size{atlas.grid.width() * atlas.cell.width(),
+                 rows * atlas.cell.height()};
+
+      texture = makeTexture(size, atlas.layout);
+      if (atlas.indexed) {
+        texture->setMinMagFilters(QOpenGLTexture::Nearest,
+                                  QOpenGLTexture::Nearest);
+      }
+
+      auto bytes = areaBytes(QRect({}, size), atlas.layout);
+      atlas.textureBytes += atlas.indexed ? bytes : bytes + bytes / 3;
+    }
+
+    auto padded = padFrame(image, atlas.layout.pixelSize);
+    texture->bind();
+    gl_->glTexSubImage2D(GL_TEXTURE_2D,
+                         0,
+                         cellIndex % atlas.grid.width() * atlas.cell.width(),
+                         cellIndex / atlas.grid.width() * atlas.cell.height(),
+                         padded.width(),
+                         padded.height(),
+                         atlas.layout.format,
+                         atlas.layout.type,
+                         padded.constBits());
+
+    atlas.filled[static_cast<std::size_t>(index)] = true;
+    atlas.mipsStale[page] = texture->mipMaxLevel() > 0;
+  }
+
+  Quad ImageRenderer::makeAtlasQuad(ImageState const& state, bool minified) {
+    DUMAGEVIEW_ASSERT(state.atlas);
+    auto& atlas = *state.atlas;
+
+    int perPage = atlas.grid.width() * atlas.grid.height();
+    auto page = static_cast<std::size_t>(state.atlasFrame / perPage);
+    int cellIndex = state.atlasFrame % perPage;
+    auto& texture = *atlas.pages[page];
+
+    if (minified && !atlas.indexed
+        && (texture.mipMaxLevel() == 0 || atlas.mipsStale[page])) {
+      texture.setMipMaxLevel(atlasGutterLevels);
+      texture.generateMipMaps();
+      texture.setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
+      atlas.mipsStale[page] = false;
+    }
+
+    double w = texture.width();
+    double h = texture.height();
+    QRectF texRect{
+      (cellIndex % atlas.grid.width() * atlas.cell.width() + atlasGutter) / w,
+      (cellIndex / atlas.grid.width() * atlas.cell.height() + atlasGutter) / h,
+      atlas.frameSize.width() / w,
+      atlas.frameSize.height() / h};
+
+    return {&texture,
+            QRectF(QPointF(0.0, 0.0), state.size),
+            texRect,
+            {},
+            state.palette.get()};
+  }
+
+  bool ImageRenderer::updateFrame(ImageState& next, QRegion const& damage) {
+    auto* shown = imageState_.get();
+    bool fits = shown && !next.sequence.isEmpty()
+                && shown->sequence == next.sequence && !shown->atlas
+                && !shown->virtualTexture && !shown->planes
+                && shown->imageSize == next.imageSize
+                && shown->layout.internalFormat == next.layout.internalFormat
+                && shown->layout.format == next.layout.format
+                && shown->layout.type == next.layout.type
+                && shown->layout.premultiplied == next.layout.premultiplied;
+    if (!fits) {
+      return false;
+    }
+
+    // larger changes are streamed in over several frames as usual
+    std::size_t bytes = 0;
+    for (auto const& rect : damage) {
+      bytes += areaBytes(rect, next.layout);
+    }
+    if (bytes > static_cast<std::size_t>(uploadBytesPerFrame)) {
+      return false;
+    }
+
+    for (auto const& surface : getSurfaces(*shown)) {
+      auto const& area = surface.tile.area;
+      for (auto const& rect : damage) {
+        auto part = rect & area;
+        if (!part.isEmpty()) {
+          uploadRect(*surface.tile.texture,
+                     0,
+                     next.image,
+                     next.layout,
+                     part,
+                     part.topLeft() - area.topLeft());
+        }
+      }
+    }
+
+    DUMAGEVIEW_LOG_DEBUG("Updated {} bytes of {}x{} frame",
+                         bytes,
+                         next.image.width(),
+                         next.image.height());
+
+    shown->key = next.key;
+    shown->image = std::move(next.image);
+    if (shown->palette) {
+      shown->palette = makePalette(shown->image);
+    }
+    updateMipmaps(*shown, damage);
+    return true;
+  }
+
+  void ImageRenderer::updateMipmaps(ImageState& state, QRegion const& damage) {
+    auto surfaces = getSurfaces(state);
+
+    // levels still being made are of the frame before; rather than wait
+    // for them, they are brought up to date once they are in
+    if (state.mipChain) {
+      auto& chain = *state.mipChain;
+      if (chain.building.valid()) {
+        chain.damage += damage;
+        return;
+      }
+      for (std::size_t i = 0; i < surfaces.size(); ++i) {
+        redoMipRects(
+          surfaces[i], chain.levels[i], damage, levelsUploaded(chain, i));
+      }
       return;
     }
+
+    if (!state.mipmapped) {
+      return;
+    }
+
+    for (std::size_t i = 0; i < surfaces.size(); ++i) {
+      auto const& surface = surfaces[i];
+      if (!damage.intersects(surface.tile.area)) {
+        continue;
+      }
+
+      // the driver can only build whole levels
+      if (state.mipImages.size() != surfaces.size()) {
+        surface.tile.texture->generateMipMaps();
+        continue;
+      }
+
+      auto& levels = state.mipImages[i];
+      redoMipRects(surface, levels, damage, levels.size());
+    }
+  }
+
+  void ImageRenderer::redoMipRects(Surface const& surface,
+                                   std::vector<QImage>& levels,
+                                   QRegion const& damage,
+                                   std::size_t numUploaded) {
+    auto const& area = surface.tile.area;
+    auto const& image = surface.image;
+
+    // the tile's area of the image, without copying it
+    QImage base{image.constScanLine(area.top())
+                  + area.left() * surface.layout.pixelSize,
+                area.width(),
+                area.height(),
+                image.bytesPerLine(),
+                image.format()};
+
+    for (auto const& rect : damage) {
+      auto changed = (rect & area).translated(-area.topLeft());
+      QImage const* below = &base;
+
+      for (std::size_t i = 0; i < levels.size() && !changed.isEmpty(); ++i) {
+        auto& level = levels[i];
+        changed = mipmap::downsampleRect(*below, level, changed);
+        if (i < numUploaded && !changed.isEmpty()) {
+          uploadRect(*surface.tile.texture,
+                     static_cast<int>(i) + 1,
+                     level,
+                     surface.layout,
+                     changed,
+                     changed.topLeft());
+        }
+        below = &level;
+      }
+    }
+  }
+
+  //
+  // Texture upload
+  //
+
+  void ImageRenderer::advanceUpload() {
+    DUMAGEVIEW_ASSERT(pendingUpload_);
+    auto& upload = *pendingUpload_;
+    auto surfaces = getSurfaces(*upload.state);
+
+    QElapsedTimer frameTimer;
+    frameTimer.start();
+
+    int budget = uploadBytesPerFrame;
+    while (budget > 0 && upload.surfaceIndex < surfaces.size()) {
+      auto const& surface = surfaces[upload.surfaceIndex];
+      auto const& area = surface.tile.area;
+      int rowBytes = area.width() * surface.layout.pixelSize;
+      int numRows =
+        std::clamp(budget / rowBytes, 1, area.height() - upload.row);
+
+      uploadRows(surface, upload.row, numRows);
+      upload.row += numRows;
+      budget -= numRows * rowBytes;
+
+      if (upload.row == area.height()) {
+        upload.row = 0;
+        ++upload.surfaceIndex;
+      }
+    }
+
+    qint64 frameNanos = frameTimer.nsecsElapsed();
+    upload.busyNanos += frameNanos;
+    upload.worstFrameNanos = std::max(upload.worstFrameNanos, frameNanos);
+    ++upload.numFrames;
+
+    if (upload.surfaceIndex < surfaces.size()) {
+      return;
+    }
+
+    log::debug(
+      "Uploaded {}x{} image in {:.1f} ms over {} frames "
+      "({:.1f} ms GL time, worst frame {:.1f} ms)",
+      upload.state->image.width(),
+      upload.state->image.height(),
+      toMillis(upload.timer.nsecsElapsed()),
+      upload.numFrames,
+      toMillis(upload.busyNanos),
+      toMillis(upload.worstFrameNanos));
+
+    makeResident(std::exchange(imageState_, std::move(upload.state)));
+    pendingUpload_.reset();
+    evictResident();
+    gl_->glEnable(GL_TEXTURE_2D);
+  }
+
+  QOpenGLTexture* ImageRenderer::getLutTexture(
+    std::shared_ptr<ColorLut const> const& lut) {
+    if (!lut) {
+      return nullptr;
+    }
+    if (lut == lutSource_) {
+      return lutTexture_.get();
+    }
+
+    auto tex = std::make_unique<QOpenGLTexture>(QOpenGLTexture::Target3D);
+    tex->setSize(lut->size, lut->size, lut->size);
+    tex->create();
+    tex->bind();
+
+    // rows of 16-bit RGB are not four-byte aligned
+    gl_->glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+    gl_->glTexImage3D(GL_TEXTURE_3D,
+                      0,
+                      GL_RGB16,
+                      lut->size,
+                      lut->size,
+                      lut->size,
+                      0,
+                      GL_RGB,
+                      GL_UNSIGNED_SHORT,
+                      lut->table.data());
+    gl_->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    tex->setMinMagFilters(QOpenGLTexture::Linear, QOpenGLTexture::Linear);
+    tex->setWrapMode(QOpenGLTexture::ClampToEdge);
+    tex->release();
+
+    lutTexture_ = std::move(tex);
+    lutSource_ = lut;
+    return lutTexture_.get();
+  }
+
+  void ImageRenderer::uploadRows(Surface const& surface,
+                                 int firstRow,
+                                 int numRows) {
+    auto const& tile = surface.tile;
+    auto const& pixels = surface.image;
+    auto const& layout = surface.layout;
+    int rowBytes = tile.area.width() * layout.pixelSize;
+    int left = tile.area.left() * layout.pixelSize;
+    int top = tile.area.top() + firstRow;
+
+    tile.texture->bind();
+
+    if (uploadBufferMappable_ && uploadBuffer_.isCreated()) {
+      uploadBuffer_.bind();
+
+      // rows keep GL's default four-byte alignment
+      int pitch = (rowBytes + 3) & ~3;
+
+      // reallocating orphans the last chunk, so the driver need not wait on it
+      uploadBuffer_.allocate(numRows * pitch);
+      auto* dst =
+        static_cast<uchar*>(uploadBuffer_.map(QOpenGLBuffer::WriteOnly));
+
+      if (dst) {
+        for (int r = 0; r < numRows; ++r) {
+          std::memcpy(dst + r * pitch,
+                      pixels.constScanLine(top + r) + left,
+                      static_cast<std::size_t>(rowBytes));
+        }
+        uploadBuffer_.unmap();
+
+        gl_->glTexSubImage2D(GL_TEXTURE_2D,
+                             0,
+                             0,
+                             firstRow,
+                             tile.area.width(),
+                             numRows,
+                             layout.format,
+                             layout.type,
+                             nullptr);
+        uploadBuffer_.release();
+        return;
+      }
+
+      uploadBuffer_.release();
+      uploadBufferMappable_ = false;
+      log::warn("Could not map pixel buffer; uploading from client memory");
+    }
+
+    // in pixels where that divides evenly; otherwise QImage's own padding
+    // matches GL's default four-byte row alignment
+    int stride = (pixels.bytesPerLine() % layout.pixelSize == 0)
+                   ? pixels.bytesPerLine() / layout.pixelSize
+                   : pixels.width();
+    gl_->glPixelStorei(GL_UNPACK_ROW_LENGTH, stride);
+    gl_->glTexSubImage2D(GL_TEXTURE_2D,
+                         0,
+                         0,
+                         firstRow,
+                         tile.area.width(),
+                         numRows,
+                         layout.format,
+                         layout.type,
+                         pixels.constScanLine(top) + left);
+    gl_->glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  }
+
+  void ImageRenderer::uploadRect(QOpenGLTexture& texture,
+                                 int level,
+                                 QImage const& pixels,
+                                 PixelLayout const& layout,
+                                 QRect const& rect,
+                                 QPoint const& to) {
+    texture.bind();
+
+    // as in uploadRows
+    int stride = (pixels.bytesPerLine() % layout.pixelSize == 0)
+                   ? pixels.bytesPerLine() / layout.pixelSize
+                   : pixels.width();
+    gl_->glPixelStorei(GL_UNPACK_ROW_LENGTH, stride);
+    gl_->glTexSubImage2D(GL_TEXTURE_2D,
+                         level,
+                         to.x(),
+                         to.y(),
+                         rect.width(),
+                         rect.height(),
+                         layout.format,
+                         layout.type,
+                         pixels.constScanLine(rect.top())
+                           + rect.left() * layout.pixelSize);
+    gl_->glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  }
+
+  //
+  // Convenience accessor-like functions
+  //
+
+  glm::dvec2 ImageRenderer::getScreenSize() const {
+    return conv::dvec(host_.getSize());
+  }
+
+  ViewMod<View> ImageRenderer::getViewMod() const {
+    DUMAGEVIEW_ASSERT(imageState_);
+    return imageState_->navigator.getViewMod();
+  }
+
+  QRectF ImageRenderer::getVisibleImageRect() const {
     auto vm = getViewMod().reified();
-    vm.setZoom(scale, conv::dvec(pos));
+    auto screen = getScreenSize();
+
+    constexpr double inf = std::numeric_limits<double>::infinity();
+    glm::dvec2 lo{inf};
+    glm::dvec2 hi{-inf};
 
-    imageState_->view = vm.getView();
+    for (auto const& corner : {glm::dvec2{0.0, 0.0},
+                               glm::dvec2{screen.x, 0.0},
+                               glm::dvec2{0.0, screen.y},
+                               screen}) {
+      auto pos = vm.screenToImage(corner);
+      lo = glm::min(lo, pos);
+      hi = glm::max(hi, pos);
+    }
+    return {conv::qpointf(lo), conv::qpointf(hi)};
+  }
+
+  //
+  // Input events
+  //
+
+  void ImageRenderer::move(QPoint const& dPos) {
+    if (imageState_) {
+      imageState_->navigator.move(conv::dvec(dPos));
+    }
+  }
+
+  void ImageRenderer::zoomRel(int steps, QPointF const& pos) {
+    if (imageState_) {
+      imageState_->navigator.zoomRel(steps, conv::dvec(pos));
+    }
+  }
+
+  void ImageRenderer::zoomAbs(double scale, QPointF const& pos) {
+    if (imageState_) {
+      imageState_->navigator.zoomAbs(scale, conv::dvec(pos));
+    }
   }
 
   void ImageRenderer::zoomToFit() {
-    if (!imageState_) {
-      return;
+    if (imageState_) {
+      imageState_->navigator.zoomToFit();
     }
-    imageState_->view = ZoomToFitView{};
+  }
+
+  bool ImageRenderer::isZoomToFit() const {
+    return !imageState_ || imageState_->navigator.isZoomToFit();
+  }
+
+  void ImageRenderer::setView(View const& view) {
+    if (imageState_) {
+      imageState_->navigator.setView(view);
+    }
+  }
+
+  void ImageRenderer::setOrientation(Orientation const& orientation) {
+    // the image last passed to setImage, which may still be uploading
+    auto* state =
+      pendingUpload_ ? pendingUpload_->state.get() : imageState_.get();
+    if (state && state->navigator.getSize().orientation != orientation) {
+      state->navigator.setOrientation(orientation);
+    }
+  }
+
+  void ImageRenderer::setColorLut(std::shared_ptr<ColorLut const> lut) {
+    auto* state =
+      pendingUpload_ ? pendingUpload_->state.get() : imageState_.get();
+    if (state) {
+      state->colorLut = std::move(lut);
+    }
+  }
+
+  void ImageRenderer::setQuality(Quality quality) {
+    quality_ = quality;
+  }
+
+  void ImageRenderer::setDisplayAdjustments(
+    DisplayAdjustments const& adjustments) {
+    displayAdjustments_ = adjustments;
   }
 
   //
@@ -183,8 +1360,7 @@ namespace dumageview::imagerenderer::detail {
   //
 
   void ImageRenderer::resize(int w, int h) {
-    DUMAGEVIEW_ASSERT(w == widget_.width());
-    DUMAGEVIEW_ASSERT(h == widget_.height());
+    DUMAGEVIEW_ASSERT(QSize(w, h) == host_.getSize());
 
     gl_->glViewport(0, 0, w, h);
 
@@ -195,36 +1371,118 @@ namespace dumageview::imagerenderer::detail {
     gl_->glMatrixMode(GL_MODELVIEW);
 
     if (imageState_) {
-      imageState_->view = getViewMod().normalize().getView();
+      imageState_->navigator.resize(glm::dvec2{w, h});
+    }
+    // the image still uploading is shown at this size too
+    if (pendingUpload_) {
+      pendingUpload_->state->navigator.resize(glm::dvec2{w, h});
     }
   }
 
   void ImageRenderer::draw() {
+    if (pendingUpload_) {
+      advanceUpload();
+      if (pendingUpload_) {
+        host_.requestFrame();
+      }
+    }
+
     gl_->glClear(GL_COLOR_BUFFER_BIT);
     if (!imageState_) {
       return;
     }
+
+    auto& state = *imageState_;
+    auto visible = getVisibleImageRect();
+    double scale = getViewMod().reified().getView().scale;
+
+    // texels per screen pixel, at its largest
+    double minification =
+      scale * std::max(state.tileScale.width(), state.tileScale.height());
+    bool canMipmap = !state.palette && !state.atlas;
+    if (minification < 1.0 && canMipmap && !state.mipmapped
+        && !state.mipChain) {
+      startMipmaps(state);
+    }
+    if (state.mipChain) {
+      advanceMipmaps(state);
+    }
+
+    quadbatch::Chroma chroma;
+    if (state.planes) {
+      chroma = {state.chroma[0].texture.get(),
+                state.chroma[1].texture.get(),
+                state.planes->chromaScale()};
+    }
+
+    // only draw tiles that can be seen
+    std::vector<Quad> quads;
+    if (state.atlas) {
+      quads.push_back(makeAtlasQuad(state, minification < 1.0));
+    }
+    for (auto const& tile : state.tiles) {
+      QRectF pos{tile.core.x() * state.tileScale.width(),
+                 tile.core.y() * state.tileScale.height(),
+                 tile.core.width() * state.tileScale.width(),
+                 tile.core.height() * state.tileScale.height()};
+      if (visible.intersects(pos)) {
+        quads.push_back({tile.texture.get(),
+                         pos,
+                         coreTexRect(tile),
+                         chroma,
+                         state.palette.get()});
+      }
+    }
+
+    if (state.virtualTexture) {
+      state.virtualTexture->update(visible, scale, quads);
+    }
+
+    gl_->glBlendFunc(state.layout.premultiplied ? GL_ONE : GL_SRC_ALPHA,
+                     GL_ONE_MINUS_SRC_ALPHA);
+
+    if (!quadBatch_) {
+      drawLegacy(quads);
+      return;
+    }
+
+    for (auto const& quad : quads) {
+      quadBatch_->add(quad);
+    }
+    quadBatch_->draw(getViewMod().imageToClipMatrix(),
+                     quality_,
+                     displayAdjustments_,
+                     state.layout.premultiplied,
+                     getLutTexture(state.colorLut));
+  }
+
+  void ImageRenderer::drawLegacy(std::vector<Quad> const& quads) {
     auto transform = getViewMod().imageToScreenMatrix();
     gl_->glLoadMatrixd(&transform[0][0]);
 
     gl_->glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
-    imageState_->texture.bind();
 
-    glm::dvec2 rectSize = getImageSize();
-    gl_->glBegin(GL_POLYGON);
+    for (auto const& quad : quads) {
+      quad.texture->bind();
+
+      auto const& pos = quad.pos;
+      auto const& tex = quad.texRect;
 
-    gl_->glTexCoord2d(0.0, 0.0);
-    gl_->glVertex2d(0.0, 0.0);
+      gl_->glBegin(GL_POLYGON);
 
-    gl_->glTexCoord2d(1.0, 0.0);
-    gl_->glVertex2d(rectSize.x, 0.0);
+      gl_->glTexCoord2d(tex.left(), tex.top());
+      gl_->glVertex2d(pos.left(), pos.top());
 
-    gl_->glTexCoord2d(1.0, 1.0);
-    gl_->glVertex2d(rectSize.x, rectSize.y);
+      gl_->glTexCoord2d(tex.right(), tex.top());
+      gl_->glVertex2d(pos.right(), pos.top());
 
-    gl_->glTexCoord2d(0.0, 1.0);
-    gl_->glVertex2d(0.0, rectSize.y);
+      gl_->glTexCoord2d(tex.right(), tex.bottom());
+      gl_->glVertex2d(pos.right(), pos.bottom());
 
-    gl_->glEnd();
+      gl_->glTexCoord2d(tex.left(), tex.bottom());
+      gl_->glVertex2d(pos.left(), pos.bottom());
+
+      gl_->glEnd();
+    }
   }
 }
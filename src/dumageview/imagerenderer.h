@@ -1,25 +1,42 @@
 #ifndef DUMAGEVIEW_IMAGERENDERER_H_
 #define DUMAGEVIEW_IMAGERENDERER_H_
 
+#include "dumageview/colorlut.h"
 #include "dumageview/math_fwd.h"
+#include "dumageview/orientation.h"
+#include "dumageview/quadbatch.h"
 #include "dumageview/renderview.h"
+#include "dumageview/tilesource.h"
+#include "dumageview/virtualtexture.h"
+#include "dumageview/workerpool.h"
+#include "dumageview/ycbcr.h"
 
 #include <glm/glm.hpp>
 
+#include <QElapsedTimer>
 #include <QImage>
 #include <QObject>
+#include <QOpenGLBuffer>
 #include <QOpenGLTexture>
 #include <QPoint>
+#include <QRect>
+#include <QRectF>
+#include <QRegion>
 #include <QSize>
+#include <QString>
 
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <list>
 #include <memory>
+#include <optional>
 #include <stdexcept>
 #include <variant>
+#include <vector>
 
 class QOpenGLFunctions_2_1;
-namespace dumageview {
-  class ImageWidget;
-}
 
 namespace dumageview::imagerenderer::detail {
   using renderview::ManualView;
@@ -33,24 +50,234 @@ namespace dumageview::imagerenderer::detail {
     using std::runtime_error::runtime_error;
   };
 
+  enum class Pipeline {
+    shader,  // falls back to legacy if shaders cannot be built
+    legacy,  // fixed-function immediate mode
+    software,  // SoftwareRenderer, without OpenGL at all
+  };
+
+  enum class MipmapSource {
+    cpu,  // box filter on worker threads, uploaded a level at a time
+    driver,  // glGenerateMipmap
+  };
+
+  struct Options {
+    Pipeline pipeline = Pipeline::shader;
+    MipmapSource mipmaps = MipmapSource::cpu;
+    bool renderThread = false;  // see ThreadedRenderer
+
+    // texture memory kept for recently shown images, including the current one
+    std::size_t residencyBudget = std::size_t{512} << 20;
+  };
+
+  /**
+   * Client pixel layout of an image, as passed to glTexSubImage2D, and the
+   * texture format that keeps its precision.
+   */
+  struct PixelLayout {
+    GLenum internalFormat = GL_RGBA8;
+    GLenum format = GL_RGBA;
+    GLenum type = GL_UNSIGNED_BYTE;
+    int pixelSize = 4;  // bytes, in the client and the texture alike
+    bool premultiplied = false;
+  };
+
+  /**
+   * Part of an image with its own texture.
+   * Images within GL_MAX_TEXTURE_SIZE have exactly one.
+   */
+  struct Tile {
+    QRect core;  // image pixels drawn by this tile
+    QRect area;  // image pixels held by the texture
+    std::unique_ptr<QOpenGLTexture> texture;
+    int mipLevels = 1;  // once mipmapped
+  };
+
+  /**
+   * Where an image sits in an animation.
+   */
+  struct FrameRef {
+    QString sequence;  // names the animation; empty for still images
+    int index = 0;
+    int count = 1;
+    std::optional<QRegion> damage;  // changed since the frame before, if known
+  };
+
+  /**
+   * Frames of one animation packed side by side into a few large textures,
+   * so each is uploaded once and showing another only changes texture
+   * coordinates. Frames are padded with their edge pixels, enough for the
+   * few mip levels the driver builds for a page once it is drawn minified.
+   */
+  struct FrameAtlas {
+    QString sequence;
+    QSize frameSize;
+    PixelLayout layout;
+    bool indexed = false;  // filtered by the shader, so never mipmapped
+    QSize cell;  // a frame and its padding
+    QSize grid;  // cells across and down a full page
+
+    std::vector<std::unique_ptr<QOpenGLTexture>> pages;  // made as needed
+    std::vector<bool> mipsStale;  // per page
+    std::vector<bool> filled;  // per frame
+    std::size_t textureBytes = 0;
+  };
+
+  /**
+   * A texture and the client pixels that fill it.
+   */
+  struct Surface {
+    Tile const& tile;
+    QImage const& image;
+    PixelLayout const& layout;
+  };
+
+  /**
+   * Mip levels built on the CPU, then uploaded a slice per frame.
+   */
+  struct MipChain {
+    ~MipChain();
+
+    std::atomic<bool> cancelled{false};
+    std::future<std::vector<std::vector<QImage>>> building;  // per tile
+    std::vector<std::vector<QImage>> levels;  // from level 1
+
+    // where frames shown while building changed the image; redone once
+    // the levels are in
+    QRegion damage;
+
+    std::size_t surfaceIndex = 0;
+    std::size_t levelIndex = 0;
+    QElapsedTimer timer;
+  };
+
   struct ImageState {
-    QImage image;
-    QOpenGLTexture texture;
-    View view;
+    QString key;  // empty if the image should not stay resident
+    QString sequence;  // the animation it is a frame of, if any
+    QImage image;  // in layout; released once resident
+    QSize imageSize;  // of image, kept after it is released
+    PixelLayout layout;
+    QSize size;  // full image; larger than image if that is a preview
+
+    std::vector<Tile> tiles;
+    QSizeF tileScale{1.0, 1.0};  // image pixels per tile texel
+
+    // full-resolution tiles drawn over a preview
+    std::unique_ptr<VirtualTexture> virtualTexture;
+
+    // with YCbCr planes, image is the luma plane, and these hold Cb and Cr
+    std::shared_ptr<YCbCrPlanes const> planes;
+    std::vector<Tile> chroma;
+
+    // with a palette, image is Indexed8 and its tiles hold the indices
+    std::unique_ptr<QOpenGLTexture> palette;
+
+    // mipmaps are made the first time the image is minified
+    std::unique_ptr<MipChain> mipChain;
+    bool mipmapped = false;
+
+    // CPU-built levels of animation frames, kept while shown so the next
+    // frame can redo only what changed; per surface, from level 1
+    std::vector<std::vector<QImage>> mipImages;
+
+    // frames of an animation are drawn from an atlas instead of tiles, and
+    // are not kept resident on their own
+    std::shared_ptr<FrameAtlas> atlas;
+    int atlasFrame = 0;
+
+    std::size_t textureBytes = 0;
+    // view and orientation; the orientation is applied by the view, not to
+    // the textures
+    renderview::Navigator navigator;
+
+    // to the display's profile, applied by the shaders
+    std::shared_ptr<ColorLut const> colorLut;
+  };
+
+  /**
+   * Image whose textures are still being filled, a slice per frame.
+   */
+  struct PendingUpload {
+    std::unique_ptr<ImageState> state;
+
+    std::size_t surfaceIndex = 0;
+    int row = 0;  // next row of the current surface's area
+
+    QElapsedTimer timer;
+    int numFrames = 0;
+    qint64 busyNanos = 0;
+    qint64 worstFrameNanos = 0;
+  };
+
+  /**
+   * What an ImageRenderer draws into: a GL surface, and whoever schedules
+   * its frames.
+   */
+  class Host {
+   public:
+    virtual void makeCurrent() = 0;
+
+    virtual void doneCurrent() = 0;
+
+    virtual QSize getSize() const = 0;
+
+    /**
+     * Asks for another frame. Called on the thread that draws.
+     */
+    virtual void requestFrame() = 0;
+
+    /**
+     * Makes a function that asks for another frame from any thread. It may
+     * outlive the host, and then does nothing.
+     */
+    virtual std::function<void()> makeWake() = 0;
+
+   protected:
+    ~Host() = default;
   };
 
+  /**
+   * Whether a context with the OpenGL 2.1 functions ImageRenderer needs can
+   * be created. Makes a throwaway context to find out.
+   */
+  bool isAvailable();
+
   /**
    * Maintains GL-related things.
    * Only alive when GL is initialized.
    */
   class ImageRenderer {
    public:
-    ImageRenderer(ImageWidget& widget,
-                  QMetaObject::Connection&& contextDestroyConnection);
+    ImageRenderer(Host& host,
+                  QMetaObject::Connection&& contextDestroyConnection,
+                  Options const& options = {});
 
     ~ImageRenderer();
 
-    void setImage(QImage image);
+    /**
+     * Shows an image. If key names a resident image of the same size, its
+     * textures and view are reused and true is returned. Otherwise the image
+     * is uploaded over the next frames and shown zoomed to fit.
+     *
+     * With a tile source, image is a preview of it, and visible parts are
+     * filled in at full resolution as they are decoded.
+     *
+     * With YCbCr planes, image is their luma plane, and the shader converts
+     * them to RGB. They are converted on the CPU instead if the shader is
+     * not in use or the image has to be split.
+     *
+     * Indexed images are uploaded as indices plus a palette, looked up by
+     * the shader. They are not mipmapped.
+     *
+     * Frames of an animation that fit go into a FrameAtlas, uploaded right
+     * away, and keep the view of the frame shown before them. Other frames
+     * whose damage is known, and small, are written over the one before.
+     */
+    bool setImage(QImage image,
+                  QString const& key = {},
+                  std::shared_ptr<TileSource const> tileSource = nullptr,
+                  std::shared_ptr<YCbCrPlanes const> planes = nullptr,
+                  FrameRef const& frame = {});
 
     void removeImage();
 
@@ -62,6 +289,38 @@ namespace dumageview::imagerenderer::detail {
 
     void zoomToFit();
 
+    bool isZoomToFit() const;
+
+    /**
+     * Replaces the view of the current image, for callers that keep their
+     * own. It is normalized first.
+     */
+    void setView(View const& view);
+
+    /**
+     * Turns or mirrors the image last passed to setImage on screen, keeping
+     * the middle of the view where it is. Resident images keep theirs.
+     */
+    void setOrientation(Orientation const& orientation);
+
+    /**
+     * Color-manages the image last passed to setImage, or stops if null.
+     * The legacy pipeline shows colors as stored.
+     */
+    void setColorLut(std::shared_ptr<ColorLut const> lut);
+
+    /**
+     * Filtering for the frames drawn from now on. The legacy pipeline only
+     * has the fast one.
+     */
+    void setQuality(Quality quality);
+
+    /**
+     * Exposure, channels and the like, applied by the shaders as they draw,
+     * so changing them uploads nothing. The legacy pipeline ignores them.
+     */
+    void setDisplayAdjustments(DisplayAdjustments const& adjustments);
+
     void resize(int w, int h);
 
     void draw();
@@ -70,30 +329,100 @@ namespace dumageview::imagerenderer::detail {
     ImageRenderer(ImageRenderer const&) = delete;
     ImageRenderer& operator=(ImageRenderer const&) = delete;
 
-    glm::dvec2 getImageSize() const;
     glm::dvec2 getScreenSize() const;
 
-    SizeInfo getSizeInfo() const;
     ViewMod<View> getViewMod() const;
 
+    QRectF getVisibleImageRect() const;
+
+    std::unique_ptr<ImageState> takeResident(QString const& key,
+                                             QSize const& size);
+    void makeResident(std::unique_ptr<ImageState> state);
+    void evictResident();
+    void logResidency() const;
+
+    void startMipmaps(ImageState& state);
+    void advanceMipmaps(ImageState& state);
+
+    std::shared_ptr<FrameAtlas> getAtlas(FrameRef const& frame,
+                                         QImage const& image,
+                                         PixelLayout const& layout);
+    void insertFrame(FrameAtlas& atlas, int index, QImage const& image);
+    Quad makeAtlasQuad(ImageState const& state, bool minified);
+    bool updateFrame(ImageState& next, QRegion const& damage);
+    void updateMipmaps(ImageState& state, QRegion const& damage);
+    void redoMipRects(Surface const& surface,
+                      std::vector<QImage>& levels,
+                      QRegion const& damage,
+                      std::size_t numUploaded);
+
+    void advanceUpload();
+    std::unique_ptr<QOpenGLTexture> makeTexture(QSize const& size,
+                                                PixelLayout const& layout);
+    std::unique_ptr<QOpenGLTexture> makePalette(QImage const& image);
+
+    QOpenGLTexture* getLutTexture(std::shared_ptr<ColorLut const> const& lut);
+
+    void uploadRows(Surface const& surface, int firstRow, int numRows);
+    void uploadRect(QOpenGLTexture& texture,
+                    int level,
+                    QImage const& pixels,
+                    PixelLayout const& layout,
+                    QRect const& rect,
+                    QPoint const& to);
+
+    void drawLegacy(std::vector<Quad> const& quads);
+
     //
     // Private data
     //
 
-    ImageWidget& widget_;
+    Host& host_;
+
+    // for building mipmaps; outlives the states whose builds use it
+    WorkerPool mipPool_;
 
     QMetaObject::Connection contextDestroyConnection_;
 
     QOpenGLFunctions_2_1* gl_ = nullptr;
 
+    int maxTextureSize_ = 0;
+    MipmapSource mipmapSource_;
+
+    QOpenGLBuffer uploadBuffer_{QOpenGLBuffer::PixelUnpackBuffer};
+    bool uploadBufferMappable_ = true;
+
+    std::unique_ptr<QuadBatch> quadBatch_;  // null on the legacy pipeline
+    Quality quality_ = Quality::fast;
+    DisplayAdjustments displayAdjustments_;
+
+    // the LUT last drawn with, which images that share a profile share
+    std::shared_ptr<ColorLut const> lutSource_;
+    std::unique_ptr<QOpenGLTexture> lutTexture_;
+
     std::unique_ptr<ImageState> imageState_;
+    std::unique_ptr<PendingUpload> pendingUpload_;
+
+    // of the animation shown last; counts against the residency budget
+    std::shared_ptr<FrameAtlas> frameAtlas_;
+
+    // images shown before, most recent first
+    std::list<std::unique_ptr<ImageState>> resident_;
+    std::size_t residencyBudget_;
+    std::size_t residentBytes_ = 0;  // excludes imageState_
   };
 }
 
 namespace dumageview {
   namespace imagerenderer {
     using detail::Error;
+    using detail::FrameRef;
+    using detail::Host;
     using detail::ImageRenderer;
+    using detail::isAvailable;
+    using detail::MipmapSource;
+    using detail::Options;
+    using detail::Pipeline;
   }
 
   using imagerenderer::ImageRenderer;
@@ -10,29 +10,117 @@
 #include <glm/glm.hpp>
 
 #include <QContextMenuEvent>
+#include <QCoreApplication>
 #include <QDesktopWidget>
 #include <QEvent>
+#include <QGuiApplication>
 #include <QKeyEvent>
 #include <QMouseEvent>
 #include <QOpenGLContext>
+#include <QOpenGLWidget>
 #include <QPaintEvent>
+#include <QPainter>
+#include <QPointer>
 #include <QResizeEvent>
+#include <QScreen>
 #include <QSizePolicy>
 #include <QWheelEvent>
+#include <QWindow>
+
+#include <algorithm>
+#include <cmath>
 
 namespace dumageview {
   namespace {
     constexpr int wheelStepSize = 120;
+
+    // a frame not swapped by then is assumed lost (e.g. window hidden)
+    constexpr qint64 frameTimeoutMs = 100;
+
+    // swaps further apart than this many refreshes count as dropped frames
+    constexpr double dropThreshold = 1.5;
+
+    // how long the view must be still before a high-quality frame
+    constexpr int idleQualityDelayMs = 200;
+
+    // display adjustment steps, and how far they go
+    constexpr double exposureStep = 0.5;  // stops
+    constexpr double maxExposure = 10.0;
+    constexpr double brightnessStep = 0.05;
+    constexpr double maxBrightness = 1.0;
+    constexpr double contrastStep = 1.1;  // a factor, as is gamma's
+    constexpr double maxContrast = 16.0;
+    constexpr double gammaStep = 1.1;
+    constexpr double maxGamma = 10.0;
+
+    double stepFactor(double value, double factor, int steps, double max) {
+      return std::clamp(value * std::pow(factor, steps), 1.0 / max, max);
+    }
   }
 
+  /**
+   * Hands its GL events to the ImageWidget it fills.
+   */
+  class ImageWidget::Surface : public QOpenGLWidget {
+   public:
+    explicit Surface(ImageWidget& owner)
+        : QOpenGLWidget(&owner), owner_(owner) {
+      setUpdateBehavior(NoPartialUpdate);
+
+      // input goes to the owner, as if there were no child
+      setAttribute(Qt::WA_TransparentForMouseEvents);
+    }
+
+   protected:
+    void initializeGL() override {
+      owner_.initializeGL();
+    }
+
+    void resizeGL(int w, int h) override {
+      owner_.resizeGL(w, h);
+    }
+
+    void paintGL() override {
+      owner_.paintGL();
+    }
+
+   private:
+    ImageWidget& owner_;
+  };
+
   ImageWidget::ImageWidget(ActionSet& actions, QWidget* parent)
       : Base(parent), actions_(actions) {
-    setUpdateBehavior(NoPartialUpdate);
     setSizePolicy(QSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding));
+
+    idleTimer_.setSingleShot(true);
+    idleTimer_.setInterval(idleQualityDelayMs);
+    qtutil::connect(&idleTimer_, &QTimer::timeout, this, &ImageWidget::onIdle);
+
+    if (!imagerenderer::isAvailable()) {
+      log::warn("OpenGL 2.1 is not available; rendering in software");
+      useSoftwareRenderer();
+      return;
+    }
+
+    surface_ = new Surface{*this};
+    surface_->setGeometry(rect());
+
+    qtutil::connect(surface_,
+                    &QOpenGLWidget::frameSwapped,
+                    this,
+                    &ImageWidget::onFrameSwapped);
   }
 
   ImageWidget::~ImageWidget() {
     DUMAGEVIEW_LOG_TRACE("this={}", this);
+    DUMAGEVIEW_LOG_DEBUG(
+      "Frames: {} painted, {} input events (max {} per frame), "
+      "{} dropped, {} duplicate",
+      frameStats_.frames,
+      frameStats_.inputEvents,
+      frameStats_.maxEventsPerFrame,
+      frameStats_.droppedFrames,
+      frameStats_.duplicateFrames);
   }
 
   //
@@ -46,8 +134,13 @@ namespace dumageview {
       return partialScreen;
     }
 
+    QSize imageSize = image_->size();
+    if (getOrientation().quarterTurns % 2 != 0) {
+      imageSize.transpose();
+    }
+
     auto longDim =
-      (math::aspectRatio(image_->size()) > math::aspectRatio(partialScreen))
+      (math::aspectRatio(imageSize) > math::aspectRatio(partialScreen))
         ? math::getX
         : math::getY;
 
@@ -55,8 +148,8 @@ namespace dumageview {
       return longDim(conv::dvec(v));
     };
 
-    double scale = longConv(partialScreen) / longConv(image_->size());
-    return image_->size() * scale;
+    double scale = longConv(partialScreen) / longConv(imageSize);
+    return imageSize * scale;
   }
 
   QSize ImageWidget::minimumSizeHint() const {
@@ -68,31 +161,178 @@ namespace dumageview {
   // Image slots
   //
 
-  void ImageWidget::resetImage(QImage const& image) {
+  void ImageWidget::resetImage(QImage const& image,
+                               QString const& key,
+                               std::shared_ptr<TileSource const> tileSource,
+                               std::shared_ptr<YCbCrPlanes const> planes,
+                               imagerenderer::FrameRef const& frame,
+                               Orientation const& orientation,
+                               std::shared_ptr<ColorLut const> colorLut) {
     if (image.isNull()) {
       imageLoadFailed("Cannot load null image");
       return;
     }
 
     image_ = image;
-    activateZoomToFit();
-
-    if (renderer_) {
-      renderer_->setImage(image);
+    imageKey_ = key;
+    tileSource_ = tileSource;
+    planes_ = planes;
+    frame_ = frame;
+    orientation_ = orientation;
+    colorLut_ = colorLut;
+
+    // input meant for the last image
+    pendingMove_ = {};
+    pendingZoomSteps_ = 0;
+    viewChanged();
+
+    bool reused = false;
+    withRenderer([&](auto& renderer) {
+      reused = renderer.setImage(image, key, tileSource, planes, frame)
+               && !renderer.isZoomToFit();
+      renderer.setOrientation(getOrientation());
+      renderer.setColorLut(colorLut_);
+    });
+
+    if (reused) {
+      deactivateZoomToFit();
+    } else {
+      activateZoomToFit();
     }
     updateGeometry();
-    update();
+    requestFrame();
   }
 
   void ImageWidget::removeImage() {
     image_.reset();
+    imageKey_.clear();
+    tileSource_.reset();
+    planes_.reset();
+    frame_ = {};
+    orientation_ = {};
+    colorLut_.reset();
     deactivateZoomToFit();
 
+    withRenderer([](auto& renderer) { renderer.removeImage(); });
+    updateGeometry();
+    requestFrame();
+  }
+
+  void ImageWidget::setRendererOptions(imagerenderer::Options const& options) {
+    DUMAGEVIEW_ASSERT(!renderer_);
+    rendererOptions_ = options;
+
+    if (options.pipeline == imagerenderer::Pipeline::software
+        && !softwareRenderer_) {
+      useSoftwareRenderer();
+    } else if (options.renderThread && surface_) {
+      if (QOpenGLContext::supportsThreadedOpenGL()) {
+        useRenderThread();
+      } else {
+        log::warn("No threaded OpenGL here; drawing on the GUI thread");
+      }
+    }
+  }
+
+  //
+  // Renderer selection
+  //
+
+  void ImageWidget::useSoftwareRenderer() {
+    DUMAGEVIEW_ASSERT(!renderer_);
+
+    if (surface_) {
+      // may be inside one of its own handlers
+      surface_->hide();
+      surface_->deleteLater();
+      surface_ = nullptr;
+    }
+    threadedRenderer_.reset();
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    frameInFlight_ = false;
+
+    softwareRenderer_ = std::make_unique<SoftwareRenderer>();
+    softwareRenderer_->setQuality(quality_);
+    softwareRenderer_->setDisplayAdjustments(display_);
+    softwareRenderer_->resize(width(), height());
+    if (image_) {
+      softwareRenderer_->setImage(
+        *image_, imageKey_, tileSource_, planes_, frame_);
+      softwareRenderer_->setOrientation(getOrientation());
+      softwareRenderer_->setColorLut(colorLut_);
+    }
+    requestFrame();
+  }
+
+  void ImageWidget::useRenderThread() {
+    DUMAGEVIEW_ASSERT(surface_ && !renderer_);
+
+    // not shown yet, so there is no GL state to clean up
+    delete surface_;
+    surface_ = nullptr;
+
+    threadedRenderer_ = std::make_unique<ThreadedRenderer>(
+      *this, rendererOptions_, [this] {
+        QMetaObject::invokeMethod(
+          this, [this] { useSoftwareRenderer(); }, Qt::QueuedConnection);
+      });
+    threadedRenderer_->setQuality(quality_);
+    threadedRenderer_->setDisplayAdjustments(display_);
+    threadedRenderer_->resize(width(), height());
+    if (image_) {
+      threadedRenderer_->setImage(
+        *image_, imageKey_, tileSource_, planes_, frame_);
+      threadedRenderer_->setOrientation(getOrientation());
+      threadedRenderer_->setColorLut(colorLut_);
+    }
+  }
+
+  bool ImageWidget::hasRenderer() const {
+    return renderer_ || threadedRenderer_ || softwareRenderer_;
+  }
+
+  template<class F>
+  void ImageWidget::withRenderer(F&& func) {
     if (renderer_) {
-      renderer_->removeImage();
+      func(*renderer_);
+    } else if (threadedRenderer_) {
+      func(*threadedRenderer_);
+    } else if (softwareRenderer_) {
+      func(*softwareRenderer_);
     }
-    updateGeometry();
-    update();
+  }
+
+  //
+  // Renderer host
+  //
+
+  void ImageWidget::makeCurrent() {
+    DUMAGEVIEW_ASSERT(surface_);
+    surface_->makeCurrent();
+  }
+
+  void ImageWidget::doneCurrent() {
+    DUMAGEVIEW_ASSERT(surface_);
+    surface_->doneCurrent();
+  }
+
+  QSize ImageWidget::getSize() const {
+    return size();
+  }
+
+  std::function<void()> ImageWidget::makeWake() {
+    // may be called from other threads, and after the widget is gone; the
+    // call is queued on the application, and the widget checked there
+    return [widget = QPointer<ImageWidget>{this}] {
+      QMetaObject::invokeMethod(
+        QCoreApplication::instance(),
+        [widget] {
+          if (widget) {
+            widget->requestFrame();
+          }
+        },
+        Qt::QueuedConnection);
+    };
   }
 
   //
@@ -108,33 +348,44 @@ namespace dumageview {
   }
 
   void ImageWidget::zoom(int steps, QPointF const& center) {
-    if (!renderer_) {
+    if (!hasRenderer()) {
       return;
     }
     deactivateZoomToFit();
-    renderer_->zoomRel(steps, center);
+    viewChanged();
+
+    // applied with the next frame
+    pendingZoomSteps_ += steps;
+    pendingZoomCenter_ = center;
+    ++pendingEvents_;
 
-    update();
+    requestFrame();
   }
 
   void ImageWidget::zoomOriginal() {
-    if (!renderer_) {
+    if (!hasRenderer()) {
       return;
     }
     deactivateZoomToFit();
-    renderer_->zoomAbs(1.0, conv::qpointf(size()) * 0.5);
+    viewChanged();
+    applyPendingInput();
+    withRenderer([&](auto& renderer) {
+      renderer.zoomAbs(1.0, conv::qpointf(size()) * 0.5);
+    });
 
-    update();
+    requestFrame();
   }
 
   void ImageWidget::zoomToFit() {
-    if (!renderer_) {
+    if (!hasRenderer()) {
       return;
     }
     activateZoomToFit();
-    renderer_->zoomToFit();
+    viewChanged();
+    applyPendingInput();
+    withRenderer([](auto& renderer) { renderer.zoomToFit(); });
 
-    update();
+    requestFrame();
   }
 
   void ImageWidget::activateZoomToFit() {
@@ -150,6 +401,247 @@ namespace dumageview {
     return !actions_.zoomToFit.isEnabled();
   }
 
+  //
+  // Orientation
+  //
+
+  void ImageWidget::rotateClockwise() {
+    setAdjustment(adjustment_.rotated(1));
+  }
+
+  void ImageWidget::rotateCounterclockwise() {
+    setAdjustment(adjustment_.rotated(-1));
+  }
+
+  void ImageWidget::flipHorizontally() {
+    setAdjustment(adjustment_.flippedHorizontally());
+  }
+
+  void ImageWidget::flipVertically() {
+    setAdjustment(adjustment_.flippedVertically());
+  }
+
+  void ImageWidget::resetOrientation() {
+    setAdjustment({});
+  }
+
+  Orientation ImageWidget::getOrientation() const {
+    return adjustment_.after(orientation_);
+  }
+
+  void ImageWidget::setAdjustment(Orientation const& adjustment) {
+    if (adjustment == adjustment_) {
+      return;
+    }
+    adjustment_ = adjustment;
+
+    if (!hasRenderer()) {
+      return;
+    }
+    viewChanged();
+
+    // pending input was aimed at the old orientation
+    applyPendingInput();
+    withRenderer(
+      [&](auto& renderer) { renderer.setOrientation(getOrientation()); });
+
+    updateGeometry();
+    requestFrame();
+  }
+
+  //
+  // Display adjustments
+  //
+
+  void ImageWidget::stepExposure(int steps) {
+    auto adjustments = display_;
+    adjustments.exposure = std::clamp(
+      adjustments.exposure + steps * exposureStep, -maxExposure, maxExposure);
+    setDisplayAdjustments(adjustments);
+  }
+
+  void ImageWidget::stepBrightness(int steps) {
+    auto adjustments = display_;
+    adjustments.brightness = std::clamp(
+      adjustments.brightness + steps * brightnessStep,
+      -maxBrightness,
+      maxBrightness);
+    setDisplayAdjustments(adjustments);
+  }
+
+  void ImageWidget::stepContrast(int steps) {
+    auto adjustments = display_;
+    adjustments.contrast =
+      stepFactor(adjustments.contrast, contrastStep, steps, maxContrast);
+    setDisplayAdjustments(adjustments);
+  }
+
+  void ImageWidget::stepGamma(int steps) {
+    auto adjustments = display_;
+    adjustments.gamma =
+      stepFactor(adjustments.gamma, gammaStep, steps, maxGamma);
+    setDisplayAdjustments(adjustments);
+  }
+
+  void ImageWidget::showChannel(Channel channel) {
+    auto adjustments = display_;
+    adjustments.channel = channel;
+    setDisplayAdjustments(adjustments);
+  }
+
+  void ImageWidget::showCheckerboard(bool show) {
+    auto adjustments = display_;
+    adjustments.checkerboard = show;
+    setDisplayAdjustments(adjustments);
+  }
+
+  void ImageWidget::resetDisplayAdjustments() {
+    setDisplayAdjustments({});
+  }
+
+  void ImageWidget::setDisplayAdjustments(
+    DisplayAdjustments const& adjustments) {
+    // the checkable actions follow resets too
+    auto& channelAction = [&]() -> QAction& {
+      switch (adjustments.channel) {
+        case Channel::red:
+          return actions_.showRed;
+        case Channel::green:
+          return actions_.showGreen;
+        case Channel::blue:
+          return actions_.showBlue;
+        case Channel::alpha:
+          return actions_.showAlpha;
+        case Channel::luma:
+          return actions_.showLuma;
+        default:
+          return actions_.showAllChannels;
+      }
+    }();
+    channelAction.setChecked(true);
+    actions_.showCheckerboard.setChecked(adjustments.checkerboard);
+
+    if (adjustments == display_) {
+      return;
+    }
+    display_ = adjustments;
+
+    DUMAGEVIEW_LOG_DEBUG(
+      "Exposure {:+.1f}, brightness {:+.2f}, contrast {:.2f}, gamma {:.2f}",
+      display_.exposure,
+      display_.brightness,
+      display_.contrast,
+      display_.gamma);
+
+    // the next frame is drawn with them; nothing is uploaded again
+    withRenderer(
+      [&](auto& renderer) { renderer.setDisplayAdjustments(display_); });
+    requestFrame();
+  }
+
+  //
+  // Frame quality
+  //
+
+  void ImageWidget::viewChanged() {
+    if (quality_ != Quality::fast) {
+      quality_ = Quality::fast;
+      withRenderer([](auto& renderer) { renderer.setQuality(Quality::fast); });
+    }
+    idleTimer_.start();
+  }
+
+  void ImageWidget::onIdle() {
+    if (!image_) {
+      return;
+    }
+    quality_ = Quality::high;
+    withRenderer([](auto& renderer) { renderer.setQuality(Quality::high); });
+    requestFrame();
+  }
+
+  //
+  // Frame scheduling
+  //
+
+  void ImageWidget::requestFrame() {
+    if (threadedRenderer_) {
+      // the render thread picks up the view whenever it draws next
+      applyPendingInput();
+      threadedRenderer_->requestFrame();
+      return;
+    }
+
+    frameRequested_ = true;
+
+    // one frame at a time, so input keeps merging while the GPU is busy
+    bool stalled = paintTimer_.isValid()
+                   && paintTimer_.elapsed() > frameTimeoutMs;
+    if (!frameInFlight_ || stalled) {
+      updateSurface();
+    }
+  }
+
+  void ImageWidget::updateSurface() {
+    if (surface_) {
+      surface_->update();
+    } else {
+      update();
+    }
+  }
+
+  void ImageWidget::beginFrame() {
+    ++frameStats_.frames;
+    if (!frameRequested_) {
+      ++frameStats_.duplicateFrames;
+    }
+    frameRequested_ = false;
+
+    applyPendingInput();
+  }
+
+  void ImageWidget::applyPendingInput() {
+    DUMAGEVIEW_ASSERT(hasRenderer());
+
+    withRenderer([&](auto& renderer) {
+      if (!pendingMove_.isNull()) {
+        renderer.move(pendingMove_);
+      }
+      if (pendingZoomSteps_ != 0) {
+        renderer.zoomRel(pendingZoomSteps_, pendingZoomCenter_);
+      }
+    });
+    pendingMove_ = {};
+    pendingZoomSteps_ = 0;
+
+    frameStats_.inputEvents += pendingEvents_;
+    frameStats_.maxEventsPerFrame =
+      std::max(frameStats_.maxEventsPerFrame, pendingEvents_);
+    pendingEvents_ = 0;
+  }
+
+  void ImageWidget::onFrameSwapped() {
+    frameInFlight_ = false;
+
+    auto* handle = window()->windowHandle();
+    auto* screen = handle ? handle->screen() : QGuiApplication::primaryScreen();
+    double refreshMs = 1000.0 / (screen ? screen->refreshRate() : 60.0);
+
+    if (animating_ && swapTimer_.isValid()) {
+      double intervalMs = swapTimer_.nsecsElapsed() / 1e6;
+      if (intervalMs > dropThreshold * refreshMs) {
+        frameStats_.droppedFrames +=
+          static_cast<std::uint64_t>(std::lround(intervalMs / refreshMs)) - 1;
+      }
+    }
+    swapTimer_.start();
+
+    animating_ = frameRequested_;
+    if (frameRequested_) {
+      updateSurface();
+    }
+  }
+
   //
   // GL handlers
   //
@@ -158,31 +650,51 @@ namespace dumageview {
     DUMAGEVIEW_ASSERT(!renderer_);
 
     try {
-      auto connection = qtutil::connect(context(),
+      auto connection = qtutil::connect(surface_->context(),
                                         &QOpenGLContext::aboutToBeDestroyed,
                                         this,
                                         &ImageWidget::cleanupGL);
 
-      renderer_ = std::make_unique<ImageRenderer>(*this, std::move(connection));
+      renderer_ = std::make_unique<ImageRenderer>(
+        *this, std::move(connection), rendererOptions_);
+      renderer_->setQuality(quality_);
+      renderer_->setDisplayAdjustments(display_);
       if (image_) {
-        renderer_->setImage(*image_);
+        renderer_->setImage(*image_, imageKey_, tileSource_, planes_, frame_);
+        renderer_->setOrientation(getOrientation());
+        renderer_->setColorLut(colorLut_);
       }
     } catch (imagerenderer::Error const& error) {
-      log::error("Could not initialize graphics: {}", error.what());
-      Application::getSingletonInstance().exit(application::exitcode::glInitError);
+      log::warn("Could not initialize graphics; rendering in software: {}",
+                error.what());
+
+      // the renderer never got to disconnect
+      QObject::disconnect(surface_->context(), nullptr, this, nullptr);
+      useSoftwareRenderer();
     }
   }
 
   void ImageWidget::resizeGL(int w, int h) {
     DUMAGEVIEW_ASSERT(w == width());
     DUMAGEVIEW_ASSERT(h == height());
-    DUMAGEVIEW_ASSERT(renderer_);
+    if (!renderer_) {
+      // switched to software; the surface is on its way out
+      return;
+    }
 
     renderer_->resize(w, h);
+    frameRequested_ = true;
   }
 
   void ImageWidget::paintGL() {
-    DUMAGEVIEW_ASSERT(renderer_);
+    if (!renderer_) {
+      return;
+    }
+
+    frameInFlight_ = true;
+    paintTimer_.start();
+
+    beginFrame();
     renderer_->draw();
   }
 
@@ -196,6 +708,33 @@ namespace dumageview {
   // Event handlers
   //
 
+  void ImageWidget::paintEvent(QPaintEvent* evt) {
+    if (!softwareRenderer_) {
+      // the GL surface covers everything
+      Base::paintEvent(evt);
+      return;
+    }
+
+    beginFrame();
+    QPainter painter(this);
+    softwareRenderer_->draw(painter);
+  }
+
+  void ImageWidget::resizeEvent(QResizeEvent* evt) {
+    viewChanged();
+    if (surface_) {
+      surface_->setGeometry(rect());
+    }
+    if (threadedRenderer_) {
+      threadedRenderer_->resize(width(), height());
+    }
+    if (softwareRenderer_) {
+      softwareRenderer_->resize(width(), height());
+      frameRequested_ = true;
+    }
+    Base::resizeEvent(evt);
+  }
+
   void ImageWidget::mouseDoubleClickEvent(QMouseEvent* evt) {
     DUMAGEVIEW_ASSERT(evt);
 
@@ -259,9 +798,12 @@ namespace dumageview {
     DUMAGEVIEW_ASSERT(evt);
 
     if (evt->buttons() & Qt::LeftButton) {
-      if (renderer_ && lastMousePos_) {
-        renderer_->move(evt->pos() - *lastMousePos_);
-        update();
+      if (hasRenderer() && lastMousePos_) {
+        // applied with the next frame
+        viewChanged();
+        pendingMove_ += evt->pos() - *lastMousePos_;
+        ++pendingEvents_;
+        requestFrame();
       }
       lastMousePos_ = evt->pos();
     } else {
@@ -271,8 +813,14 @@ namespace dumageview {
 
   void ImageWidget::wheelEvent(QWheelEvent* evt) {
     DUMAGEVIEW_ASSERT(evt);
-    int steps = evt->angleDelta().y() / wheelStepSize;
-    zoom(steps, evt->posF());
+    // touchpads send fractions of a step; keep the rest for later events
+    int delta = wheelRemainder_ + evt->angleDelta().y();
+    int steps = delta / wheelStepSize;
+    wheelRemainder_ = delta % wheelStepSize;
+
+    if (steps != 0) {
+      zoom(steps, evt->posF());
+    }
   }
 
   void ImageWidget::keyPressEvent(QKeyEvent* evt) {
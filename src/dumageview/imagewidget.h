@@ -3,20 +3,41 @@
 
 #include "dumageview/actionset.h"
 #include "dumageview/imagerenderer.h"
+#include "dumageview/softwarerenderer.h"
+#include "dumageview/threadedrenderer.h"
 
 #include <glm/fwd.hpp>
 
+#include <QElapsedTimer>
 #include <QImage>
-#include <QOpenGLWidget>
 #include <QPoint>
 #include <QPointF>
+#include <QTimer>
 #include <QWidget>
 
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <optional>
 
 namespace dumageview {
-  class ImageWidget : public QOpenGLWidget {
+  /**
+   * Counters for frame pacing, since the widget was created.
+   */
+  struct FrameStats {
+    std::uint64_t frames = 0;
+    std::uint64_t inputEvents = 0;  // coalesced into those frames
+    std::uint64_t maxEventsPerFrame = 0;
+    std::uint64_t droppedFrames = 0;  // refreshes missed while animating
+    std::uint64_t duplicateFrames = 0;  // painted with nothing new to show
+  };
+
+  /**
+   * Shows the current image, drawn by ImageRenderer on an OpenGL surface
+   * filling the widget, by ThreadedRenderer if asked to, or by
+   * SoftwareRenderer when OpenGL is unavailable.
+   */
+  class ImageWidget : public QWidget, public imagerenderer::Host {
     Q_OBJECT;
 
    public:
@@ -24,10 +45,41 @@ namespace dumageview {
 
     virtual ~ImageWidget();
 
-    void resetImage(QImage const& image);
+    /**
+     * Shows an image. Images with the same non-empty key may reuse
+     * textures and view state from when they were last shown.
+     * See ImageRenderer::setImage for tileSource, planes and frame.
+     *
+     * The image is drawn turned by its own orientation, then by whatever
+     * rotating and flipping have been done since resetOrientation().
+     * Its colors are converted to the display's by colorLut, if set.
+     */
+    void resetImage(QImage const& image,
+                    QString const& key = {},
+                    std::shared_ptr<TileSource const> tileSource = nullptr,
+                    std::shared_ptr<YCbCrPlanes const> planes = nullptr,
+                    imagerenderer::FrameRef const& frame = {},
+                    Orientation const& orientation = {},
+                    std::shared_ptr<ColorLut const> colorLut = nullptr);
 
     void removeImage();
 
+    /**
+     * Configures the renderer. Takes effect when GL is initialized, or
+     * right away for the software pipeline.
+     */
+    void setRendererOptions(imagerenderer::Options const& options);
+
+    /**
+     * Asks for a repaint on the next display refresh.
+     * Requests made before then are merged into one frame.
+     */
+    void requestFrame() override;
+
+    FrameStats const& getFrameStats() const {
+      return frameStats_;
+    }
+
     void zoomToFit();
 
     void zoomOriginal();
@@ -36,6 +88,34 @@ namespace dumageview {
 
     void zoomOut();
 
+    void rotateClockwise();
+
+    void rotateCounterclockwise();
+
+    void flipHorizontally();
+
+    void flipVertically();
+
+    /**
+     * Undoes rotating and flipping, back to the image's own orientation.
+     */
+    void resetOrientation();
+
+    /**
+     * Display adjustments, a step up or down from where they are. They stay
+     * from one image to the next.
+     */
+    void stepExposure(int steps);
+    void stepBrightness(int steps);
+    void stepContrast(int steps);
+    void stepGamma(int steps);
+
+    void showChannel(Channel channel);
+
+    void showCheckerboard(bool show);
+
+    void resetDisplayAdjustments();
+
     QSize sizeHint() const override;
 
     QSize minimumSizeHint() const override;
@@ -47,21 +127,25 @@ namespace dumageview {
 
    protected:
     //
-    // GL handlers
+    // Renderer host, for the GL surface
     //
 
-    void initializeGL() override;
+    void makeCurrent() override;
 
-    void resizeGL(int width, int height) override;
+    void doneCurrent() override;
 
-    void paintGL() override;
+    QSize getSize() const override;
 
-    void cleanupGL();
+    std::function<void()> makeWake() override;
 
     //
     // Event handlers
     //
 
+    void paintEvent(QPaintEvent* evt) override;
+
+    void resizeEvent(QResizeEvent* evt) override;
+
     void mouseDoubleClickEvent(QMouseEvent* evt) override;
 
     void mousePressEvent(QMouseEvent* evt) override;
@@ -77,10 +161,58 @@ namespace dumageview {
     void contextMenuEvent(QContextMenuEvent* evt) override;
 
    private:
-    using Base = QOpenGLWidget;
+    using Base = QWidget;
+
+    class Surface;
+
+    //
+    // GL handlers, forwarded by Surface
+    //
+
+    void initializeGL();
+
+    void resizeGL(int width, int height);
+
+    void paintGL();
+
+    void cleanupGL();
+
+    /**
+     * Drops the GL surface, if any, and draws in software from then on.
+     */
+    void useSoftwareRenderer();
+
+    /**
+     * Replaces the GL surface with a ThreadedRenderer.
+     */
+    void useRenderThread();
+
+    bool hasRenderer() const;
+
+    /**
+     * Calls func with whichever renderer is in use, if any.
+     */
+    template<class F>
+    void withRenderer(F&& func);
 
     void zoom(int steps, QPointF const& center);
 
+    /**
+     * Drops to fast frames until the view has been still for a while.
+     */
+    void viewChanged();
+    void onIdle();
+
+    Orientation getOrientation() const;
+    void setAdjustment(Orientation const& adjustment);
+
+    void setDisplayAdjustments(DisplayAdjustments const& adjustments);
+
+    void updateSurface();
+    void beginFrame();
+    void applyPendingInput();
+    void onFrameSwapped();
+
     bool zoomToFitActive() const;
     void activateZoomToFit();
     void deactivateZoomToFit();
@@ -91,9 +223,46 @@ namespace dumageview {
 
     ActionSet& actions_;
     std::optional<QImage> image_;
+    QString imageKey_;
+    std::shared_ptr<TileSource const> tileSource_;
+    std::shared_ptr<YCbCrPlanes const> planes_;
+    imagerenderer::FrameRef frame_;
+    Orientation orientation_;  // the image's own
+    std::shared_ptr<ColorLut const> colorLut_;
+    Orientation adjustment_;  // rotating and flipping on top of that
+    DisplayAdjustments display_;
+
+    Surface* surface_ = nullptr;  // a child; null when rendering in software
     std::unique_ptr<ImageRenderer> renderer_;
+    std::unique_ptr<ThreadedRenderer> threadedRenderer_;
+    std::unique_ptr<SoftwareRenderer> softwareRenderer_;
+    imagerenderer::Options rendererOptions_;
+    Quality quality_ = Quality::fast;
+    QTimer idleTimer_;
 
     std::optional<QPoint> lastMousePos_;
+
+    //
+    // Input waiting for the next frame
+    //
+
+    QPoint pendingMove_;
+    int pendingZoomSteps_ = 0;
+    QPointF pendingZoomCenter_;
+    int wheelRemainder_ = 0;  // partial steps from high-resolution wheels
+    std::uint64_t pendingEvents_ = 0;
+
+    //
+    // Frame pacing
+    //
+
+    bool frameRequested_ = false;
+    bool frameInFlight_ = false;
+    bool animating_ = false;  // another frame was wanted at the last swap
+
+    QElapsedTimer paintTimer_;
+    QElapsedTimer swapTimer_;
+    FrameStats frameStats_;
   };
 }
 
@@ -0,0 +1,427 @@
+#include "dumageview/ioengine.h"
+
+#include "dumageview/assert.h"
+#include "dumageview/log.h"
+#include "dumageview/scopeguard.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <iterator>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(DUMAGEVIEW_HAVE_LIBURING)
+#include <liburing.h>
+#endif
+
+namespace dumageview::ioengine {
+  namespace {
+    using Millis = std::chrono::duration<double, std::milli>;
+
+    double percentile(std::vector<double> values, double p) {
+      if (values.empty()) {
+        return 0.0;
+      }
+      auto nth = values.begin() + static_cast<long>(p * (values.size() - 1));
+      std::nth_element(values.begin(), nth, values.end());
+      return *nth;
+    }
+
+    /**
+     * Allocates a buffer for the whole file. Returns errno on failure.
+     */
+    int allocateFor(int fd, QByteArray& data) {
+      struct stat st {};
+      if (::fstat(fd, &st) != 0) {
+        return errno;
+      }
+      if (st.st_size > INT_MAX) {
+        return EFBIG;
+      }
+      data = QByteArray(static_cast<int>(st.st_size), Qt::Uninitialized);
+      return 0;
+    }
+
+    int readWhole(Path const& path, QByteArray& data) {
+      int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0) {
+        return errno;
+      }
+      auto closer = ScopeGuard{[fd] { ::close(fd); }};
+
+      if (int error = allocateFor(fd, data)) {
+        return error;
+      }
+
+      int done = 0;
+      while (done < data.size()) {
+        ssize_t n = ::pread(fd, data.data() + done, data.size() - done, done);
+        if (n < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          return errno;
+        }
+        if (n == 0) {
+          // file shrank after fstat
+          data.truncate(done);
+          break;
+        }
+        done += static_cast<int>(n);
+      }
+      return 0;
+    }
+
+    Result readBlocking(Path const& path) {
+      Result result;
+      result.path = path;
+      auto start = Clock::now();
+      result.error = readWhole(path, result.data);
+      result.latency = Clock::now() - start;
+      return result;
+    }
+
+    bool probeIoUring() {
+#if defined(DUMAGEVIEW_HAVE_LIBURING)
+      io_uring_probe* probe = io_uring_get_probe();
+      if (!probe) {
+        return false;
+      }
+      auto guard = ScopeGuard{[probe] { io_uring_free_probe(probe); }};
+
+      return io_uring_opcode_supported(probe, IORING_OP_OPENAT)
+             && io_uring_opcode_supported(probe, IORING_OP_READ)
+             && io_uring_opcode_supported(probe, IORING_OP_CLOSE);
+#else
+      return false;
+#endif
+    }
+
+    char const* backendName(Backend backend) {
+      switch (backend) {
+        case Backend::ioUring:
+          return "io_uring";
+        case Backend::threadPool:
+          return "thread pool";
+      }
+      return "unknown";
+    }
+  }
+
+  struct IoEngine::Batch {
+    std::vector<Path> paths;
+    Callback callback;
+    Backend backend;
+    Clock::time_point start{Clock::now()};
+
+    std::mutex mutex;
+    diskorder::InOrderDelivery<Result> delivery;
+    std::atomic<std::size_t> numDelivered{0};  // readable without mutex
+    std::vector<double> latencies;  // ms
+    std::size_t bytes = 0;
+  };
+
+  IoEngine::IoEngine(Options const& options)
+      : options_(options),
+        backend_(options.allowIoUring && probeIoUring() ? Backend::ioUring
+                                                        : Backend::threadPool) {
+    DUMAGEVIEW_LOG_DEBUG("I/O engine using {}", backendName(backend_));
+
+    if (backend_ == Backend::threadPool) {
+      unsigned numThreads = std::max(options_.numThreads, 1u);
+      for (unsigned i = 0; i < numThreads; ++i) {
+        workers_.emplace_back([this] { poolLoop(); });
+      }
+    }
+    dispatcher_ = std::thread([this] { dispatchLoop(); });
+  }
+
+  IoEngine::~IoEngine() {
+    {
+      std::lock_guard lock{mutex_};
+      stopping_ = true;
+    }
+    batchReady_.notify_all();
+    jobReady_.notify_all();
+    delivered_.notify_all();
+
+    dispatcher_.join();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  void IoEngine::read(std::vector<Path> paths, Callback callback) {
+    if (paths.empty()) {
+      return;
+    }
+    auto batch = std::make_shared<Batch>();
+    batch->paths = std::move(paths);
+    batch->callback = std::move(callback);
+    batch->backend = backend_;
+
+    {
+      std::lock_guard lock{mutex_};
+      batches_.push_back(std::move(batch));
+    }
+    batchReady_.notify_one();
+  }
+
+  //
+  // Threads
+  //
+
+  void IoEngine::dispatchLoop() {
+    while (true) {
+      std::shared_ptr<Batch> batch;
+      {
+        std::unique_lock lock{mutex_};
+        batchReady_.wait(lock, [this] { return stopping_ || !batches_.empty(); });
+        if (stopping_) {
+          return;
+        }
+        batch = std::move(batches_.front());
+        batches_.pop_front();
+      }
+
+      // locating files touches the disk, so it happens here, not in read()
+      std::vector<Job> jobs;
+      for (auto index : diskorder::physicalOrder(
+             batch->paths, options_.order, options_.window)) {
+        jobs.push_back({batch, index});
+      }
+
+      if (backend_ == Backend::ioUring) {
+        runUring(jobs);
+      } else {
+        runPool(jobs);
+      }
+    }
+  }
+
+  void IoEngine::poolLoop() {
+    while (true) {
+      Job job;
+      {
+        std::unique_lock lock{mutex_};
+        jobReady_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+        if (stopping_) {
+          return;
+        }
+        job = std::move(jobs_.front());
+        jobs_.pop_front();
+      }
+      finish(job, readBlocking(job.batch->paths[job.index]));
+    }
+  }
+
+  void IoEngine::runPool(std::vector<Job>& jobs) {
+    // the job to deliver next is always queued before any that must wait
+    // for it, so this cannot stall
+    for (auto& job : jobs) {
+      {
+        std::unique_lock lock{mutex_};
+        delivered_.wait(lock, [&] { return stopping_ || inWindow(job); });
+        if (stopping_) {
+          return;
+        }
+        jobs_.push_back(std::move(job));
+      }
+      jobReady_.notify_one();
+    }
+  }
+
+  void IoEngine::runUring(std::vector<Job>& jobs) {
+#if defined(DUMAGEVIEW_HAVE_LIBURING)
+    io_uring ring;
+    int rc = io_uring_queue_init(options_.queueDepth, &ring, 0);
+    if (rc < 0) {
+      log::warn("Could not set up io_uring: {}", std::strerror(-rc));
+      for (auto const& job : jobs) {
+        finish(job, readBlocking(job.batch->paths[job.index]));
+      }
+      return;
+    }
+    auto guard = ScopeGuard{[&] { io_uring_queue_exit(&ring); }};
+
+    enum class Phase { open, read, close };
+
+    struct Slot {
+      Job const* job = nullptr;
+      Phase phase = Phase::open;
+      Result result;
+      Clock::time_point start;
+      int fd = -1;
+      int done = 0;
+    };
+
+    std::vector<Slot> slots(std::max(options_.queueDepth, 1u));
+    std::vector<Slot*> freeSlots;
+    for (auto& slot : slots) {
+      freeSlots.push_back(&slot);
+    }
+
+    auto prep = [&](Slot& slot) {
+      io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+      DUMAGEVIEW_ASSERT(sqe);
+
+      switch (slot.phase) {
+        case Phase::open:
+          io_uring_prep_openat(sqe,
+                               AT_FDCWD,
+                               slot.result.path.c_str(),
+                               O_RDONLY | O_CLOEXEC,
+                               0);
+          break;
+        case Phase::read:
+          io_uring_prep_read(sqe,
+                             slot.fd,
+                             slot.result.data.data() + slot.done,
+                             slot.result.data.size() - slot.done,
+                             slot.done);
+          break;
+        case Phase::close:
+          io_uring_prep_close(sqe, slot.fd);
+          break;
+      }
+      io_uring_sqe_set_data(sqe, &slot);
+    };
+
+    auto toClose = [&](Slot& slot) {
+      slot.phase = Phase::close;
+      prep(slot);
+    };
+
+    auto complete = [&](Slot& slot) {
+      slot.result.latency = Clock::now() - slot.start;
+      finish(*slot.job, std::move(slot.result));
+      slot = Slot{};
+      freeSlots.push_back(&slot);
+    };
+
+    auto next = jobs.begin();
+    std::size_t inFlight = 0;
+
+    while (next != jobs.end() || inFlight > 0) {
+      // top up the submission queue with new opens; whatever holds up the
+      // window is already in flight
+      while (next != jobs.end() && !freeSlots.empty() && inWindow(*next)) {
+        Slot& slot = *freeSlots.back();
+        freeSlots.pop_back();
+
+        slot.job = &*next++;
+        slot.result.path = slot.job->batch->paths[slot.job->index];
+        slot.start = Clock::now();
+        prep(slot);
+        ++inFlight;
+      }
+
+      io_uring_submit_and_wait(&ring, 1);
+
+      io_uring_cqe* cqe = nullptr;
+      while (io_uring_peek_cqe(&ring, &cqe) == 0) {
+        auto& slot = *static_cast<Slot*>(io_uring_cqe_get_data(cqe));
+        int res = cqe->res;
+        io_uring_cqe_seen(&ring, cqe);
+
+        switch (slot.phase) {
+          case Phase::open:
+            if (res < 0) {
+              slot.result.error = -res;
+              complete(slot);
+              --inFlight;
+              break;
+            }
+            slot.fd = res;
+            slot.result.error = allocateFor(slot.fd, slot.result.data);
+            if (!slot.result.ok() || slot.result.data.isEmpty()) {
+              toClose(slot);
+            } else {
+              slot.phase = Phase::read;
+              prep(slot);
+            }
+            break;
+
+          case Phase::read:
+            if (res < 0 && res != -EINTR && res != -EAGAIN) {
+              slot.result.error = -res;
+              toClose(slot);
+            } else if (res == 0) {
+              slot.result.data.truncate(slot.done);
+              toClose(slot);
+            } else {
+              slot.done += std::max(res, 0);
+              if (slot.done < slot.result.data.size()) {
+                prep(slot);  // short read
+              } else {
+                toClose(slot);
+              }
+            }
+            break;
+
+          case Phase::close:
+            complete(slot);
+            --inFlight;
+            break;
+        }
+      }
+    }
+#else
+    DUMAGEVIEW_ASSERT(false);
+    runPool(jobs);
+#endif
+  }
+
+  //
+  // Completion
+  //
+
+  bool IoEngine::inWindow(Job const& job) const {
+    return job.index < job.batch->numDelivered + options_.window;
+  }
+
+  void IoEngine::finish(Job const& job, Result&& result) {
+    auto& batch = *job.batch;
+    std::unique_lock lock{batch.mutex};
+
+    batch.latencies.push_back(Millis(result.latency).count());
+    batch.bytes += static_cast<std::size_t>(result.data.size());
+
+    if (!result.ok()) {
+      log::warn("Could not read {}: {}", result.path, std::strerror(result.error));
+    }
+
+    batch.delivery.put(job.index, std::move(result), batch.callback);
+    bool advanced = batch.delivery.getNext() != batch.numDelivered;
+    batch.numDelivered = batch.delivery.getNext();
+
+    if (batch.latencies.size() == batch.paths.size()) {
+      log::debug(
+        "Read {} files ({:.1f} MiB) via {} in {:.1f} ms: "
+        "{:.1f} MiB/s, latency p50 {:.2f} ms, p99 {:.2f} ms",
+        batch.paths.size(),
+        batch.bytes / 1048576.0,
+        backendName(batch.backend),
+        Millis(Clock::now() - batch.start).count(),
+        batch.bytes / std::chrono::duration<double>(Clock::now() - batch.start).count()
+          / 1048576.0,
+        percentile(batch.latencies, 0.5),
+        percentile(batch.latencies, 0.99)
+      );
+    }
+    lock.unlock();
+
+    // a dispatcher may be waiting for room in the window; taking the lock
+    // first keeps it from missing this between its check and its wait
+    if (advanced) {
+      { std::lock_guard engineLock{mutex_}; }
+      delivered_.notify_all();
+    }
+  }
+}
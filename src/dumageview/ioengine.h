@@ -0,0 +1,125 @@
+#ifndef DUMAGEVIEW_IOENGINE_H_
+#define DUMAGEVIEW_IOENGINE_H_
+
+#include "dumageview/diskorder.h"
+
+#include <QByteArray>
+
+#include <boost/filesystem.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dumageview::ioengine {
+  using Path = boost::filesystem::path;
+  using Clock = std::chrono::steady_clock;
+
+  enum class Backend {
+    ioUring,
+    threadPool,
+  };
+
+  /**
+   * Whole contents of one file, or the reason it could not be read.
+   */
+  struct Result {
+    Path path;
+    QByteArray data;
+    int error{0};  // errno value; zero on success
+    Clock::duration latency{};
+
+    bool ok() const {
+      return error == 0;
+    }
+  };
+
+  /**
+   * Called once per file, in the order the paths were given.
+   * Runs on an engine thread, so receivers must hop to their own thread.
+   */
+  using Callback = std::function<void(std::size_t index, Result&& result)>;
+
+  struct Options {
+    unsigned queueDepth{32};  // io_uring submissions in flight
+    unsigned numThreads{4};  // pread workers when io_uring is unavailable
+    std::size_t window{diskorder::defaultWindow};  // reads ahead of delivery
+    bool allowIoUring{true};
+    diskorder::Policy order{diskorder::Policy::automatic};
+  };
+
+  /**
+   * Reads batches of whole files in the background.
+   *
+   * Opens and reads are submitted through io_uring when the kernel and build
+   * support it. Otherwise a small pool of threads does blocking preads.
+   * Within a batch, files are read in on-disk order, but no further ahead
+   * of the callback than the window allows, so results waiting to be
+   * delivered in order stay bounded.
+   */
+  class IoEngine {
+   public:
+    explicit IoEngine(Options const& options = {});
+
+    ~IoEngine();
+
+    /**
+     * Queues a batch of files to read. Returns immediately.
+     */
+    void read(std::vector<Path> paths, Callback callback);
+
+    Backend getBackend() const {
+      return backend_;
+    }
+
+   private:
+    IoEngine(IoEngine const&) = delete;
+    IoEngine& operator=(IoEngine const&) = delete;
+
+    struct Batch;
+
+    struct Job {
+      std::shared_ptr<Batch> batch;
+      std::size_t index;
+    };
+
+    void dispatchLoop();
+    void poolLoop();
+
+    void runUring(std::vector<Job>& jobs);
+    void runPool(std::vector<Job>& jobs);
+
+    bool inWindow(Job const& job) const;
+    void finish(Job const& job, Result&& result);
+
+    //
+    // Private data
+    //
+
+    Options options_;
+    Backend backend_;
+
+    std::mutex mutex_;
+    std::condition_variable batchReady_;
+    std::condition_variable jobReady_;
+    std::condition_variable delivered_;
+    std::deque<std::shared_ptr<Batch>> batches_;
+    std::deque<Job> jobs_;
+    bool stopping_ = false;
+
+    std::thread dispatcher_;
+    std::vector<std::thread> workers_;
+  };
+}
+
+namespace dumageview {
+  using ioengine::IoEngine;
+}
+
+#endif  // DUMAGEVIEW_IOENGINE_H_
@@ -52,19 +52,69 @@ namespace dumageview {
   //
 
   void MainWindow::resetImage(QImage const& image, ImageInfo const& info) {
-    setWindowTitle(
-      QString("%1 : %2 (%3 / %4) - %5")
-        .arg(info.fileName)
-        .arg(info.frame)
-        .arg(info.dirIndex + 1)
-        .arg(info.dirSize)
-        .arg(Application::getSingletonInstance().applicationDisplayName())
-    );
-    getImageArea().resetImage(image);
+    updateInfo(info);
+
+    // rotating and flipping last across the frames of a file
+    if (info.filePath != filePath_) {
+      filePath_ = info.filePath;
+      getImageArea().resetOrientation();
+    }
+
+    // each frame of each version of a file keeps its own textures and
+    // view, and the frames of an animation share an atlas
+    auto file = QString("%1:%2").arg(info.filePath, info.stamp);
+    auto key = QString("%1:%2").arg(file).arg(info.frame);
+    imagerenderer::FrameRef frame{
+      info.numFrames > 1 ? file : QString{},
+      info.frame,
+      info.numFrames,
+      info.damage};
+    getImageArea().resetImage(image,
+                              key,
+                              info.tileSource,
+                              info.planes,
+                              frame,
+                              info.orientation,
+                              info.colorLut);
+  }
+
+  void MainWindow::updateInfo(ImageInfo const& info) {
+    imageTitle_ = QString("%1 : %2 (%3 / %4)")
+                    .arg(info.fileName)
+                    .arg(info.frame)
+                    .arg(info.dirIndex + 1)
+                    .arg(info.dirSize);
+    updateTitle();
   }
 
   void MainWindow::removeImage() {
-    setWindowTitle(Application::getSingletonInstance().applicationDisplayName());
+    imageTitle_.clear();
+    updateTitle();
+    filePath_.clear();
     getImageArea().removeImage();
   }
+
+  void MainWindow::setPlaybackStats(
+    std::optional<playback::Stats> const& stats) {
+    playbackStats_ = stats;
+    updateTitle();
+  }
+
+  void MainWindow::updateTitle() {
+    auto appName = Application::getSingletonInstance().applicationDisplayName();
+    if (imageTitle_.isEmpty()) {
+      setWindowTitle(appName);
+      return;
+    }
+
+    if (playbackStats_) {
+      setWindowTitle(QString("%1 [%2 / %3 fps] - %4")
+                       .arg(imageTitle_)
+                       .arg(playbackStats_->actualFps, 0, 'f', 1)
+                       .arg(playbackStats_->targetFps, 0, 'f', 1)
+                       .arg(appName));
+    } else {
+      setWindowTitle(QString("%1 - %2").arg(imageTitle_, appName));
+    }
+  }
 }
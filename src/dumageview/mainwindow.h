@@ -5,8 +5,12 @@
 #include "dumageview/classtools.h"
 #include "dumageview/imageinfo.h"
 #include "dumageview/imagewidget.h"
+#include "dumageview/playback.h"
 
 #include <QMainWindow>
+#include <QString>
+
+#include <optional>
 
 namespace dumageview {
   class MainWindow : public QMainWindow {
@@ -33,8 +37,15 @@ namespace dumageview {
 
     void resetImage(QImage const& image, ImageInfo const& info);
 
+    void updateInfo(ImageInfo const& info);
+
     void removeImage();
 
+    /**
+     * Shown in the title while an animation plays; nothing once it stops.
+     */
+    void setPlaybackStats(std::optional<playback::Stats> const& stats);
+
     //
     // Public accessors
     //
@@ -44,12 +55,17 @@ namespace dumageview {
     }
 
    private:
+    void updateTitle();
+
     //
     // Private data
     //
 
     ActionSet& actions_;
     ImageWidget imageArea_;
+    QString filePath_;  // of the image shown
+    QString imageTitle_;
+    std::optional<playback::Stats> playbackStats_;
   };
 }
 
@@ -61,6 +61,66 @@ namespace dumageview {
     // image widget sets enabled state for zoomToFit
     actions_.zoomToFit.setEnabled(false);
 
+    //
+    // Orientation
+    //
+
+    setA(actions_.rotateClockwise, "Rotate Clockwise", {Qt::Key_R});
+
+    setA(actions_.rotateCounterclockwise,
+         "Rotate Counterclockwise",
+         {Qt::SHIFT + Qt::Key_R, Qt::Key_L});
+
+    setA(actions_.flipHorizontally, "Flip Horizontally", {Qt::Key_H});
+    setA(actions_.flipVertically, "Flip Vertically", {Qt::Key_V});
+
+    //
+    // Display adjustments
+    //
+
+    setA(actions_.increaseExposure, "Increase Exposure", {Qt::Key_E});
+    setA(actions_.decreaseExposure,
+         "Decrease Exposure",
+         {Qt::SHIFT + Qt::Key_E});
+
+    setA(actions_.increaseBrightness, "Increase Brightness", {Qt::Key_B});
+    setA(actions_.decreaseBrightness,
+         "Decrease Brightness",
+         {Qt::SHIFT + Qt::Key_B});
+
+    setA(actions_.increaseContrast, "Increase Contrast", {Qt::Key_C});
+    setA(actions_.decreaseContrast,
+         "Decrease Contrast",
+         {Qt::SHIFT + Qt::Key_C});
+
+    setA(actions_.increaseGamma, "Increase Gamma", {Qt::Key_G});
+    setA(actions_.decreaseGamma, "Decrease Gamma", {Qt::SHIFT + Qt::Key_G});
+
+    setA(actions_.showAllChannels, "All Channels", {Qt::ALT + Qt::Key_C});
+    setA(actions_.showRed, "Red Channel", {Qt::ALT + Qt::Key_R});
+    setA(actions_.showGreen, "Green Channel", {Qt::ALT + Qt::Key_G});
+    setA(actions_.showBlue, "Blue Channel", {Qt::ALT + Qt::Key_B});
+    setA(actions_.showAlpha, "Alpha Channel", {Qt::ALT + Qt::Key_A});
+    setA(actions_.showLuma, "Luma", {Qt::ALT + Qt::Key_L});
+
+    for (QAction* action : {&actions_.showAllChannels,
+                            &actions_.showRed,
+                            &actions_.showGreen,
+                            &actions_.showBlue,
+                            &actions_.showAlpha,
+                            &actions_.showLuma}) {
+      action->setCheckable(true);
+      channelGroup_.addAction(action);
+    }
+    actions_.showAllChannels.setChecked(true);
+
+    setA(actions_.showCheckerboard, "Show Transparency", {Qt::Key_T});
+    actions_.showCheckerboard.setCheckable(true);
+
+    setA(actions_.resetAdjustments,
+         "Reset Adjustments",
+         {Qt::Key_Backspace});
+
     //
     // Panning
     //
@@ -98,6 +158,10 @@ namespace dumageview {
 
     setA(actions_.nextFrame, "Next Frame", {Qt::Key_Period});
 
+    setA(actions_.playAnimation, "Play Animation", {Qt::Key_Slash});
+
+    actions_.playAnimation.setCheckable(true);
+
     //
     // Window manipulation
     //
@@ -135,6 +199,10 @@ namespace dumageview {
       actions_.zoomOriginal,
       actions_.zoomIn,
       actions_.zoomOut,
+      actions_.rotateClockwise,
+      actions_.rotateCounterclockwise,
+      actions_.flipHorizontally,
+      actions_.flipVertically,
       actions_.panUp,
       actions_.panDown,
       actions_.panLeft,
@@ -143,6 +211,7 @@ namespace dumageview {
       actions_.nextImage,
       actions_.prevFrame,
       actions_.nextFrame,
+      actions_.playAnimation,
     };
   }
 
@@ -150,6 +219,27 @@ namespace dumageview {
   // Menus
   //
 
+  void MenuMaker::addAdjustActions(QMenu& menu) {
+    menu.addAction(&actions_.increaseExposure);
+    menu.addAction(&actions_.decreaseExposure);
+    menu.addAction(&actions_.increaseBrightness);
+    menu.addAction(&actions_.decreaseBrightness);
+    menu.addAction(&actions_.increaseContrast);
+    menu.addAction(&actions_.decreaseContrast);
+    menu.addAction(&actions_.increaseGamma);
+    menu.addAction(&actions_.decreaseGamma);
+    menu.addSeparator();
+    menu.addAction(&actions_.showAllChannels);
+    menu.addAction(&actions_.showRed);
+    menu.addAction(&actions_.showGreen);
+    menu.addAction(&actions_.showBlue);
+    menu.addAction(&actions_.showAlpha);
+    menu.addAction(&actions_.showLuma);
+    menu.addSeparator();
+    menu.addAction(&actions_.showCheckerboard);
+    menu.addAction(&actions_.resetAdjustments);
+  }
+
   void MenuMaker::setupContextMenu() {
     contextMenu_.addAction(&actions_.prevImage);
     contextMenu_.addAction(&actions_.nextImage);
@@ -162,8 +252,15 @@ namespace dumageview {
     contextMenu_.addAction(&actions_.zoomIn);
     contextMenu_.addAction(&actions_.zoomOut);
     contextMenu_.addSeparator();
+    contextMenu_.addAction(&actions_.rotateClockwise);
+    contextMenu_.addAction(&actions_.rotateCounterclockwise);
+    contextMenu_.addAction(&actions_.flipHorizontally);
+    contextMenu_.addAction(&actions_.flipVertically);
+    addAdjustActions(*contextMenu_.addMenu("Adjust"));
+    contextMenu_.addSeparator();
     contextMenu_.addAction(&actions_.prevFrame);
     contextMenu_.addAction(&actions_.nextFrame);
+    contextMenu_.addAction(&actions_.playAnimation);
     contextMenu_.addSeparator();
     contextMenu_.addAction(&actions_.showMenuBar);
     contextMenu_.addAction(&actions_.fullScreen);
@@ -186,13 +283,22 @@ namespace dumageview {
     viewMenu->addAction(&actions_.zoomOut);
     viewMenu->addAction(&actions_.zoomToFit);
     viewMenu->addAction(&actions_.zoomOriginal);
+    viewMenu->addSeparator();
+    viewMenu->addAction(&actions_.rotateClockwise);
+    viewMenu->addAction(&actions_.rotateCounterclockwise);
+    viewMenu->addAction(&actions_.flipHorizontally);
+    viewMenu->addAction(&actions_.flipVertically);
     fileMenu->addSeparator();
     fileMenu->addAction(&actions_.prevFrame);
     fileMenu->addAction(&actions_.nextFrame);
+    fileMenu->addAction(&actions_.playAnimation);
     viewMenu->addSeparator();
     viewMenu->addAction(&actions_.showMenuBar);
     viewMenu->addAction(&actions_.fullScreen);
 
+    QMenu* adjustMenu = menuBar->addMenu("&Adjust");
+    addAdjustActions(*adjustMenu);
+
     menuBar->hide();
     actions_.showMenuBar.setChecked(false);
   }
@@ -4,6 +4,7 @@
 #include "dumageview/actionset.h"
 
 #include <QAction>
+#include <QActionGroup>
 #include <QMenu>
 #include <QObject>
 
@@ -49,11 +50,14 @@ namespace dumageview {
 
     actionset::RefList getImageActions();
 
+    void addAdjustActions(QMenu& menu);
+
     //
     // Private data
     //
 
     ActionSet actions_;
+    QActionGroup channelGroup_{nullptr};  // one channel at a time
 
     QMenu contextMenu_;
   };
@@ -0,0 +1,200 @@
+#include "dumageview/mipmap.h"
+
+#include "dumageview/assert.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace dumageview::mipmap {
+  namespace {
+    // fewer rows than this are not worth a thread
+    constexpr int minRowsPerBand = 64;
+
+    /**
+     * Box filters pixels from x on, each channel on its own.
+     */
+    template <typename T>
+    void downsampleRowFrom(int x,
+                           uchar const* row0,
+                           uchar const* row1,
+                           uchar* dst,
+                           int srcWidth,
+                           int dstWidth,
+                           int channels) {
+      auto const* src0 = reinterpret_cast<T const*>(row0);
+      auto const* src1 = reinterpret_cast<T const*>(row1);
+      auto* out = reinterpret_cast<T*>(dst);
+
+      for (; x < dstWidth; ++x) {
+        int x0 = std::min(2 * x, srcWidth - 1);
+        int x1 = std::min(2 * x + 1, srcWidth - 1);
+        for (int c = 0; c < channels; ++c) {
+          unsigned sum = src0[channels * x0 + c] + src0[channels * x1 + c]
+                         + src1[channels * x0 + c] + src1[channels * x1 + c];
+          out[channels * x + c] = static_cast<T>((sum + 2) >> 2);
+        }
+      }
+    }
+
+    void downsampleRow(uchar const* row0,
+                       uchar const* row1,
+                       uchar* dst,
+                       int srcWidth,
+                       int dstWidth,
+                       int channels,
+                       bool wide) {
+      if (wide) {
+        downsampleRowFrom<quint16>(
+          0, row0, row1, dst, srcWidth, dstWidth, channels);
+        return;
+      }
+
+      int x = 0;
+
+#if defined(__SSE2__)
+      // four source pixels to two destination pixels per step
+      __m128i const zero = _mm_setzero_si128();
+      __m128i const two = _mm_set1_epi16(2);
+
+      for (; channels == 4 && x + 2 <= dstWidth && 2 * x + 4 <= srcWidth;
+           x += 2) {
+        auto const* src0 = reinterpret_cast<__m128i const*>(row0 + 8 * x);
+        auto const* src1 = reinterpret_cast<__m128i const*>(row1 + 8 * x);
+        auto a = _mm_loadu_si128(src0);
+        auto b = _mm_loadu_si128(src1);
+
+        // vertical sums in 16 bits: lo holds pixels 0-1, hi holds 2-3
+        auto lo =
+          _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+        auto hi =
+          _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+
+        // horizontal sums land in the low four lanes of each
+        lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+        hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+
+        auto sum = _mm_unpacklo_epi64(lo, hi);
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 4 * x),
+                         _mm_packus_epi16(sum, sum));
+      }
+#endif
+
+      downsampleRowFrom<uchar>(
+        x, row0, row1, dst, srcWidth, dstWidth, channels);
+    }
+
+    bool hasWideChannels(QImage::Format format) {
+      switch (format) {
+        case QImage::Format_Grayscale16:
+        case QImage::Format_RGBX64:
+        case QImage::Format_RGBA64:
+        case QImage::Format_RGBA64_Premultiplied:
+          return true;
+        default:
+          return false;
+      }
+    }
+  }
+
+  bool isSupported(QImage::Format format) {
+    switch (format) {
+      case QImage::Format_Grayscale8:
+      case QImage::Format_Grayscale16:
+      case QImage::Format_RGB888:
+      case QImage::Format_RGB32:
+      case QImage::Format_ARGB32:
+      case QImage::Format_ARGB32_Premultiplied:
+      case QImage::Format_RGBX8888:
+      case QImage::Format_RGBA8888:
+      case QImage::Format_RGBA8888_Premultiplied:
+      case QImage::Format_RGBX64:
+      case QImage::Format_RGBA64:
+      case QImage::Format_RGBA64_Premultiplied:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  QImage downsample(QImage const& src, WorkerPool& pool) {
+    bool wide = hasWideChannels(src.format());
+    int channels = src.depth() / (wide ? 16 : 8);
+    DUMAGEVIEW_ASSERT(isSupported(src.format()));
+
+    // same sizes as GL mip levels; odd trailing pixels are dropped
+    int width = std::max(src.width() / 2, 1);
+    int height = std::max(src.height() / 2, 1);
+    QImage dst(width, height, src.format());
+
+    auto doRows = [&](int begin, int end) {
+      for (int y = begin; y < end; ++y) {
+        downsampleRow(src.constScanLine(std::min(2 * y, src.height() - 1)),
+                      src.constScanLine(std::min(2 * y + 1, src.height() - 1)),
+                      dst.scanLine(y),
+                      src.width(),
+                      width,
+                      channels,
+                      wide);
+      }
+    };
+
+    pool.forBands(height, minRowsPerBand, doRows);
+    return dst;
+  }
+
+  QRect downsampleRect(QImage const& src, QImage& dst, QRect const& srcRect) {
+    bool wide = hasWideChannels(src.format());
+    int channels = src.depth() / (wide ? 16 : 8);
+    int pixelBytes = src.depth() / 8;
+    DUMAGEVIEW_ASSERT(src.format() == dst.format());
+
+    auto clipped = srcRect & src.rect();
+    if (clipped.isEmpty()) {
+      return {};
+    }
+
+    // each destination pixel covers a 2x2 block of the source
+    QRect dstRect = QRect{QPoint{clipped.left() / 2, clipped.top() / 2},
+                          QPoint{clipped.right() / 2, clipped.bottom() / 2}}
+                    & dst.rect();
+    if (dstRect.isEmpty()) {
+      return {};
+    }
+
+    int srcLeft = 2 * dstRect.left();
+    auto srcOffset = static_cast<std::size_t>(srcLeft * pixelBytes);
+    auto dstOffset = static_cast<std::size_t>(dstRect.left() * pixelBytes);
+
+    for (int y = dstRect.top(); y <= dstRect.bottom(); ++y) {
+      downsampleRow(
+        src.constScanLine(std::min(2 * y, src.height() - 1)) + srcOffset,
+        src.constScanLine(std::min(2 * y + 1, src.height() - 1)) + srcOffset,
+        dst.scanLine(y) + dstOffset,
+        src.width() - srcLeft,
+        dstRect.width(),
+        channels,
+        wide);
+    }
+    return dstRect;
+  }
+
+  std::vector<QImage> buildChain(QImage const& base,
+                                 int numLevels,
+                                 WorkerPool& pool,
+                                 std::atomic<bool> const& cancelled) {
+    std::vector<QImage> levels;
+    levels.reserve(static_cast<std::size_t>(std::max(numLevels - 1, 0)));
+    QImage const* prev = &base;
+
+    for (int level = 1; level < numLevels && !cancelled; ++level) {
+      levels.push_back(downsample(*prev, pool));
+      prev = &levels.back();
+    }
+    return levels;
+  }
+}
@@ -0,0 +1,44 @@
+#ifndef DUMAGEVIEW_MIPMAP_H_
+#define DUMAGEVIEW_MIPMAP_H_
+
+#include "dumageview/workerpool.h"
+
+#include <QImage>
+#include <QRect>
+
+#include <atomic>
+#include <vector>
+
+namespace dumageview::mipmap {
+  /**
+   * Whether format has 8- or 16-bit channels of one kind, which is what
+   * downsample() takes. The channel order does not matter.
+   */
+  bool isSupported(QImage::Format format);
+
+  /**
+   * Halves a supported image with a 2x2 box filter, each channel on its own.
+   * Sizes round down like GL mip levels, so an odd last row or column is
+   * dropped; only a side of one is reused for both samples. Rows are split
+   * across the pool.
+   */
+  QImage downsample(QImage const& src, WorkerPool& pool);
+
+  /**
+   * Redoes the part of dst, which downsample() made from src, that depends
+   * on srcRect of src. Returns that part. On the calling thread, since it
+   * is meant for small changes.
+   */
+  QRect downsampleRect(QImage const& src, QImage& dst, QRect const& srcRect);
+
+  /**
+   * Builds mip levels 1 through numLevels - 1 of a supported image.
+   * Stops early, returning what it has, once cancelled is set.
+   */
+  std::vector<QImage> buildChain(QImage const& base,
+                                 int numLevels,
+                                 WorkerPool& pool,
+                                 std::atomic<bool> const& cancelled);
+}
+
+#endif  // DUMAGEVIEW_MIPMAP_H_
@@ -0,0 +1,84 @@
+#include "dumageview/orientation.h"
+
+#include "dumageview/math.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <QTransform>
+
+namespace dumageview::orientation {
+  //
+  // Orientation member functions
+  //
+
+  Orientation Orientation::after(Orientation const& other) const {
+    // mirroring first reverses the turns that came before it
+    int turns = mirrored ? -other.quarterTurns : other.quarterTurns;
+    return {mirrored != other.mirrored, math::mod(quarterTurns + turns, 4)};
+  }
+
+  Orientation Orientation::rotated(int turns) const {
+    return Orientation{false, math::mod(turns, 4)}.after(*this);
+  }
+
+  Orientation Orientation::flippedHorizontally() const {
+    return Orientation{true, 0}.after(*this);
+  }
+
+  Orientation Orientation::flippedVertically() const {
+    return Orientation{true, 2}.after(*this);
+  }
+
+  //
+  // Free functions
+  //
+
+  Orientation fromTransformations(QImageIOHandler::Transformations tf) {
+    // a flip is a mirror turned halfway, and Qt turns after both
+    bool mirror = tf & QImageIOHandler::TransformationMirror;
+    bool flip = tf & QImageIOHandler::TransformationFlip;
+    bool rotate = tf & QImageIOHandler::TransformationRotate90;
+    return {mirror != flip, (flip ? 2 : 0) + (rotate ? 1 : 0)};
+  }
+
+  glm::dvec2 orientedSize(Orientation const& o, glm::dvec2 const& size) {
+    return (o.quarterTurns % 2 == 0) ? size : glm::dvec2{size.y, size.x};
+  }
+
+  glm::dmat4 orientMatrix(Orientation const& o, glm::dvec2 const& size) {
+    glm::dmat4 eye{1.0};
+    glm::dmat4 m{1.0};
+    glm::dvec2 bounds = size;
+
+    if (o.mirrored) {
+      m = glm::translate(eye, glm::dvec3{bounds.x, 0.0, 0.0})
+          * glm::scale(eye, glm::dvec3{-1.0, 1.0, 1.0});
+    }
+
+    for (int i = 0; i < o.quarterTurns; ++i) {
+      // (x, y) -> (h - y, x), with y down
+      glm::dmat4 turn{1.0};
+      turn[0] = glm::dvec4{0.0, 1.0, 0.0, 0.0};
+      turn[1] = glm::dvec4{-1.0, 0.0, 0.0, 0.0};
+      turn[3] = glm::dvec4{bounds.y, 0.0, 0.0, 1.0};
+
+      m = turn * m;
+      bounds = glm::dvec2{bounds.y, bounds.x};
+    }
+
+    return m;
+  }
+
+  QImage apply(QImage const& image, Orientation const& o) {
+    if (o.isIdentity()) {
+      return image;
+    }
+
+    auto result = image.mirrored(o.mirrored, false);
+    if (o.quarterTurns != 0) {
+      // right angles take Qt's exact rotation path, without resampling
+      result = result.transformed(QTransform().rotate(90.0 * o.quarterTurns));
+    }
+    return result;
+  }
+}
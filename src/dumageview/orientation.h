@@ -0,0 +1,73 @@
+#ifndef DUMAGEVIEW_ORIENTATION_H_
+#define DUMAGEVIEW_ORIENTATION_H_
+
+#include <glm/glm.hpp>
+
+#include <QImage>
+#include <QImageIOHandler>
+
+namespace dumageview::orientation {
+  /**
+   * How an image is turned for display: mirrored left to right, then
+   * rotated clockwise. Covers all eight EXIF orientations.
+   */
+  struct Orientation {
+    bool mirrored{false};
+    int quarterTurns{0};  // 0 to 3
+
+    /**
+     * This applied after other.
+     */
+    Orientation after(Orientation const& other) const;
+
+    /**
+     * Turned further clockwise, or counterclockwise for negative turns.
+     */
+    Orientation rotated(int turns) const;
+
+    /**
+     * Mirrored left to right, or top to bottom, as seen after turning.
+     */
+    Orientation flippedHorizontally() const;
+    Orientation flippedVertically() const;
+
+    bool isIdentity() const {
+      return !mirrored && quarterTurns == 0;
+    }
+
+    bool operator==(Orientation const& other) const {
+      return mirrored == other.mirrored && quarterTurns == other.quarterTurns;
+    }
+    bool operator!=(Orientation const& other) const {
+      return !(*this == other);
+    }
+  };
+
+  /**
+   * From the transformation an image reader reports.
+   */
+  Orientation fromTransformations(QImageIOHandler::Transformations tf);
+
+  /**
+   * Size of an image of the given size once oriented.
+   */
+  glm::dvec2 orientedSize(Orientation const& o, glm::dvec2 const& size);
+
+  /**
+   * Maps points in an image of the given size to the oriented image, whose
+   * top left is still the origin.
+   */
+  glm::dmat4 orientMatrix(Orientation const& o, glm::dvec2 const& size);
+
+  /**
+   * Orients the pixels themselves, for when they are written out or have
+   * no transform to go through.
+   */
+  QImage apply(QImage const& image, Orientation const& o);
+}
+
+namespace dumageview {
+  using orientation::Orientation;
+}
+
+#endif  // DUMAGEVIEW_ORIENTATION_H_
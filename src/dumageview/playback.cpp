@@ -0,0 +1,284 @@
+#include "dumageview/playback.h"
+
+#include "dumageview/damage.h"
+#include "dumageview/log.h"
+#include "dumageview/qtutil.h"
+
+#include <QBuffer>
+#include <QImageReader>
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+namespace dumageview::playback {
+  namespace {
+    using namespace std::literals;
+
+    // decoded frames held ahead of the one shown, at most
+    constexpr std::size_t ringBytes = std::size_t{256} << 20;
+    constexpr std::size_t minRingFrames = 2;
+    constexpr std::size_t maxRingFrames = 32;
+
+    // browsers show frames this short for 100 ms, and files are made to
+    // look right in browsers
+    constexpr Millis minDelay = 11ms;
+    constexpr Millis shortDelay = 100ms;
+
+    // how soon to look again when the decoder has fallen behind
+    constexpr Millis retryInterval = 4ms;
+
+    // further behind than this, dropping frames to catch up looks worse
+    // than starting the clock over
+    constexpr auto maxLag = 500ms;
+
+    constexpr auto statsInterval = 1s;
+
+    std::size_t ringCapacity(QImage const& frame) {
+      auto frameBytes = static_cast<std::size_t>(std::max(
+        frame.sizeInBytes(), decltype(frame.sizeInBytes()){1}));
+      return std::clamp(ringBytes / frameBytes, minRingFrames, maxRingFrames);
+    }
+
+    /**
+     * A reader, and the buffer it reads from if there is one.
+     */
+    struct Decoder {
+      std::unique_ptr<QBuffer> buffer;
+      std::unique_ptr<QImageReader> reader;
+    };
+
+    Decoder openDecoder(Source const& source) {
+      Decoder decoder;
+      if (!source.fileName.isEmpty()) {
+        decoder.reader = std::make_unique<QImageReader>(source.fileName);
+      } else {
+        decoder.buffer = std::make_unique<QBuffer>();
+        decoder.buffer->setData(source.data);
+        decoder.buffer->open(QIODevice::ReadOnly);
+        decoder.reader = std::make_unique<QImageReader>(decoder.buffer.get(),
+                                                        source.format);
+      }
+
+      // orientation is applied by the view, as for the first frame
+      decoder.reader->setAutoTransform(false);
+      return decoder;
+    }
+
+    /**
+     * Both of two changes, one after the other. Unknown if either is.
+     */
+    std::optional<QRegion> combine(std::optional<QRegion> const& first,
+                                   std::optional<QRegion> const& second) {
+      if (!first || !second) {
+        return std::nullopt;
+      }
+      return first->united(*second);
+    }
+  }
+
+  Player::Player(Source source,
+                 QImage const& current,
+                 int firstFrame,
+                 Convert convert,
+                 std::function<void(Frame&&)> onFrame,
+                 std::function<void(Stats const&)> onStats,
+                 std::function<void()> onFinished)
+      : source_(std::move(source)),
+        convert_(std::move(convert)),
+        onFrame_(std::move(onFrame)),
+        onStats_(std::move(onStats)),
+        onFinished_(std::move(onFinished)),
+        ring_(ringCapacity(current)) {
+    DUMAGEVIEW_LOG_DEBUG("Playing from frame {} with {} frames buffered",
+                         firstFrame,
+                         ring_.size());
+
+    timer_.setSingleShot(true);
+    timer_.setTimerType(Qt::PreciseTimer);
+    qtutil::connect(&timer_, &QTimer::timeout, [this] { tick(); });
+
+    // the current frame stays up for as long as a frame usually does
+    due_ = Clock::now() + shortDelay;
+    statsStart_ = Clock::now();
+    timer_.start(shortDelay);
+
+    thread_ = std::thread{[this, current, firstFrame] {
+      decode(current, firstFrame);
+    }};
+  }
+
+  Player::~Player() {
+    {
+      std::lock_guard lock{mutex_};
+      stopping_ = true;
+    }
+    space_.notify_all();
+    thread_.join();
+  }
+
+  //
+  // Decoding thread
+  //
+
+  void Player::decode(QImage previous, int firstFrame) {
+    auto decoder = openDecoder(source_);
+    auto* reader = decoder.reader.get();
+
+    int index = firstFrame;
+    if (index > 0 && !reader->jumpToImage(index)) {
+      // some formats only read forward
+      for (int i = 0; i < index; ++i) {
+        if (reader->read().isNull()) {
+          break;
+        }
+      }
+    }
+
+    // -1 is forever, and otherwise the file plays one more time than this
+    int loopCount = reader->loopCount();
+    int passes = 0;
+    bool anyRead = false;
+
+    while (true) {
+      QImage image = reader->read();
+      if (image.isNull()) {
+        // at the end of the file, or stuck partway through it
+        bool more = anyRead && (loopCount < 0 || passes < loopCount);
+        if (!more) {
+          if (index < reader->imageCount()) {
+            log::warn("Could not read frame {}: {}",
+                      index,
+                      reader->errorString().toStdString());
+          }
+          break;
+        }
+        ++passes;
+        anyRead = false;
+        decoder = openDecoder(source_);
+        reader = decoder.reader.get();
+        index = 0;
+        continue;
+      }
+      anyRead = true;
+
+      Millis delay{reader->nextImageDelay()};
+      if (delay < minDelay) {
+        delay = shortDelay;
+      }
+      if (convert_) {
+        image = convert_(image);
+      }
+
+      auto damage = damage::findChanges(previous, image);
+      previous = image;
+
+      if (!push({std::move(image), index, delay, std::move(damage)})) {
+        return;
+      }
+      ++index;
+    }
+
+    std::lock_guard lock{mutex_};
+    decodeDone_ = true;
+  }
+
+  bool Player::push(Frame&& frame) {
+    std::unique_lock lock{mutex_};
+    space_.wait(lock, [this] { return stopping_ || count_ < ring_.size(); });
+    if (stopping_) {
+      return false;
+    }
+    ring_[(head_ + count_) % ring_.size()] = std::move(frame);
+    ++count_;
+    return true;
+  }
+
+  //
+  // Calling thread
+  //
+
+  void Player::tick() {
+    auto now = Clock::now();
+
+    bool ended = false;
+    auto frame = takeDue(now, ended);
+    space_.notify_one();
+
+    if (frame) {
+      if (now - due_ > maxLag) {
+        due_ = now;
+      }
+      due_ += frame->delay;
+      ++shown_;
+
+      frame->damage = combine(droppedDamage_, frame->damage);
+      droppedDamage_ = QRegion{};
+
+      auto wait = std::chrono::duration_cast<Millis>(due_ - Clock::now());
+      timer_.start(std::max(wait, Millis{0}));
+    } else if (!ended) {
+      timer_.start(retryInterval);
+    }
+    report(now);
+
+    // last, since either may take a while
+    if (frame) {
+      onFrame_(std::move(*frame));
+    } else if (ended) {
+      DUMAGEVIEW_LOG_DEBUG("Playback finished");
+      onFinished_();
+    }
+  }
+
+  std::optional<Frame> Player::takeDue(Clock::time_point now, bool& ended) {
+    std::lock_guard lock{mutex_};
+
+    std::optional<Frame> frame;
+    while (count_ > 0) {
+      frame = std::move(ring_[head_]);
+      head_ = (head_ + 1) % ring_.size();
+      --count_;
+      authored_ += frame->delay;
+
+      // dropped only for one that is ready to take its place
+      if (count_ == 0 || now < due_ + frame->delay) {
+        break;
+      }
+      due_ += frame->delay;
+      ++dropped_;
+      droppedDamage_ = combine(droppedDamage_, frame->damage);
+      frame.reset();
+    }
+
+    ended = !frame && decodeDone_;
+    return frame;
+  }
+
+  void Player::report(Clock::time_point now) {
+    auto elapsed = now - statsStart_;
+    if (elapsed < statsInterval) {
+      return;
+    }
+
+    Stats stats;
+    stats.actualFps =
+      shown_ / std::chrono::duration<double>(elapsed).count();
+    if (authored_.count() > 0) {
+      stats.targetFps = (shown_ + dropped_)
+                        / std::chrono::duration<double>(authored_).count();
+    }
+    stats.dropped = dropped_;
+
+    DUMAGEVIEW_LOG_DEBUG("Playing at {:.1f} of {:.1f} fps, {} dropped",
+                         stats.actualFps,
+                         stats.targetFps,
+                         stats.dropped);
+
+    statsStart_ = now;
+    shown_ = 0;
+    dropped_ = 0;
+    authored_ = Millis{0};
+    onStats_(stats);
+  }
+}
@@ -0,0 +1,143 @@
+#ifndef DUMAGEVIEW_PLAYBACK_H_
+#define DUMAGEVIEW_PLAYBACK_H_
+
+#include <QByteArray>
+#include <QImage>
+#include <QRegion>
+#include <QString>
+#include <QTimer>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace dumageview::playback {
+  using Clock = std::chrono::steady_clock;
+  using Millis = std::chrono::milliseconds;
+
+  /**
+   * Where an animation is decoded from: a file, or bytes already read.
+   */
+  struct Source {
+    QString fileName;  // used if not empty
+    QByteArray data;  // must own its bytes; decoding outlives the caller
+    QByteArray format;
+  };
+
+  struct Frame {
+    QImage image;
+    int index{0};
+    Millis delay{0};  // how long it is shown
+
+    // where it differs from the frame shown before it, if known
+    std::optional<QRegion> damage;
+  };
+
+  /**
+   * Measured over the last second or so of playback.
+   */
+  struct Stats {
+    double actualFps{0.0};  // frames shown
+    double targetFps{0.0};  // frames the file's delays call for
+    int dropped{0};  // decoded too late to be shown
+  };
+
+  /**
+   * Converts a decoded frame, on the decoding thread, before it is queued.
+   */
+  using Convert = std::function<QImage(QImage const&)>;
+
+  /**
+   * Plays an animation at the rate its file asks for.
+   *
+   * Frames are decoded ahead on a thread of their own into a small ring of
+   * them, sized by a memory budget. A timer on the calling thread shows
+   * each one when its delay has passed. Frames that are still queued when
+   * the one after them is already due are dropped, so a slow decode costs
+   * smoothness rather than speed.
+   */
+  class Player {
+   public:
+    /**
+     * Starts with the frame after current, which is shown as firstFrame - 1
+     * and is what the first frame's damage is found against. onFrame and
+     * onStats are called on this thread; onFinished once the file's loop
+     * count is used up or nothing more can be decoded. Neither may
+     * destroy the player, whose timer is still signalling.
+     */
+    Player(Source source,
+           QImage const& current,
+           int firstFrame,
+           Convert convert,
+           std::function<void(Frame&&)> onFrame,
+           std::function<void(Stats const&)> onStats,
+           std::function<void()> onFinished);
+
+    ~Player();
+
+   private:
+    Player(Player const&) = delete;
+    Player& operator=(Player const&) = delete;
+
+    //
+    // Decoding thread
+    //
+
+    void decode(QImage previous, int firstFrame);
+
+    bool push(Frame&& frame);
+
+    //
+    // Calling thread
+    //
+
+    void tick();
+
+    std::optional<Frame> takeDue(Clock::time_point now, bool& ended);
+
+    void report(Clock::time_point now);
+
+    //
+    // Private data
+    //
+
+    Source source_;
+    Convert convert_;
+    std::function<void(Frame&&)> onFrame_;
+    std::function<void(Stats const&)> onStats_;
+    std::function<void()> onFinished_;
+
+    // guarded by mutex_
+    std::mutex mutex_;
+    std::condition_variable space_;
+    std::vector<Frame> ring_;  // sized from the frame shown at the start
+    std::size_t head_ = 0;
+    std::size_t count_ = 0;
+    bool decodeDone_ = false;
+    bool stopping_ = false;
+
+    QTimer timer_;
+    Clock::time_point due_;  // of the next frame in the ring
+
+    // where dropped frames changed since the last frame shown
+    std::optional<QRegion> droppedDamage_{QRegion{}};
+
+    Clock::time_point statsStart_;
+    int shown_ = 0;
+    int dropped_ = 0;
+    Millis authored_{0};  // delays of the frames shown and dropped
+
+    std::thread thread_;
+  };
+}
+
+namespace dumageview {
+  using playback::Player;
+}
+
+#endif  // DUMAGEVIEW_PLAYBACK_H_
@@ -0,0 +1,451 @@
+#include "dumageview/quadbatch.h"
+
+#include "dumageview/assert.h"
+#include "dumageview/conv_str.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <QByteArray>
+#include <QOpenGLFunctions_2_1>
+
+#include <cmath>
+#include <cstddef>
+
+namespace dumageview::quadbatch {
+  namespace {
+    constexpr char const* vertexSource = R"(
+      #version 120
+
+      uniform mat4 transform;
+
+      attribute vec2 position;
+      attribute vec2 texCoord;
+
+      varying vec2 vTexCoord;
+
+      void main() {
+        vTexCoord = texCoord;
+        gl_Position = transform * vec4(position, 0.0, 1.0);
+      }
+    )";
+
+    //
+    // RGB and YCbCr programs are a fetch function, which samples a color at
+    // a texture coordinate, then the display adjustments, then a main that
+    // filters with fetch and adjusts the result.
+    //
+
+    constexpr char const* rgbFetchSource = R"(
+      #version 120
+
+      uniform sampler2D image;
+
+      vec4 fetch(vec2 coord, float bias) {
+        return texture2D(image, coord, bias);
+      }
+    )";
+
+    // JFIF YCbCr: full-range BT.601, chroma centered on 128
+    constexpr char const* ycbcrFetchSource = R"(
+      #version 120
+
+      uniform sampler2D image;
+      uniform sampler2D cb;
+      uniform sampler2D cr;
+      uniform vec2 chromaScale;
+
+      vec4 fetch(vec2 coord, float bias) {
+        vec2 chromaCoord = coord * chromaScale;
+        float y = texture2D(image, coord, bias).r;
+        float u = texture2D(cb, chromaCoord, bias).r - 128.0 / 255.0;
+        float v = texture2D(cr, chromaCoord, bias).r - 128.0 / 255.0;
+
+        return vec4(y + 1.402 * v,
+                    y - 0.344136 * u - 0.714136 * v,
+                    y + 1.772 * u,
+                    1.0);
+      }
+    )";
+
+    // channels are numbered as in Channel; the checkerboard is in screen
+    // pixels, so it stays put as the image moves
+    constexpr char const* adjustSource = R"(
+      uniform bool premultiplied;
+      uniform bool colorManaged;
+      uniform sampler3D colorLut;
+      uniform float lutSize;
+      uniform float exposure;
+      uniform float brightness;
+      uniform float contrast;
+      uniform float inverseGamma;
+      uniform int channel;
+      uniform bool checkerboard;
+
+      vec4 adjust(vec4 color) {
+        float alpha = color.a;
+        vec3 rgb = color.rgb;
+        if (premultiplied) {
+          rgb = (alpha > 0.0) ? rgb / alpha : vec3(0.0);
+        }
+
+        // between the centers of the first and last texels
+        if (colorManaged) {
+          vec3 lutCoord = (clamp(rgb, 0.0, 1.0) * (lutSize - 1.0) + 0.5)
+                          / lutSize;
+          rgb = texture3D(colorLut, lutCoord).rgb;
+        }
+
+        rgb = (rgb * exposure - 0.5) * contrast + 0.5 + brightness;
+        rgb = pow(clamp(rgb, 0.0, 1.0), vec3(inverseGamma));
+
+        if (channel == 1) {
+          rgb = vec3(rgb.r);
+        } else if (channel == 2) {
+          rgb = vec3(rgb.g);
+        } else if (channel == 3) {
+          rgb = vec3(rgb.b);
+        } else if (channel == 4) {
+          rgb = vec3(alpha);
+          alpha = 1.0;
+        } else if (channel == 5) {
+          rgb = vec3(dot(rgb, vec3(0.2126, 0.7152, 0.0722)));
+        }
+
+        if (checkerboard) {
+          vec2 square = floor(gl_FragCoord.xy / 8.0);
+          float light = mod(square.x + square.y, 2.0);
+          rgb = mix(vec3(0.4 + 0.2 * light), rgb, alpha);
+          alpha = 1.0;
+        }
+
+        return premultiplied ? vec4(rgb * alpha, alpha) : vec4(rgb, alpha);
+      }
+    )";
+
+    constexpr char const* fastMainSource = R"(
+      varying vec2 vTexCoord;
+
+      void main() {
+        gl_FragColor = adjust(fetch(vTexCoord, 0.0));
+      }
+    )";
+
+    // Magnified, a Catmull-Rom spline through the 4x4 texels around each
+    // fragment. Minified, 16 taps spread over the fragment's footprint,
+    // each from a mip level four times finer than it would use.
+    constexpr char const* highMainSource = R"(
+      uniform vec2 texSize;
+
+      varying vec2 vTexCoord;
+
+      vec4 catmullRom(float t) {
+        float t2 = t * t;
+        float t3 = t2 * t;
+        return 0.5 * vec4(-t3 + 2.0 * t2 - t,
+                          3.0 * t3 - 5.0 * t2 + 2.0,
+                          -3.0 * t3 + 4.0 * t2 + t,
+                          t3 - t2);
+      }
+
+      vec4 bicubic(vec2 coord) {
+        vec2 pos = coord * texSize - 0.5;
+        vec2 base = floor(pos);
+        vec4 wx = catmullRom(pos.x - base.x);
+        vec4 wy = catmullRom(pos.y - base.y);
+
+        vec4 sum = vec4(0.0);
+        for (int j = 0; j < 4; ++j) {
+          vec4 row = vec4(0.0);
+          for (int i = 0; i < 4; ++i) {
+            vec2 texel = base + vec2(float(i) - 0.5, float(j) - 0.5);
+            row += wx[i] * fetch(texel / texSize, 0.0);
+          }
+          sum += wy[j] * row;
+        }
+
+        // the spline overshoots at hard edges
+        return clamp(sum, 0.0, 1.0);
+      }
+
+      vec4 supersample(vec2 coord, vec2 dx, vec2 dy) {
+        vec4 sum = vec4(0.0);
+        for (int j = 0; j < 4; ++j) {
+          for (int i = 0; i < 4; ++i) {
+            vec2 offset = (vec2(float(i), float(j)) + 0.5) / 4.0 - 0.5;
+            sum += fetch(coord + offset.x * dx + offset.y * dy, -2.0);
+          }
+        }
+        return sum / 16.0;
+      }
+
+      void main() {
+        // outside the branch, where derivatives are defined
+        vec2 dx = dFdx(vTexCoord);
+        vec2 dy = dFdy(vTexCoord);
+        float texelsPerPixel = max(length(dx * texSize), length(dy * texSize));
+
+        if (texelsPerPixel <= 1.0) {
+          gl_FragColor = adjust(bicubic(vTexCoord));
+        } else {
+          gl_FragColor = adjust(supersample(vTexCoord, dx, dy));
+        }
+      }
+    )";
+
+    // Indices are sampled nearest, so the four around each fragment are
+    // looked up and blended here, premultiplied so transparent entries do
+    // not bleed their color.
+    constexpr char const* indexedLookupSource = R"(
+      #version 120
+
+      uniform sampler2D image;
+      uniform sampler2D palette;
+      uniform vec2 texSize;
+
+      vec4 lookup(vec2 texel) {
+        float index = texture2D(image, texel / texSize).r * 255.0;
+        vec4 color = texture2D(palette, vec2((index + 0.5) / 256.0, 0.5));
+        return vec4(color.rgb * color.a, color.a);
+      }
+    )";
+
+    constexpr char const* indexedMainSource = R"(
+      varying vec2 vTexCoord;
+
+      void main() {
+        vec2 pos = vTexCoord * texSize - 0.5;
+        vec2 texel = floor(pos) + 0.5;
+        vec2 f = pos - floor(pos);
+
+        vec4 top = mix(lookup(texel), lookup(texel + vec2(1.0, 0.0)), f.x);
+        vec4 bottom = mix(lookup(texel + vec2(0.0, 1.0)),
+                          lookup(texel + vec2(1.0, 1.0)),
+                          f.x);
+        gl_FragColor = adjust(mix(top, bottom, f.y));
+      }
+    )";
+
+    // two triangles per quad; GL_QUADS is gone from core profiles
+    constexpr int verticesPerQuad = 6;
+
+    // after the image, and the chroma planes or palette
+    constexpr int colorLutUnit = 3;
+  }
+
+  QuadBatch::QuadBatch(QOpenGLFunctions_2_1& gl) : gl_(gl) {
+    build(rgb_, {rgbFetchSource, adjustSource, fastMainSource});
+    build(ycbcr_, {ycbcrFetchSource, adjustSource, fastMainSource});
+    build(indexed_, {indexedLookupSource, adjustSource, indexedMainSource});
+    build(rgbHigh_, {rgbFetchSource, adjustSource, highMainSource});
+    build(ycbcrHigh_, {ycbcrFetchSource, adjustSource, highMainSource});
+
+    for (auto* program : {&ycbcr_, &ycbcrHigh_}) {
+      auto& p = program->program;
+      program->cbLoc = p.uniformLocation("cb");
+      program->crLoc = p.uniformLocation("cr");
+      program->chromaScaleLoc = p.uniformLocation("chromaScale");
+    }
+
+    indexed_.paletteLoc = indexed_.program.uniformLocation("palette");
+    for (auto* program : {&indexed_, &rgbHigh_, &ycbcrHigh_}) {
+      program->texSizeLoc = program->program.uniformLocation("texSize");
+    }
+
+    if (!vertexBuffer_.create()) {
+      throw Error("Could not create vertex buffer.");
+    }
+    vertexBuffer_.setUsagePattern(QOpenGLBuffer::StreamDraw);
+  }
+
+  QuadBatch::~QuadBatch() {
+    vertexBuffer_.destroy();
+  }
+
+  void QuadBatch::build(Program& program,
+                        std::initializer_list<char const*> fragmentParts) {
+    QByteArray fragmentSource;
+    for (auto const* part : fragmentParts) {
+      fragmentSource += part;
+    }
+
+    auto& p = program.program;
+    bool built =
+      p.addShaderFromSourceCode(QOpenGLShader::Vertex, vertexSource)
+      && p.addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentSource)
+      && p.link();
+    if (!built) {
+      throw Error(conv::str(p.log()));
+    }
+
+    program.positionLoc = p.attributeLocation("position");
+    program.texCoordLoc = p.attributeLocation("texCoord");
+    program.transformLoc = p.uniformLocation("transform");
+    program.samplerLoc = p.uniformLocation("image");
+
+    program.premultipliedLoc = p.uniformLocation("premultiplied");
+    program.exposureLoc = p.uniformLocation("exposure");
+    program.brightnessLoc = p.uniformLocation("brightness");
+    program.contrastLoc = p.uniformLocation("contrast");
+    program.inverseGammaLoc = p.uniformLocation("inverseGamma");
+    program.channelLoc = p.uniformLocation("channel");
+    program.checkerboardLoc = p.uniformLocation("checkerboard");
+
+    program.colorManagedLoc = p.uniformLocation("colorManaged");
+    program.colorLutLoc = p.uniformLocation("colorLut");
+    program.lutSizeLoc = p.uniformLocation("lutSize");
+  }
+
+  void QuadBatch::add(QOpenGLTexture& texture,
+                      QRectF const& pos,
+                      QRectF const& texRect,
+                      Chroma const& chroma,
+                      QOpenGLTexture* palette) {
+    int first = static_cast<int>(vertices_.size());
+
+    auto vertex = [](QPointF const& p, QPointF const& t) {
+      return Vertex{static_cast<GLfloat>(p.x()),
+                    static_cast<GLfloat>(p.y()),
+                    static_cast<GLfloat>(t.x()),
+                    static_cast<GLfloat>(t.y())};
+    };
+
+    auto topLeft = vertex(pos.topLeft(), texRect.topLeft());
+    auto topRight = vertex(pos.topRight(), texRect.topRight());
+    auto botLeft = vertex(pos.bottomLeft(), texRect.bottomLeft());
+    auto botRight = vertex(pos.bottomRight(), texRect.bottomRight());
+
+    vertices_.insert(vertices_.end(),
+                     {topLeft, topRight, botRight, topLeft, botRight, botLeft});
+
+    // extend the last run if the textures are unchanged
+    if (!runs_.empty() && runs_.back().texture == &texture
+        && runs_.back().chroma == chroma && runs_.back().palette == palette) {
+      runs_.back().count += verticesPerQuad;
+    } else {
+      runs_.push_back({&texture, chroma, palette, first, verticesPerQuad});
+    }
+  }
+
+  auto QuadBatch::getProgram(Run const& run, Quality quality) -> Program& {
+    bool high = quality == Quality::high;
+    if (run.palette) {
+      return indexed_;
+    }
+    if (run.chroma.cb) {
+      return high ? ycbcrHigh_ : ycbcr_;
+    }
+    return high ? rgbHigh_ : rgb_;
+  }
+
+  void QuadBatch::draw(glm::mat4 const& transform,
+                       Quality quality,
+                       DisplayAdjustments const& adjustments,
+                       bool premultiplied,
+                       QOpenGLTexture* colorLut) {
+    if (runs_.empty()) {
+      return;
+    }
+
+    vertexBuffer_.bind();
+    vertexBuffer_.allocate(vertices_.data(),
+                           static_cast<int>(vertices_.size() * sizeof(Vertex)));
+
+    // past the units quads rebind
+    if (colorLut) {
+      colorLut->bind(colorLutUnit, QOpenGLTexture::ResetTextureUnit);
+    }
+    gl_.glActiveTexture(GL_TEXTURE0);
+
+    Program* bound = nullptr;
+    for (auto const& run : runs_) {
+      DUMAGEVIEW_ASSERT(run.texture);
+
+      auto& program = getProgram(run, quality);
+      if (bound != &program) {
+        if (bound) {
+          release(*bound);
+        }
+        bind(program, transform, adjustments, premultiplied, colorLut);
+        bound = &program;
+      }
+
+      if (run.chroma.cb) {
+        DUMAGEVIEW_ASSERT(run.chroma.cr);
+        run.chroma.cb->bind(1, QOpenGLTexture::ResetTextureUnit);
+        run.chroma.cr->bind(2, QOpenGLTexture::ResetTextureUnit);
+        program.program.setUniformValue(program.chromaScaleLoc,
+                                        run.chroma.scale);
+      }
+      if (run.palette) {
+        run.palette->bind(1, QOpenGLTexture::ResetTextureUnit);
+      }
+      if (program.texSizeLoc >= 0) {
+        program.program.setUniformValue(
+          program.texSizeLoc,
+          QSizeF(run.texture->width(), run.texture->height()));
+      }
+
+      run.texture->bind();
+      gl_.glDrawArrays(GL_TRIANGLES, run.first, run.count);
+    }
+    release(*bound);
+
+    if (colorLut) {
+      colorLut->release(colorLutUnit, QOpenGLTexture::ResetTextureUnit);
+    }
+    vertexBuffer_.release();
+
+    vertices_.clear();
+    runs_.clear();
+  }
+
+  void QuadBatch::bind(Program& program,
+                       glm::mat4 const& transform,
+                       DisplayAdjustments const& adjustments,
+                       bool premultiplied,
+                       QOpenGLTexture* colorLut) {
+    auto& p = program.program;
+    p.bind();
+    gl_.glUniformMatrix4fv(
+      program.transformLoc, 1, GL_FALSE, glm::value_ptr(transform));
+    p.setUniformValue(program.samplerLoc, 0);
+    if (program.cbLoc >= 0) {
+      p.setUniformValue(program.cbLoc, 1);
+      p.setUniformValue(program.crLoc, 2);
+    }
+    if (program.paletteLoc >= 0) {
+      p.setUniformValue(program.paletteLoc, 1);
+    }
+
+    auto toFloat = [](double value) { return static_cast<GLfloat>(value); };
+    p.setUniformValue(program.premultipliedLoc, premultiplied);
+    p.setUniformValue(program.exposureLoc,
+                      toFloat(std::exp2(adjustments.exposure)));
+    p.setUniformValue(program.brightnessLoc, toFloat(adjustments.brightness));
+    p.setUniformValue(program.contrastLoc, toFloat(adjustments.contrast));
+    p.setUniformValue(program.inverseGammaLoc,
+                      toFloat(1.0 / adjustments.gamma));
+    p.setUniformValue(program.channelLoc,
+                      static_cast<GLint>(adjustments.channel));
+    p.setUniformValue(program.checkerboardLoc, adjustments.checkerboard);
+
+    p.setUniformValue(program.colorManagedLoc, colorLut != nullptr);
+    p.setUniformValue(program.colorLutLoc, colorLutUnit);
+    if (colorLut) {
+      p.setUniformValue(program.lutSizeLoc, toFloat(colorLut->width()));
+    }
+
+    p.enableAttributeArray(program.positionLoc);
+    p.enableAttributeArray(program.texCoordLoc);
+    p.setAttributeBuffer(
+      program.positionLoc, GL_FLOAT, offsetof(Vertex, x), 2, sizeof(Vertex));
+    p.setAttributeBuffer(
+      program.texCoordLoc, GL_FLOAT, offsetof(Vertex, s), 2, sizeof(Vertex));
+  }
+
+  void QuadBatch::release(Program& program) {
+    program.program.disableAttributeArray(program.positionLoc);
+    program.program.disableAttributeArray(program.texCoordLoc);
+    program.program.release();
+  }
+}
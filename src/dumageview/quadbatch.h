@@ -0,0 +1,222 @@
+#ifndef DUMAGEVIEW_QUADBATCH_H_
+#define DUMAGEVIEW_QUADBATCH_H_
+
+#include <glm/glm.hpp>
+
+#include <QOpenGLBuffer>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+#include <QRectF>
+#include <QSizeF>
+
+#include <initializer_list>
+#include <stdexcept>
+#include <vector>
+
+class QOpenGLFunctions_2_1;
+
+namespace dumageview::quadbatch {
+  class Error : public virtual std::runtime_error {
+   public:
+    using std::runtime_error::runtime_error;
+  };
+
+  /**
+   * Chroma planes of a YCbCr image, whose luma is the quad's texture.
+   */
+  struct Chroma {
+    QOpenGLTexture* cb = nullptr;
+    QOpenGLTexture* cr = nullptr;
+    QSizeF scale{1.0, 1.0};  // chroma texture coordinates per luma one
+
+    bool operator==(Chroma const& other) const {
+      return cb == other.cb && cr == other.cr && scale == other.scale;
+    }
+  };
+
+  /**
+   * How quads are filtered. High quality is bicubic when magnified and
+   * supersampled when minified, at many times the texture reads; it is
+   * meant for frames drawn once the view is still.
+   */
+  enum class Quality { fast, high };
+
+  enum class Channel { all, red, green, blue, alpha, luma };
+
+  /**
+   * Changes to how colors are shown, made by the shader as they are drawn.
+   * Applied in order, to straight (not premultiplied) color.
+   */
+  struct DisplayAdjustments {
+    double exposure = 0.0;  // in stops
+    double brightness = 0.0;  // added
+    double contrast = 1.0;  // around middle gray
+    double gamma = 1.0;
+    Channel channel = Channel::all;  // one alone, as gray
+    bool checkerboard = false;  // transparency over a checkerboard
+
+    bool operator==(DisplayAdjustments const& other) const {
+      return exposure == other.exposure && brightness == other.brightness
+             && contrast == other.contrast && gamma == other.gamma
+             && channel == other.channel && checkerboard == other.checkerboard;
+    }
+    bool operator!=(DisplayAdjustments const& other) const {
+      return !(*this == other);
+    }
+  };
+
+  struct Quad {
+    QOpenGLTexture* texture;
+    QRectF pos;
+    QRectF texRect;  // normalized
+    Chroma chroma{};  // unused for RGB
+    QOpenGLTexture* palette = nullptr;  // 256x1; texture holds indices
+  };
+
+  /**
+   * Draws textured quads with a shader and a vertex buffer.
+   *
+   * Quads are collected with add() and drawn by draw(), which uploads them
+   * in one buffer and issues one draw call per run of quads that share a
+   * texture. Uses GLSL 1.20, so it runs on the same OpenGL 2.1 context as
+   * the fixed-function path.
+   *
+   * Quads with chroma planes are converted from YCbCr to RGB by a second
+   * program. Quads with a palette have their indices looked up and filtered
+   * by a third, which outputs premultiplied alpha. RGB and YCbCr quads each
+   * have a high-quality variant; indexed ones are filtered the same either
+   * way. All of them end with color management, when there is a LUT for
+   * it, and the display adjustments.
+   */
+  class QuadBatch {
+   public:
+    /**
+     * Compiles the shaders. The context must be current.
+     * Throws Error if they cannot be built.
+     */
+    explicit QuadBatch(QOpenGLFunctions_2_1& gl);
+
+    /**
+     * Releases GL resources. The context must be current.
+     */
+    ~QuadBatch();
+
+    /**
+     * Queues a quad covering pos, sampling texRect (normalized) of texture.
+     */
+    void add(QOpenGLTexture& texture,
+             QRectF const& pos,
+             QRectF const& texRect,
+             Chroma const& chroma = {},
+             QOpenGLTexture* palette = nullptr);
+
+    void add(Quad const& quad) {
+      add(*quad.texture, quad.pos, quad.texRect, quad.chroma, quad.palette);
+    }
+
+    /**
+     * Draws and clears queued quads. transform maps pos to clip space.
+     * premultiplied is whether the colors the quads sample have their
+     * alpha premultiplied, as palette lookups always do. colorLut, a 3D
+     * texture, converts them to the display's profile.
+     */
+    void draw(glm::mat4 const& transform,
+              Quality quality = Quality::fast,
+              DisplayAdjustments const& adjustments = {},
+              bool premultiplied = false,
+              QOpenGLTexture* colorLut = nullptr);
+
+   private:
+    QuadBatch(QuadBatch const&) = delete;
+    QuadBatch& operator=(QuadBatch const&) = delete;
+
+    struct Vertex {
+      GLfloat x, y;
+      GLfloat s, t;
+    };
+
+    struct Run {
+      QOpenGLTexture* texture;
+      Chroma chroma;
+      QOpenGLTexture* palette;
+      int first;
+      int count;
+    };
+
+    struct Program {
+      QOpenGLShaderProgram program;
+
+      int positionLoc = -1;
+      int texCoordLoc = -1;
+      int transformLoc = -1;
+      int samplerLoc = -1;
+
+      // YCbCr only
+      int cbLoc = -1;
+      int crLoc = -1;
+      int chromaScaleLoc = -1;
+
+      // indexed only
+      int paletteLoc = -1;
+
+      // indexed and high quality
+      int texSizeLoc = -1;
+
+      // display adjustments
+      int premultipliedLoc = -1;
+      int exposureLoc = -1;
+      int brightnessLoc = -1;
+      int contrastLoc = -1;
+      int inverseGammaLoc = -1;
+      int channelLoc = -1;
+      int checkerboardLoc = -1;
+
+      // color management
+      int colorManagedLoc = -1;
+      int colorLutLoc = -1;
+      int lutSizeLoc = -1;
+    };
+
+    /**
+     * Builds from fragment shader parts, the first of which has the
+     * version directive.
+     */
+    static void build(Program& program,
+                      std::initializer_list<char const*> fragmentParts);
+
+    Program& getProgram(Run const& run, Quality quality);
+
+    void bind(Program& program,
+              glm::mat4 const& transform,
+              DisplayAdjustments const& adjustments,
+              bool premultiplied,
+              QOpenGLTexture* colorLut);
+    void release(Program& program);
+
+    //
+    // Private data
+    //
+
+    QOpenGLFunctions_2_1& gl_;
+
+    Program rgb_;
+    Program ycbcr_;
+    Program indexed_;
+    Program rgbHigh_;
+    Program ycbcrHigh_;
+    QOpenGLBuffer vertexBuffer_{QOpenGLBuffer::VertexBuffer};
+
+    std::vector<Vertex> vertices_;
+    std::vector<Run> runs_;
+  };
+}
+
+namespace dumageview {
+  using quadbatch::Channel;
+  using quadbatch::DisplayAdjustments;
+  using quadbatch::Quad;
+  using quadbatch::QuadBatch;
+  using quadbatch::Quality;
+}
+
+#endif  // DUMAGEVIEW_QUADBATCH_H_
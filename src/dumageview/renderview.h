@@ -2,6 +2,7 @@
 #define DUMAGEVIEW_RENDERVIEW_H_
 
 #include "dumageview/math.h"
+#include "dumageview/orientation.h"
 
 #include <glm/glm.hpp>
 
@@ -12,6 +13,9 @@ namespace dumageview::renderview {
   inline constexpr double minZoom{0.05};
   inline constexpr double maxZoom{20.0};
 
+  // scale change per zoom step
+  inline constexpr double zoomFactor{1.1};
+
   struct ZoomToFitView {};
 
   struct ManualView {
@@ -24,8 +28,38 @@ namespace dumageview::renderview {
   struct SizeInfo {
     glm::dvec2 image;
     glm::dvec2 screen;
+    Orientation orientation{};
   };
 
+  /**
+   * Image size as it appears on screen, after orientation.
+   */
+  glm::dvec2 orientedImageSize(SizeInfo const& size);
+
+  /**
+   * Orthographic projection from screen pixels (origin top left) to clip space.
+   */
+  glm::dmat4 screenToClipMatrix(glm::dvec2 const& screen);
+
+  /**
+   * Scale at which the whole image fits the screen.
+   */
+  double fitScale(SizeInfo const& size);
+
+  /**
+   * Smallest allowed scale. Images too large to fit at minZoom may still be
+   * zoomed out until they fit.
+   */
+  double minScale(SizeInfo const& size);
+
+  /**
+   * The view once the image is oriented anew, keeping what is in the middle
+   * of the screen there.
+   */
+  View reorient(View const& view,
+                SizeInfo const& size,
+                Orientation const& orientation);
+
   /**
    * Modifies a view.
    * This is a feeble attempt to separate view-fiddling stuff from other image
@@ -86,6 +120,11 @@ namespace dumageview::renderview {
     glm::dmat4 imageToScreenMatrix() const;
     glm::dmat4 screenToImageMatrix() const;
 
+    /**
+     * Full transform for shaders, which take single precision.
+     */
+    glm::mat4 imageToClipMatrix() const;
+
     View& getView() {
       return view_;
     }
@@ -115,6 +154,11 @@ namespace dumageview::renderview {
     glm::dmat4 imageToScreenMatrix() const;
     glm::dmat4 screenToImageMatrix() const;
 
+    /**
+     * Full transform for shaders, which take single precision.
+     */
+    glm::mat4 imageToClipMatrix() const;
+
     ManualView& getView() {
       return std::get<ManualView>(view_);
     }
@@ -122,6 +166,57 @@ namespace dumageview::renderview {
       return std::get<ManualView>(view_);
     }
   };
+
+  /**
+   * The view of a single image, kept normalized as input moves and zooms it.
+   * For renderers that do not keep a view per image.
+   */
+  class Navigator {
+   public:
+    /**
+     * Starts over, zoomed to fit an unturned image of the given size.
+     */
+    void reset(glm::dvec2 const& image);
+
+    void resize(glm::dvec2 const& screen);
+
+    void setOrientation(Orientation const& orientation);
+
+    void move(glm::dvec2 const& delta);
+
+    void zoomRel(int steps, glm::dvec2 const& pos);
+
+    void zoomAbs(double scale, glm::dvec2 const& pos);
+
+    void zoomToFit();
+
+    bool isZoomToFit() const;
+
+    /**
+     * Replaces the view, normalized to the current sizes.
+     */
+    void setView(View const& view);
+
+    /**
+     * Goes back to the image and view another navigator was left at,
+     * keeping this one's screen size.
+     */
+    void restore(Navigator const& saved);
+
+    View const& getView() const {
+      return view_;
+    }
+
+    SizeInfo const& getSize() const {
+      return size_;
+    }
+
+    ViewMod<View> getViewMod() const;
+
+   private:
+    View view_;
+    SizeInfo size_{};
+  };
 }
 
 #endif  // DUMAGEVIEW_RENDERVIEW_H_
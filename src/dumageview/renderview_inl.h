@@ -9,6 +9,50 @@
 #include <boost/hana.hpp>
 
 namespace dumageview::renderview {
+  inline glm::dmat4 screenToClipMatrix(glm::dvec2 const& screen) {
+    return glm::ortho(0.0, screen.x, screen.y, 0.0, -1.0, 1.0);
+  }
+
+  inline glm::dvec2 orientedImageSize(SizeInfo const& size) {
+    return orientation::orientedSize(size.orientation, size.image);
+  }
+
+  inline double fitScale(SizeInfo const& size) {
+    auto image = orientedImageSize(size);
+    auto longDim = (math::aspectRatio(image) > math::aspectRatio(size.screen))
+                     ? math::getX
+                     : math::getY;
+    return longDim(size.screen) / longDim(image);
+  }
+
+  inline double minScale(SizeInfo const& size) {
+    return std::min(minZoom, fitScale(size));
+  }
+
+  inline View reorient(View const& view,
+                       SizeInfo const& size,
+                       Orientation const& orientation) {
+    SizeInfo newSize = size;
+    newSize.orientation = orientation;
+
+    auto visitor = boost::hana::overload(
+      [](ZoomToFitView v) -> View {
+        return v;
+      },
+      [&](ManualView const& v) -> View {
+        auto middle = size.screen * 0.5;
+        auto imageMiddle = ViewMod{v, size}.screenToImage(middle);
+
+        ManualView rv{v.scale, glm::dvec2{0.0}};
+        auto oriented = ViewMod{rv, newSize}.imageToScreen(imageMiddle);
+        rv.position = middle - oriented;
+
+        return ViewMod{rv, newSize}.normalize().getView();
+      });
+
+    return std::visit(visitor, view);
+  }
+
   //
   // BaseViewMod member functions
   //
@@ -25,7 +69,7 @@ namespace dumageview::renderview {
   template<class D>
   D& BaseViewMod<D>::normalize() {
     modify([this](auto& rv) {
-      auto scaledImageSize = rv.scale * size_.image;
+      auto scaledImageSize = rv.scale * orientedImageSize(size_);
       ViewMod vm{rv, size_};
 
       for (auto const& dim : math::dimensions2D) {
@@ -47,14 +91,13 @@ namespace dumageview::renderview {
         return v;
       },
       [&](ZoomToFitView) {
-        auto [longDim, shortDim] =
-          (math::aspectRatio(size_.image) > math::aspectRatio(size_.screen))
-            ? std::pair{math::getX, math::getY}
-            : std::pair{math::getY, math::getX};
-
-        double scale = longDim(size_.screen) / longDim(size_.image);
+        auto shortDim =
+          (math::aspectRatio(orientedImageSize(size_))
+           > math::aspectRatio(size_.screen))
+            ? math::getY
+            : math::getX;
 
-        ManualView rv{scale, {0.0, 0.0}};
+        ManualView rv{fitScale(size_), {0.0, 0.0}};
         ViewMod vm{rv, size_};
         return vm.center(shortDim).getView();
       });
@@ -83,18 +126,24 @@ namespace dumageview::renderview {
     return reified().screenToImageMatrix();
   }
 
+  inline glm::mat4 ViewMod<View>::imageToClipMatrix() const {
+    return reified().imageToClipMatrix();
+  }
+
   //
   // ViewMod<ManualView> member functions
   //
 
   inline auto ViewMod<ManualView>::center(math::Getter const& dim) -> ViewMod& {
-    dim(getView().position) = dim(getSize().screen * 0.5)
-                              - dim(getSize().image * getView().scale * 0.5);
+    dim(getView().position) =
+      dim(getSize().screen * 0.5)
+      - dim(orientedImageSize(getSize()) * getView().scale * 0.5);
     return *this;
   }
 
   inline auto ViewMod<ManualView>::clamp(math::Getter const& dim) -> ViewMod& {
-    auto botRight = imageToScreen(getSize().image);
+    auto botRight =
+      getView().scale * orientedImageSize(getSize()) + getView().position;
 
     if (dim(getView().position) > 0.0) {
       dim(getView().position) = 0.0;
@@ -107,12 +156,13 @@ namespace dumageview::renderview {
 
   inline auto ViewMod<ManualView>::setZoom(double scale,
                                            glm::dvec2 const& screenFixed) -> ViewMod& {
-    // zoom around fixed point
-    auto imageFixed = screenToImage(screenFixed);
-    imageFixed = glm::clamp(imageFixed, glm::dvec2{0.0}, getSize().image);
+    // zoom around fixed point, in oriented image coordinates
+    auto orientedFixed = (screenFixed - getView().position) / getView().scale;
+    orientedFixed = glm::clamp(
+      orientedFixed, glm::dvec2{0.0}, orientedImageSize(getSize()));
 
-    getView().scale = std::clamp(scale, minZoom, maxZoom);
-    getView().position = screenFixed - getView().scale * imageFixed;
+    getView().scale = std::clamp(scale, minScale(getSize()), maxZoom);
+    getView().position = screenFixed - getView().scale * orientedFixed;
 
     normalize();
     return *this;
@@ -120,12 +170,19 @@ namespace dumageview::renderview {
 
   inline glm::dvec2 ViewMod<ManualView>::imageToScreen(
     glm::dvec2 const& imagePos) const {
-    return getView().scale * imagePos + getView().position;
+    auto oriented =
+      orientation::orientMatrix(getSize().orientation, getSize().image)
+      * glm::dvec4{imagePos, 0.0, 1.0};
+    return getView().scale * glm::dvec2{oriented} + getView().position;
   }
 
   inline glm::dvec2 ViewMod<ManualView>::screenToImage(
     glm::dvec2 const& screenPos) const {
-    return (1.0 / getView().scale) * (screenPos - getView().position);
+    auto oriented = (1.0 / getView().scale) * (screenPos - getView().position);
+    auto imagePos = glm::inverse(orientation::orientMatrix(
+                      getSize().orientation, getSize().image))
+                    * glm::dvec4{oriented, 0.0, 1.0};
+    return glm::dvec2{imagePos};
   }
 
   inline glm::dmat4 ViewMod<ManualView>::imageToScreenMatrix() const {
@@ -134,8 +191,9 @@ namespace dumageview::renderview {
 
     auto t = glm::translate(eye, glm::dvec3{getView().position, 0.0});
     auto s = glm::scale(eye, glm::dvec3{scale, 1.0});
+    auto o = orientation::orientMatrix(getSize().orientation, getSize().image);
 
-    return t * s;
+    return t * s * o;
   }
 
   inline glm::dmat4 ViewMod<ManualView>::screenToImageMatrix() const {
@@ -144,8 +202,77 @@ namespace dumageview::renderview {
 
     auto t = glm::translate(eye, glm::dvec3{-1.0 * getView().position, 0.0});
     auto s = glm::scale(eye, glm::dvec3{invScale, 1.0});
+    auto o = glm::inverse(
+      orientation::orientMatrix(getSize().orientation, getSize().image));
+
+    return o * s * t;
+  }
+
+  inline glm::mat4 ViewMod<ManualView>::imageToClipMatrix() const {
+    return glm::mat4{screenToClipMatrix(getSize().screen)
+                     * imageToScreenMatrix()};
+  }
+
+  //
+  // Navigator member functions
+  //
+
+  inline void Navigator::reset(glm::dvec2 const& image) {
+    size_.image = image;
+    size_.orientation = {};
+    view_ = ZoomToFitView{};
+  }
+
+  inline void Navigator::resize(glm::dvec2 const& screen) {
+    size_.screen = screen;
+    view_ = getViewMod().normalize().getView();
+  }
+
+  inline void Navigator::setOrientation(Orientation const& orientation) {
+    view_ = reorient(view_, size_, orientation);
+    size_.orientation = orientation;
+  }
+
+  inline void Navigator::move(glm::dvec2 const& delta) {
+    auto vm = getViewMod();
+    vm.modify([&](auto& v) {
+      v.position += delta;
+    });
+    view_ = vm.normalize().getView();
+  }
+
+  inline void Navigator::zoomRel(int steps, glm::dvec2 const& pos) {
+    auto vm = getViewMod().reified();
+    vm.setZoom(vm.getView().scale * math::ipow(zoomFactor, steps), pos);
+    view_ = vm.getView();
+  }
+
+  inline void Navigator::zoomAbs(double scale, glm::dvec2 const& pos) {
+    auto vm = getViewMod().reified();
+    vm.setZoom(scale, pos);
+    view_ = vm.getView();
+  }
+
+  inline void Navigator::zoomToFit() {
+    view_ = ZoomToFitView{};
+  }
+
+  inline bool Navigator::isZoomToFit() const {
+    return std::holds_alternative<ZoomToFitView>(view_);
+  }
+
+  inline void Navigator::setView(View const& view) {
+    view_ = ViewMod(view, size_).normalize().getView();
+  }
+
+  inline void Navigator::restore(Navigator const& saved) {
+    auto screen = size_.screen;
+    *this = saved;
+    resize(screen);
+  }
 
-    return s * t;
+  inline ViewMod<View> Navigator::getViewMod() const {
+    return ViewMod(view_, size_);
   }
 }
 
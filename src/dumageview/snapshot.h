@@ -0,0 +1,49 @@
+#ifndef DUMAGEVIEW_SNAPSHOT_H_
+#define DUMAGEVIEW_SNAPSHOT_H_
+
+#include <atomic>
+
+namespace dumageview {
+  /**
+   * Hands the latest value of T from one thread to another without locks
+   * (a triple buffer). The writer never waits for the reader, and the
+   * reader always gets a whole value, skipping any it was too slow for.
+   */
+  template<class T>
+  class Snapshot {
+   public:
+    /**
+     * Publishes a value. Writer thread only.
+     */
+    void store(T const& value) {
+      slots_[back_] = value;
+      back_ = latest_.exchange(back_ | fresh, std::memory_order_acq_rel)
+              & indexMask;
+    }
+
+    /**
+     * Gets the latest value. Reader thread only. Returns whether it is
+     * newer than the one returned last time.
+     */
+    bool load(T& value) {
+      bool isFresh = latest_.load(std::memory_order_relaxed) & fresh;
+      if (isFresh) {
+        front_ = latest_.exchange(front_, std::memory_order_acq_rel)
+                 & indexMask;
+      }
+      value = slots_[front_];
+      return isFresh;
+    }
+
+   private:
+    static constexpr int indexMask = 3;
+    static constexpr int fresh = 4;
+
+    T slots_[3]{};
+    int back_ = 0;  // writer's
+    std::atomic<int> latest_{1};  // last published, and whether it is read
+    int front_ = 2;  // reader's
+  };
+}
+
+#endif  // DUMAGEVIEW_SNAPSHOT_H_
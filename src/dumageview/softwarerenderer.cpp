@@ -0,0 +1,336 @@
+#include "dumageview/softwarerenderer.h"
+
+#include "dumageview/assert.h"
+#include "dumageview/colorlut.h"
+#include "dumageview/conv_vec.h"
+#include "dumageview/log.h"
+#include "dumageview/mipmap.h"
+#include "dumageview/renderview_inl.h"
+
+#include <QPainter>
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace dumageview::softwarerenderer {
+  namespace {
+    // fewer rows than this are not worth a thread
+    constexpr int minRowsPerBand = 32;
+
+    // premultiplied pixels over black only need their alpha set
+    constexpr quint32 opaqueBlack = 0xff000000;
+
+    /**
+     * Where a screen pixel samples from along one axis: a source pixel, and
+     * the weight of the one after it, in 256ths.
+     */
+    struct Sample {
+      int index;
+      unsigned weight;
+    };
+
+    /**
+     * Blends two premultiplied pixels, two channels per multiply.
+     */
+    quint32 interpolate(quint32 a, quint32 b, unsigned weight) {
+      unsigned inverse = 256 - weight;
+      quint32 rb =
+        (((a & 0xff00ff) * inverse + (b & 0xff00ff) * weight) >> 8) & 0xff00ff;
+      quint32 ag =
+        (((a >> 8) & 0xff00ff) * inverse + ((b >> 8) & 0xff00ff) * weight)
+        & 0xff00ff00;
+      return rb | ag;
+    }
+
+    void interpolateRows(quint32 const* a,
+                         quint32 const* b,
+                         quint32* out,
+                         int count,
+                         unsigned weight) {
+      int i = 0;
+
+#if defined(__SSE2__)
+      // four pixels per step, each channel widened to 16 bits; the weighted
+      // sum is at most 255 * 256, so it cannot overflow
+      __m128i const zero = _mm_setzero_si128();
+      __m128i const weightB = _mm_set1_epi16(static_cast<short>(weight));
+      __m128i const weightA = _mm_set1_epi16(static_cast<short>(256 - weight));
+
+      for (; i + 4 <= count; i += 4) {
+        auto pa = _mm_loadu_si128(reinterpret_cast<__m128i const*>(a + i));
+        auto pb = _mm_loadu_si128(reinterpret_cast<__m128i const*>(b + i));
+
+        auto lo = _mm_add_epi16(
+          _mm_mullo_epi16(_mm_unpacklo_epi8(pa, zero), weightA),
+          _mm_mullo_epi16(_mm_unpacklo_epi8(pb, zero), weightB));
+        auto hi = _mm_add_epi16(
+          _mm_mullo_epi16(_mm_unpackhi_epi8(pa, zero), weightA),
+          _mm_mullo_epi16(_mm_unpackhi_epi8(pb, zero), weightB));
+
+        _mm_storeu_si128(
+          reinterpret_cast<__m128i*>(out + i),
+          _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+      }
+#endif
+
+      for (; i < count; ++i) {
+        out[i] = interpolate(a[i], b[i], weight);
+      }
+    }
+
+    /**
+     * Screen pixels in [begin, end) whose centers fall in [origin, origin +
+     * length), clipped to [0, screen).
+     */
+    std::pair<int, int> coveredRange(double origin, double length, int screen) {
+      auto clip = [&](double pos) {
+        return static_cast<int>(
+          std::clamp(std::ceil(pos - 0.5), 0.0, static_cast<double>(screen)));
+      };
+      int begin = clip(origin);
+      return {begin, std::max(clip(origin + length), begin)};
+    }
+
+    /**
+     * Samples for screen pixels [begin, end) along one axis, of a source
+     * size pixels long drawn at origin, scale screen pixels per pixel.
+     */
+    std::vector<Sample> makeSamples(
+      int begin, int end, double origin, double scale, int size) {
+      std::vector<Sample> samples;
+      samples.reserve(static_cast<std::size_t>(end - begin));
+
+      for (int i = begin; i < end; ++i) {
+        double pos = std::clamp(
+          (i + 0.5 - origin) / scale - 0.5, 0.0, static_cast<double>(size - 1));
+        auto index = static_cast<int>(pos);
+        auto weight = static_cast<unsigned>(std::lround((pos - index) * 256));
+        samples.push_back({index, weight});
+      }
+      return samples;
+    }
+  }
+
+  SoftwareRenderer::SoftwareRenderer() {
+    DUMAGEVIEW_LOG_DEBUG("Rendering in software with {} threads",
+                         pool_.getNumThreads());
+  }
+
+  //
+  // Image management
+  //
+
+  bool SoftwareRenderer::setImage(QImage image,
+                                  QString const& key,
+                                  std::shared_ptr<TileSource const> tileSource,
+                                  std::shared_ptr<YCbCrPlanes const> planes,
+                                  imagerenderer::FrameRef const& frame) {
+    // reshowing the current image changes nothing
+    if (!key.isEmpty() && key == key_ && !source_.isNull()
+        && source_.size() == image.size()) {
+      return true;
+    }
+
+    // without textures to stream tiles into, the preview is all there is
+    Q_UNUSED(tileSource);
+    Q_UNUSED(frame);
+
+    if (planes) {
+      image = planes->toRgb();
+    }
+
+    levels_.clear();
+    source_ = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    if (source_.isNull()) {
+      log::warn("Could not convert {}x{} image for software rendering",
+                image.width(),
+                image.height());
+    } else {
+      levels_.push_back(source_);
+    }
+
+    key_ = key;
+    colorManaged_ = false;
+    orientation_ = {};
+    navigator_.reset(conv::dvec(image.size()));
+    return false;
+  }
+
+  void SoftwareRenderer::removeImage() {
+    key_.clear();
+    source_ = {};
+    levels_.clear();
+  }
+
+  void SoftwareRenderer::setOrientation(Orientation const& orientation) {
+    if (source_.isNull() || orientation == orientation_) {
+      return;
+    }
+    orientation_ = orientation;
+
+    // there is no transform to draw through, so the pixels are turned
+    levels_.clear();
+    levels_.push_back(dumageview::orientation::apply(source_, orientation));
+    navigator_.setOrientation(orientation);
+  }
+
+  void SoftwareRenderer::setColorLut(std::shared_ptr<ColorLut const> lut) {
+    if (!lut || source_.isNull() || colorManaged_) {
+      return;
+    }
+    colorManaged_ = true;
+
+    source_ = colorlut::apply(source_, *lut, pool_)
+                .convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    levels_.clear();
+    levels_.push_back(dumageview::orientation::apply(source_, orientation_));
+  }
+
+  void SoftwareRenderer::setQuality(Quality quality) {
+    Q_UNUSED(quality);
+  }
+
+  void SoftwareRenderer::setDisplayAdjustments(
+    DisplayAdjustments const& adjustments) {
+    Q_UNUSED(adjustments);
+  }
+
+  QImage const& SoftwareRenderer::getLevel(double scale) {
+    DUMAGEVIEW_ASSERT(!levels_.empty());
+
+    // bilinear filtering holds up down to half size
+    auto wanted = (scale >= 1.0)
+                    ? std::size_t{0}
+                    : static_cast<std::size_t>(std::floor(-std::log2(scale)));
+
+    while (levels_.size() <= wanted) {
+      auto const& last = levels_.back();
+      if (last.width() == 1 && last.height() == 1) {
+        break;
+      }
+      auto next = mipmap::downsample(last, pool_);
+      DUMAGEVIEW_LOG_DEBUG(
+        "Built software mip level {} at {}x{}",
+        levels_.size(),
+        next.width(),
+        next.height());
+      levels_.push_back(std::move(next));
+    }
+    return levels_[std::min(wanted, levels_.size() - 1)];
+  }
+
+  //
+  // Input events
+  //
+
+  void SoftwareRenderer::move(QPoint const& dPos) {
+    if (levels_.empty()) {
+      return;
+    }
+    navigator_.move(conv::dvec(dPos));
+  }
+
+  void SoftwareRenderer::zoomRel(int steps, QPointF const& pos) {
+    if (levels_.empty()) {
+      return;
+    }
+    navigator_.zoomRel(steps, conv::dvec(pos));
+  }
+
+  void SoftwareRenderer::zoomAbs(double scale, QPointF const& pos) {
+    if (levels_.empty()) {
+      return;
+    }
+    navigator_.zoomAbs(scale, conv::dvec(pos));
+  }
+
+  void SoftwareRenderer::zoomToFit() {
+    navigator_.zoomToFit();
+  }
+
+  bool SoftwareRenderer::isZoomToFit() const {
+    return levels_.empty() || navigator_.isZoomToFit();
+  }
+
+  //
+  // Widget events
+  //
+
+  void SoftwareRenderer::resize(int w, int h) {
+    frame_ = QImage(w, h, QImage::Format_RGB32);
+    navigator_.resize(conv::dvec(frame_.size()));
+  }
+
+  void SoftwareRenderer::draw(QPainter& painter) {
+    if (frame_.isNull()) {
+      return;
+    }
+    if (levels_.empty()) {
+      painter.fillRect(frame_.rect(), Qt::black);
+      return;
+    }
+
+    int width = frame_.width();
+    int height = frame_.height();
+
+    // levels are already oriented, so their top left is at the position
+    auto vm = navigator_.getViewMod().reified();
+    double scale = vm.getView().scale;
+    auto origin = vm.getView().position;
+
+    auto const& src = getLevel(scale);
+    auto imageSize = conv::dvec(levels_.front().size());
+    auto levelScale = scale * imageSize / conv::dvec(src.size());
+
+    auto [x0, x1] = coveredRange(origin.x, imageSize.x * scale, width);
+    auto [y0, y1] = coveredRange(origin.y, imageSize.y * scale, height);
+    auto columns = makeSamples(x0, x1, origin.x, levelScale.x, src.width());
+    auto rows = makeSamples(y0, y1, origin.y, levelScale.y, src.height());
+
+    // Source columns read by this frame. Each row is blended vertically over
+    // them first, then each screen pixel blends two of those horizontally.
+    int first = columns.empty() ? 0 : columns.front().index;
+    int last = columns.empty() ? 0 : columns.back().index + 1;
+    int count = std::min(last, src.width() - 1) - first + 1;
+
+    auto doRows = [&, x0 = x0, x1 = x1, y0 = y0, y1 = y1](int begin, int end) {
+      // one past count, repeating the edge pixel
+      std::vector<quint32> blended(static_cast<std::size_t>(last - first + 1));
+
+      for (int y = begin; y < end; ++y) {
+        auto* out = reinterpret_cast<quint32*>(frame_.scanLine(y));
+        if (y < y0 || y >= y1 || columns.empty()) {
+          std::fill(out, out + width, opaqueBlack);
+          continue;
+        }
+        std::fill(out, out + x0, opaqueBlack);
+        std::fill(out + x1, out + width, opaqueBlack);
+
+        auto const& row = rows[static_cast<std::size_t>(y - y0)];
+        auto const* top =
+          reinterpret_cast<quint32 const*>(src.constScanLine(row.index));
+        auto const* bottom = reinterpret_cast<quint32 const*>(
+          src.constScanLine(std::min(row.index + 1, src.height() - 1)));
+
+        interpolateRows(
+          top + first, bottom + first, blended.data(), count, row.weight);
+        blended.back() = blended[static_cast<std::size_t>(count - 1)];
+
+        for (int x = x0; x < x1; ++x) {
+          auto const& col = columns[static_cast<std::size_t>(x - x0)];
+          auto const* pair = blended.data() + (col.index - first);
+          out[x] = interpolate(pair[0], pair[1], col.weight) | opaqueBlack;
+        }
+      }
+    };
+
+    pool_.forBands(height, minRowsPerBand, doRows);
+
+    painter.drawImage(0, 0, frame_);
+  }
+}
@@ -0,0 +1,109 @@
+#ifndef DUMAGEVIEW_SOFTWARERENDERER_H_
+#define DUMAGEVIEW_SOFTWARERENDERER_H_
+
+#include "dumageview/imagerenderer.h"
+#include "dumageview/orientation.h"
+#include "dumageview/renderview.h"
+#include "dumageview/tilesource.h"
+#include "dumageview/workerpool.h"
+#include "dumageview/ycbcr.h"
+
+#include <QImage>
+#include <QPoint>
+#include <QPointF>
+#include <QSize>
+#include <QString>
+
+#include <memory>
+#include <vector>
+
+class QPainter;
+
+namespace dumageview::softwarerenderer {
+  /**
+   * Draws on the CPU, for when OpenGL cannot be used. Takes the same calls
+   * as ImageRenderer, except that draw() paints with a QPainter.
+   *
+   * Frames are scaled bilinearly from the image, or from a mip level of it
+   * when zoomed out, with rows split across threads. Turned images are
+   * turned on a copy of their pixels.
+   */
+  class SoftwareRenderer {
+   public:
+    SoftwareRenderer();
+
+    /**
+     * Shows an image. Returns true, keeping the view, if key names the
+     * image already shown. A tile source's preview is shown as it is, and
+     * YCbCr planes are converted to RGB up front. Animation frames are
+     * shown like any other image.
+     */
+    bool setImage(QImage image,
+                  QString const& key = {},
+                  std::shared_ptr<TileSource const> tileSource = nullptr,
+                  std::shared_ptr<YCbCrPlanes const> planes = nullptr,
+                  imagerenderer::FrameRef const& frame = {});
+
+    void removeImage();
+
+    void setOrientation(Orientation const& orientation);
+
+    /**
+     * Converts the colors of the image last passed to setImage, once; a
+     * null LUT leaves them as stored.
+     */
+    void setColorLut(std::shared_ptr<ColorLut const> lut);
+
+    /**
+     * Accepted for the same calls as ImageRenderer; frames here are
+     * bilinear either way.
+     */
+    void setQuality(Quality quality);
+
+    /**
+     * Accepted likewise; without shaders, colors are shown as they are.
+     */
+    void setDisplayAdjustments(DisplayAdjustments const& adjustments);
+
+    void move(QPoint const& dPos);
+
+    void zoomRel(int steps, QPointF const& pos);
+
+    void zoomAbs(double scale, QPointF const& pos);
+
+    void zoomToFit();
+
+    bool isZoomToFit() const;
+
+    void resize(int w, int h);
+
+    void draw(QPainter& painter);
+
+   private:
+    SoftwareRenderer(SoftwareRenderer const&) = delete;
+    SoftwareRenderer& operator=(SoftwareRenderer const&) = delete;
+
+    QImage const& getLevel(double scale);
+
+    //
+    // Private data
+    //
+
+    WorkerPool pool_;  // splits rows, kept so frames do not start threads
+
+    QString key_;
+    QImage source_;  // premultiplied, as stored unless color managed
+    bool colorManaged_ = false;
+    Orientation orientation_;
+    std::vector<QImage> levels_;  // oriented; full size, then halves
+    renderview::Navigator navigator_;
+
+    QImage frame_;  // opaque, the size of the widget
+  };
+}
+
+namespace dumageview {
+  using softwarerenderer::SoftwareRenderer;
+}
+
+#endif  // DUMAGEVIEW_SOFTWARERENDERER_H_
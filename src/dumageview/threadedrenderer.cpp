@@ -0,0 +1,387 @@
+#include "dumageview/threadedrenderer.h"
+
+#include "dumageview/conv_vec.h"
+#include "dumageview/log.h"
+#include "dumageview/renderview_inl.h"
+
+#include <QContextMenuEvent>
+#include <QCoreApplication>
+#include <QEvent>
+#include <QExposeEvent>
+#include <QMouseEvent>
+#include <QOpenGLContext>
+#include <QThread>
+#include <QWidget>
+#include <QWindow>
+
+#include <algorithm>
+#include <utility>
+
+namespace dumageview::threadedrenderer {
+  namespace {
+    // views are small, so more are kept than textures usually are
+    constexpr std::size_t maxSavedViews = 256;
+
+    /**
+     * Passes its input on to the widget it is embedded in, as if it were
+     * not there, and reports when it can be drawn into.
+     */
+    class RenderWindow : public QWindow {
+     public:
+      RenderWindow(QWidget& target, std::function<void(bool)> onExposed)
+          : target_(target), onExposed_(std::move(onExposed)) {
+        setSurfaceType(QSurface::OpenGLSurface);
+      }
+
+     protected:
+      void exposeEvent(QExposeEvent*) override {
+        onExposed_(isExposed());
+      }
+
+      bool event(QEvent* evt) override {
+        switch (evt->type()) {
+          case QEvent::MouseButtonPress:
+          case QEvent::MouseButtonRelease:
+          case QEvent::MouseButtonDblClick:
+          case QEvent::MouseMove:
+          case QEvent::Wheel:
+          case QEvent::KeyPress:
+          case QEvent::KeyRelease: {
+            bool handled = QCoreApplication::sendEvent(&target_, evt);
+            if (evt->type() == QEvent::MouseButtonPress) {
+              // widgets get this from their window, which this is not
+              auto* mouse = static_cast<QMouseEvent*>(evt);
+              if (mouse->button() == Qt::RightButton) {
+                QContextMenuEvent menu{QContextMenuEvent::Mouse,
+                                       mouse->pos(),
+                                       mouse->globalPos(),
+                                       mouse->modifiers()};
+                QCoreApplication::sendEvent(&target_, &menu);
+              }
+            }
+            return handled;
+          }
+
+          default:
+            return QWindow::event(evt);
+        }
+      }
+
+     private:
+      QWidget& target_;
+      std::function<void(bool)> onExposed_;
+    };
+  }
+
+  ThreadedRenderer::ThreadedRenderer(QWidget& parent,
+                                     imagerenderer::Options const& options,
+                                     std::function<void()> onFailure)
+      : options_(options),
+        onFailure_(std::move(onFailure)),
+        wakeTarget_(std::make_shared<WakeTarget>()) {
+    wakeTarget_->renderer = this;
+
+    window_ = new RenderWindow{
+      parent, [this](bool exposed) { onExposed(exposed); }};
+    container_ = QWidget::createWindowContainer(window_, &parent);
+    container_->setGeometry(parent.rect());
+
+    // the platform window has to exist before another thread draws into it
+    window_->create();
+
+    context_ = std::make_unique<QOpenGLContext>();
+    context_->setFormat(window_->requestedFormat());
+    if (!context_->create()) {
+      log::warn("Could not create a context for the render thread");
+      onFailure_();
+      return;
+    }
+
+    thread_.reset(QThread::create([this] { run(); }));
+    thread_->setObjectName("Render");
+    context_->moveToThread(thread_.get());
+    thread_->start();
+  }
+
+  ThreadedRenderer::~ThreadedRenderer() {
+    {
+      std::lock_guard lock{wakeTarget_->mutex};
+      wakeTarget_->renderer = nullptr;
+    }
+    {
+      std::lock_guard lock{mutex_};
+      stopping_ = true;
+    }
+    wakeup_.notify_all();
+
+    if (thread_) {
+      thread_->wait();
+    }
+    context_.reset();
+    delete container_;
+  }
+
+  //
+  // GUI thread
+  //
+
+  bool ThreadedRenderer::setImage(QImage image,
+                                  QString const& key,
+                                  std::shared_ptr<TileSource const> tileSource,
+                                  std::shared_ptr<YCbCrPlanes const> planes,
+                                  imagerenderer::FrameRef const& frame) {
+    // reshowing the current image changes nothing
+    if (!key.isEmpty() && key == key_ && imageSize_ == image.size()) {
+      return true;
+    }
+    // the frames of an animation share a view, as they do on the GL thread
+    bool sameAnimation = !frame.sequence.isEmpty()
+                         && frame.sequence == sequence_
+                         && imageSize_ == image.size();
+    if (!sameAnimation) {
+      saveView();
+    }
+    key_ = key;
+    sequence_ = frame.sequence;
+    imageSize_ = image.size();
+
+    // queued before the view, so the view is never older than the image
+    post([image = std::move(image),
+          key,
+          tileSource = std::move(tileSource),
+          planes = std::move(planes),
+          frame](ImageRenderer& renderer) {
+      renderer.setImage(image, key, tileSource, planes, frame);
+    });
+
+    if (sameAnimation) {
+      return true;
+    }
+    bool restored = restoreView(key, imageSize_);
+    if (!restored) {
+      navigator_.reset(conv::dvec(imageSize_));
+    }
+    publishView();
+    return restored;
+  }
+
+  void ThreadedRenderer::removeImage() {
+    saveView();
+    key_.clear();
+    sequence_.clear();
+    imageSize_ = {};
+    post([](ImageRenderer& renderer) { renderer.removeImage(); });
+  }
+
+  void ThreadedRenderer::setOrientation(Orientation const& orientation) {
+    if (imageSize_.isEmpty()) {
+      return;
+    }
+    post([orientation](ImageRenderer& renderer) {
+      renderer.setOrientation(orientation);
+    });
+
+    navigator_.setOrientation(orientation);
+    publishView();
+  }
+
+  void ThreadedRenderer::setColorLut(std::shared_ptr<ColorLut const> lut) {
+    post([lut = std::move(lut)](ImageRenderer& renderer) {
+      renderer.setColorLut(lut);
+    });
+  }
+
+  void ThreadedRenderer::setQuality(Quality quality) {
+    post([quality](ImageRenderer& renderer) { renderer.setQuality(quality); });
+  }
+
+  void ThreadedRenderer::setDisplayAdjustments(
+    DisplayAdjustments const& adjustments) {
+    post([adjustments](ImageRenderer& renderer) {
+      renderer.setDisplayAdjustments(adjustments);
+    });
+  }
+
+  void ThreadedRenderer::move(QPoint const& dPos) {
+    if (imageSize_.isEmpty()) {
+      return;
+    }
+    navigator_.move(conv::dvec(dPos));
+    publishView();
+  }
+
+  void ThreadedRenderer::zoomRel(int steps, QPointF const& pos) {
+    if (imageSize_.isEmpty()) {
+      return;
+    }
+    navigator_.zoomRel(steps, conv::dvec(pos));
+    publishView();
+  }
+
+  void ThreadedRenderer::zoomAbs(double scale, QPointF const& pos) {
+    if (imageSize_.isEmpty()) {
+      return;
+    }
+    navigator_.zoomAbs(scale, conv::dvec(pos));
+    publishView();
+  }
+
+  void ThreadedRenderer::zoomToFit() {
+    navigator_.zoomToFit();
+    publishView();
+  }
+
+  bool ThreadedRenderer::isZoomToFit() const {
+    return imageSize_.isEmpty() || navigator_.isZoomToFit();
+  }
+
+  void ThreadedRenderer::resize(int w, int h) {
+    container_->resize(w, h);
+
+    post([this, w, h](ImageRenderer& renderer) {
+      size_ = {w, h};
+      makeCurrent();
+      renderer.resize(w, h);
+    });
+
+    navigator_.resize(glm::dvec2{w, h});
+    publishView();
+  }
+
+  void ThreadedRenderer::saveView() {
+    if (key_.isEmpty() || imageSize_.isEmpty()) {
+      return;
+    }
+    savedViews_.push_front({key_, imageSize_, navigator_});
+    if (savedViews_.size() > maxSavedViews) {
+      savedViews_.pop_back();
+    }
+  }
+
+  bool ThreadedRenderer::restoreView(QString const& key, QSize const& size) {
+    if (key.isEmpty()) {
+      return false;
+    }
+    auto it = std::find_if(
+      savedViews_.begin(), savedViews_.end(), [&](auto const& saved) {
+        return saved.key == key && saved.size == size;
+      });
+    if (it == savedViews_.end()) {
+      return false;
+    }
+    navigator_.restore(it->navigator);
+    savedViews_.erase(it);
+    return true;
+  }
+
+  void ThreadedRenderer::post(Command command) {
+    {
+      std::lock_guard lock{mutex_};
+      commands_.push_back(std::move(command));
+    }
+    wakeup_.notify_one();
+  }
+
+  void ThreadedRenderer::publishView() {
+    view_.store(navigator_.getView());
+  }
+
+  void ThreadedRenderer::onExposed(bool exposed) {
+    exposed_ = exposed;
+    if (exposed) {
+      requestFrame();
+    }
+  }
+
+  void ThreadedRenderer::requestFrame() {
+    {
+      std::lock_guard lock{mutex_};
+      frameWanted_ = true;
+    }
+    wakeup_.notify_one();
+  }
+
+  //
+  // Render thread
+  //
+
+  void ThreadedRenderer::run() {
+    std::unique_ptr<ImageRenderer> renderer;
+    if (context_->makeCurrent(window_)) {
+      try {
+        renderer = std::make_unique<ImageRenderer>(
+          *this, QMetaObject::Connection{}, options_);
+      } catch (imagerenderer::Error const& error) {
+        log::warn("Could not initialize graphics on the render thread: {}",
+                  error.what());
+      }
+    }
+
+    View view;
+    while (renderer) {
+      std::vector<Command> commands;
+      {
+        std::unique_lock lock{mutex_};
+        wakeup_.wait(lock, [this] {
+          return stopping_ || frameWanted_ || !commands_.empty();
+        });
+        if (stopping_) {
+          break;
+        }
+        commands.swap(commands_);
+        frameWanted_ = false;
+      }
+
+      for (auto const& command : commands) {
+        command(*renderer);
+      }
+
+      // drawn with the latest view even if it is not new, since a new image
+      // may have brought its own
+      view_.load(view);
+      renderer->setView(view);
+
+      if (!exposed_) {
+        continue;
+      }
+
+      makeCurrent();
+      renderer->draw();
+      context_->swapBuffers(window_);
+      ++frames_;
+    }
+
+    bool failed = !renderer;
+    renderer.reset();
+    DUMAGEVIEW_LOG_DEBUG("Render thread drew {} frames", frames_);
+
+    context_->doneCurrent();
+    context_->moveToThread(QCoreApplication::instance()->thread());
+
+    if (failed) {
+      onFailure_();
+    }
+  }
+
+  void ThreadedRenderer::makeCurrent() {
+    context_->makeCurrent(window_);
+  }
+
+  void ThreadedRenderer::doneCurrent() {
+    context_->doneCurrent();
+  }
+
+  QSize ThreadedRenderer::getSize() const {
+    return size_;
+  }
+
+  std::function<void()> ThreadedRenderer::makeWake() {
+    // may be kept by workers that outlive this
+    return [target = wakeTarget_] {
+      std::lock_guard lock{target->mutex};
+      if (target->renderer) {
+        target->renderer->requestFrame();
+      }
+    };
+  }
+}
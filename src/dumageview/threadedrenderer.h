@@ -0,0 +1,169 @@
+#ifndef DUMAGEVIEW_THREADEDRENDERER_H_
+#define DUMAGEVIEW_THREADEDRENDERER_H_
+
+#include "dumageview/imagerenderer.h"
+#include "dumageview/orientation.h"
+#include "dumageview/renderview.h"
+#include "dumageview/snapshot.h"
+#include "dumageview/tilesource.h"
+#include "dumageview/ycbcr.h"
+
+#include <QImage>
+#include <QPoint>
+#include <QPointF>
+#include <QSize>
+#include <QString>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class QOpenGLContext;
+class QThread;
+class QWidget;
+class QWindow;
+
+namespace dumageview::threadedrenderer {
+  using renderview::View;
+
+  /**
+   * Draws with an ImageRenderer on a thread of its own, into a window of its
+   * own, so frames keep coming while the GUI thread is busy.
+   *
+   * Takes the same calls as ImageRenderer, on the GUI thread. Images are
+   * queued for the render thread. The view is kept here and handed over as
+   * a snapshot, which the render thread picks up each frame.
+   */
+  class ThreadedRenderer : private imagerenderer::Host {
+   public:
+    /**
+     * Embeds the window in parent, which gets its input events.
+     * onFailure is called, from either thread, if GL cannot be used.
+     */
+    ThreadedRenderer(QWidget& parent,
+                     imagerenderer::Options const& options,
+                     std::function<void()> onFailure);
+
+    ~ThreadedRenderer();
+
+    bool setImage(QImage image,
+                  QString const& key = {},
+                  std::shared_ptr<TileSource const> tileSource = nullptr,
+                  std::shared_ptr<YCbCrPlanes const> planes = nullptr,
+                  imagerenderer::FrameRef const& frame = {});
+
+    void removeImage();
+
+    void setOrientation(Orientation const& orientation);
+
+    void setColorLut(std::shared_ptr<ColorLut const> lut);
+
+    void setQuality(Quality quality);
+
+    void setDisplayAdjustments(DisplayAdjustments const& adjustments);
+
+    void move(QPoint const& dPos);
+
+    void zoomRel(int steps, QPointF const& pos);
+
+    void zoomAbs(double scale, QPointF const& pos);
+
+    void zoomToFit();
+
+    bool isZoomToFit() const;
+
+    void resize(int w, int h);
+
+    /**
+     * Asks for another frame. Safe from any thread.
+     */
+    void requestFrame() override;
+
+   private:
+    using Command = std::function<void(ImageRenderer&)>;
+
+    ThreadedRenderer(ThreadedRenderer const&) = delete;
+    ThreadedRenderer& operator=(ThreadedRenderer const&) = delete;
+
+    void post(Command command);
+    void publishView();
+
+    void saveView();
+    bool restoreView(QString const& key, QSize const& size);
+
+    void onExposed(bool exposed);
+
+    //
+    // Render thread
+    //
+
+    void run();
+
+    void makeCurrent() override;
+    void doneCurrent() override;
+    QSize getSize() const override;
+    std::function<void()> makeWake() override;
+
+    //
+    // Private data
+    //
+
+    /**
+     * What wakes from makeWake() call through. Cleared first thing on
+     * destruction, after which they do nothing.
+     */
+    struct WakeTarget {
+      std::mutex mutex;
+      ThreadedRenderer* renderer = nullptr;
+    };
+
+    imagerenderer::Options options_;
+    std::function<void()> onFailure_;
+
+    QWidget* container_ = nullptr;  // a child of the parent; owns window_
+    QWindow* window_ = nullptr;
+    std::unique_ptr<QOpenGLContext> context_;
+    std::unique_ptr<QThread> thread_;
+    std::shared_ptr<WakeTarget> wakeTarget_;
+
+    // GUI thread only
+    renderview::Navigator navigator_;
+    QString key_;
+
+    // where images shown before were left, most recent first; kept here
+    // since the render thread's answer would come too late
+    struct SavedView {
+      QString key;
+      QSize size;
+      renderview::Navigator navigator;
+    };
+    std::list<SavedView> savedViews_;
+
+    QString sequence_;
+    QSize imageSize_;
+
+    Snapshot<View> view_;
+    std::atomic<bool> exposed_{false};
+
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    std::vector<Command> commands_;
+    bool frameWanted_ = false;
+    bool stopping_ = false;
+
+    // render thread only
+    QSize size_;
+    std::uint64_t frames_ = 0;
+  };
+}
+
+namespace dumageview {
+  using threadedrenderer::ThreadedRenderer;
+}
+
+#endif  // DUMAGEVIEW_THREADEDRENDERER_H_
@@ -0,0 +1,53 @@
+#ifndef DUMAGEVIEW_TILEGRID_H_
+#define DUMAGEVIEW_TILEGRID_H_
+
+#include <QRect>
+#include <QSize>
+
+#include <algorithm>
+#include <vector>
+
+namespace dumageview::tilegrid {
+  /**
+   * One cell of an image split for texturing.
+   *
+   * Each tile draws only its core, but samples from a larger area that
+   * overlaps its neighbors, so filtering across the seam sees the same
+   * pixels a single texture would have.
+   */
+  struct TileRect {
+    QRect core;
+    QRect area;  // core plus gutter, clipped to the image
+  };
+
+  /**
+   * Splits an image into tiles whose areas are at most maxTileSize on a side.
+   * Images that already fit become a single tile with no gutter.
+   */
+  inline std::vector<TileRect> makeTileGrid(QSize const& imageSize,
+                                            int maxTileSize,
+                                            int gutter) {
+    QRect full{QPoint{0, 0}, imageSize};
+
+    if (imageSize.width() <= maxTileSize && imageSize.height() <= maxTileSize) {
+      return {{full, full}};
+    }
+
+    int step = std::max(maxTileSize - 2 * gutter, 1);
+
+    std::vector<TileRect> tiles;
+    for (int y = 0; y < imageSize.height(); y += step) {
+      for (int x = 0; x < imageSize.width(); x += step) {
+        QRect core{x,
+                   y,
+                   std::min(step, imageSize.width() - x),
+                   std::min(step, imageSize.height() - y)};
+        QRect area = core.adjusted(-gutter, -gutter, gutter, gutter) & full;
+        tiles.push_back({core, area});
+      }
+    }
+    return tiles;
+  }
+}
+
+#endif  // DUMAGEVIEW_TILEGRID_H_
@@ -0,0 +1,117 @@
+#include "dumageview/tilesource.h"
+
+#include "dumageview/conv_str.h"
+#include "dumageview/log.h"
+
+#include <QBuffer>
+#include <QImageIOHandler>
+#include <QImageReader>
+
+#include <algorithm>
+#include <memory>
+
+namespace dumageview::tilesource {
+  namespace {
+    int ceilDiv(int a, int b) {
+      return (a + b - 1) / b;
+    }
+
+    QRectF scaled(QRectF const& rect, double sx, double sy) {
+      return {
+        rect.x() * sx, rect.y() * sy, rect.width() * sx, rect.height() * sy};
+    }
+  }
+
+  bool TileSource::canDecodeTiles(QImageReader& reader) {
+    return reader.supportsOption(QImageIOHandler::ScaledSize)
+           && reader.supportsOption(QImageIOHandler::ScaledClipRect);
+  }
+
+  TileSource::TileSource(QString const& fileName, QSize const& size)
+      : fileName_(fileName), size_(size) {
+    while (std::max(levelSize(numLevels_ - 1).width(),
+                    levelSize(numLevels_ - 1).height())
+           > tileSize) {
+      ++numLevels_;
+    }
+  }
+
+  TileSource::TileSource(QByteArray const& data,
+                         QByteArray const& format,
+                         QSize const& size)
+      : TileSource(QString{}, size) {
+    // deep, since data may be a view of an archive that is unmapped while
+    // tiles are still decoding
+    data_ = QByteArray(data.constData(), data.size());
+    format_ = format;
+  }
+
+  QSize TileSource::levelSize(int level) const {
+    int scale = 1 << level;
+    return {ceilDiv(size_.width(), scale), ceilDiv(size_.height(), scale)};
+  }
+
+  QSize TileSource::levelTiles(int level) const {
+    auto size = levelSize(level);
+    return {ceilDiv(size.width(), tileSize), ceilDiv(size.height(), tileSize)};
+  }
+
+  QRect TileSource::tileCore(TileId const& id) const {
+    QRect tile{id.x * tileSize, id.y * tileSize, tileSize, tileSize};
+    return tile & QRect{QPoint{0, 0}, levelSize(id.level)};
+  }
+
+  QRect TileSource::tileArea(TileId const& id) const {
+    auto core = tileCore(id);
+    auto area =
+      core.adjusted(-tileBorder, -tileBorder, tileBorder, tileBorder);
+    return area & QRect{QPoint{0, 0}, levelSize(id.level)};
+  }
+
+  QRectF TileSource::levelToImage(int level, QRectF const& rect) const {
+    auto size = levelSize(level);
+    return scaled(rect,
+                  static_cast<double>(size_.width()) / size.width(),
+                  static_cast<double>(size_.height()) / size.height());
+  }
+
+  QRectF TileSource::imageToLevel(int level, QRectF const& rect) const {
+    auto size = levelSize(level);
+    return scaled(rect,
+                  static_cast<double>(size.width()) / size_.width(),
+                  static_cast<double>(size.height()) / size_.height());
+  }
+
+  QImage TileSource::decode(TileId const& id) const {
+    std::unique_ptr<QBuffer> buffer;
+    std::unique_ptr<QImageReader> reader;
+
+    if (fileName_.isEmpty()) {
+      // QByteArray is shared, so each thread gets its own cheap copy
+      buffer = std::make_unique<QBuffer>();
+      buffer->setData(data_);
+      buffer->open(QIODevice::ReadOnly);
+      reader = std::make_unique<QImageReader>(buffer.get(), format_);
+    } else {
+      reader = std::make_unique<QImageReader>(fileName_);
+    }
+
+    // tiles address stored pixels; the view orients them
+    reader->setAutoTransform(false);
+
+    // level 0 too, since canDecodeTiles() does not check for ClipRect
+    reader->setScaledSize(levelSize(id.level));
+    reader->setScaledClipRect(tileArea(id));
+
+    QImage image = reader->read();
+    if (image.isNull()) {
+      log::warn("Could not decode tile {}:{},{}: {}",
+                id.level,
+                id.x,
+                id.y,
+                conv::str(reader->errorString()));
+      return image;
+    }
+    return image.convertToFormat(QImage::Format_RGBA8888);
+  }
+}
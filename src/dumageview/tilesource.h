@@ -0,0 +1,122 @@
+#ifndef DUMAGEVIEW_TILESOURCE_H_
+#define DUMAGEVIEW_TILESOURCE_H_
+
+#include <QByteArray>
+#include <QImage>
+#include <QRect>
+#include <QRectF>
+#include <QSize>
+#include <QString>
+
+#include <tuple>
+
+class QImageReader;
+
+namespace dumageview::tilesource {
+  /**
+   * One tile of the pyramid. Level 0 is full resolution; each level above
+   * halves both dimensions.
+   */
+  struct TileId {
+    int level{0};
+    int x{0};
+    int y{0};
+
+    bool operator<(TileId const& other) const {
+      return std::tie(level, x, y) < std::tie(other.level, other.x, other.y);
+    }
+
+    bool operator==(TileId const& other) const {
+      return std::tie(level, x, y) == std::tie(other.level, other.x, other.y);
+    }
+  };
+
+  /**
+   * Decodes parts of an image too large to hold in memory.
+   *
+   * Every decode opens its own reader and asks the format handler for a
+   * scaled, clipped region, so decoding is thread-safe and memory stays
+   * proportional to the tile. Only formats whose handler supports both
+   * options can be used; others would decode the whole image anyway.
+   */
+  class TileSource {
+   public:
+    static constexpr int tileSize = 256;
+    static constexpr int tileBorder = 1;  // texels shared with neighbors
+    static constexpr int textureSize = tileSize + 2 * tileBorder;
+
+    /**
+     * Checks whether reader can decode scaled regions.
+     */
+    static bool canDecodeTiles(QImageReader& reader);
+
+    /**
+     * Reads tiles from a file.
+     */
+    TileSource(QString const& fileName, QSize const& size);
+
+    /**
+     * Reads tiles from an in-memory image. The data is copied, so it may be
+     * a view of memory that goes away first.
+     */
+    TileSource(QByteArray const& data,
+               QByteArray const& format,
+               QSize const& size);
+
+    QSize getSize() const {
+      return size_;
+    }
+
+    /**
+     * Number of levels; the last fits in a single tile.
+     */
+    int getNumLevels() const {
+      return numLevels_;
+    }
+
+    QSize levelSize(int level) const;
+
+    /**
+     * Number of tiles across and down a level.
+     */
+    QSize levelTiles(int level) const;
+
+    /**
+     * Level pixels drawn by a tile.
+     */
+    QRect tileCore(TileId const& id) const;
+
+    /**
+     * Level pixels decoded for a tile: the core plus a border, clipped.
+     */
+    QRect tileArea(TileId const& id) const;
+
+    /**
+     * Maps a rectangle of level pixels to full-resolution image pixels.
+     */
+    QRectF levelToImage(int level, QRectF const& rect) const;
+
+    QRectF imageToLevel(int level, QRectF const& rect) const;
+
+    /**
+     * Decodes a tile's area as RGBA8888. Returns a null image on failure.
+     * Safe to call from any thread.
+     */
+    QImage decode(TileId const& id) const;
+
+   private:
+    QString fileName_;
+    QByteArray data_;
+    QByteArray format_;
+
+    QSize size_;
+    int numLevels_ = 1;
+  };
+}
+
+namespace dumageview {
+  using tilesource::TileId;
+  using tilesource::TileSource;
+}
+
+#endif  // DUMAGEVIEW_TILESOURCE_H_
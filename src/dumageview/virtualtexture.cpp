@@ -0,0 +1,296 @@
+#include "dumageview/virtualtexture.h"
+
+#include "dumageview/assert.h"
+#include "dumageview/log.h"
+
+#include <QOpenGLFunctions_2_1>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+
+namespace dumageview::virtualtexture {
+  namespace {
+    constexpr int textureSize = TileSource::textureSize;
+
+    /**
+     * Repeats the last row and column of a clipped tile, so filtering at the
+     * image edge does not pick up stale texels.
+     */
+    QImage padEdges(QImage const& image) {
+      int w = image.width();
+      int h = image.height();
+      int paddedW = std::min(w + 1, textureSize);
+      int paddedH = std::min(h + 1, textureSize);
+      if (image.isNull() || (paddedW == w && paddedH == h)) {
+        return image;
+      }
+
+      QImage padded(paddedW, paddedH, image.format());
+      auto rowBytes = static_cast<std::size_t>(w) * 4;
+      for (int y = 0; y < paddedH; ++y) {
+        auto const* src = image.constScanLine(std::min(y, h - 1));
+        auto* dst = padded.scanLine(y);
+        std::memcpy(dst, src, rowBytes);
+        if (paddedW > w) {
+          std::memcpy(dst + rowBytes, src + rowBytes - 4, 4);
+        }
+      }
+      return padded;
+    }
+  }
+
+  VirtualTexture::VirtualTexture(QOpenGLFunctions_2_1& gl,
+                                 std::shared_ptr<TileSource const> source,
+                                 std::function<void()> wake,
+                                 Options const& options)
+      : gl_(gl),
+        source_(std::move(source)),
+        wake_(std::move(wake)),
+        options_(options) {
+    DUMAGEVIEW_ASSERT(source_);
+    DUMAGEVIEW_LOG_DEBUG("Virtual texture {}x{} with {} levels",
+                         source_->getSize().width(),
+                         source_->getSize().height(),
+                         source_->getNumLevels());
+
+    unsigned numThreads = std::max(options_.numThreads, 1u);
+    for (unsigned i = 0; i < numThreads; ++i) {
+      workers_.emplace_back([this] { workLoop(); });
+    }
+  }
+
+  VirtualTexture::~VirtualTexture() {
+    {
+      std::lock_guard lock{mutex_};
+      stopping_ = true;
+    }
+    queueReady_.notify_all();
+
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  std::size_t VirtualTexture::getTextureBytes() const {
+    return options_.cacheTiles * textureSize * textureSize * 4;
+  }
+
+  //
+  // Frame update
+  //
+
+  void VirtualTexture::update(QRectF const& visible,
+                              double scale,
+                              std::vector<Quad>& quads) {
+    ++frame_;
+    uploadDecoded();
+
+    // one texel per screen pixel or finer
+    int maxLevel = source_->getNumLevels() - 1;
+    int level = (scale >= 1.0)
+                  ? 0
+                  : std::clamp(static_cast<int>(std::floor(-std::log2(scale))),
+                               0,
+                               maxLevel);
+
+    auto tiles = source_->levelTiles(level);
+    auto region = source_->imageToLevel(level, visible);
+    auto tileIndex = [](double pos, int numTiles) {
+      auto index = static_cast<int>(std::floor(pos / TileSource::tileSize));
+      return std::clamp(index, 0, numTiles - 1);
+    };
+
+    int x0 = tileIndex(region.left(), tiles.width());
+    int x1 = tileIndex(region.right(), tiles.width());
+    int y0 = tileIndex(region.top(), tiles.height());
+    int y1 = tileIndex(region.bottom(), tiles.height());
+
+    std::vector<TileId> wanted;
+
+    for (int y = y0; y <= y1; ++y) {
+      for (int x = x0; x <= x1; ++x) {
+        TileId id{level, x, y};
+        if (auto* slot = findSlot(id)) {
+          quads.push_back(makeQuad(id, id, *slot));
+          continue;
+        }
+
+        if (!failed_.count(id)) {
+          wanted.push_back(id);
+        }
+
+        // stand in with the nearest coarser tile
+        for (int k = level + 1; k <= maxLevel; ++k) {
+          int shift = k - level;
+          TileId parent{k, x >> shift, y >> shift};
+          if (auto* slot = findSlot(parent)) {
+            quads.push_back(makeQuad(id, parent, *slot));
+            break;
+          }
+        }
+      }
+    }
+
+    // nearest the middle of the screen first
+    auto center = region.center() / TileSource::tileSize;
+    auto distance = [&](TileId const& id) {
+      double dx = id.x + 0.5 - center.x();
+      double dy = id.y + 0.5 - center.y();
+      return dx * dx + dy * dy;
+    };
+    std::sort(wanted.begin(), wanted.end(), [&](auto const& a, auto const& b) {
+      return distance(a) < distance(b);
+    });
+
+    {
+      std::lock_guard lock{mutex_};
+
+      // tiles no longer visible are dropped before they are decoded
+      queue_.clear();
+      for (auto const& id : wanted) {
+        bool done = std::any_of(decoded_.begin(),
+                                decoded_.end(),
+                                [&](auto const& d) { return d.first == id; });
+        if (!done && !inFlight_.count(id)) {
+          queue_.push_back(id);
+        }
+      }
+    }
+    queueReady_.notify_all();
+  }
+
+  void VirtualTexture::uploadDecoded() {
+    std::vector<std::pair<TileId, QImage>> ready;
+    bool more = false;
+    {
+      std::lock_guard lock{mutex_};
+      auto count = std::min(decoded_.size(),
+                            static_cast<std::size_t>(options_.uploadsPerFrame));
+      auto end = decoded_.begin() + static_cast<long>(count);
+      std::move(decoded_.begin(), end, std::back_inserter(ready));
+      decoded_.erase(decoded_.begin(), end);
+      more = !decoded_.empty();
+    }
+
+    for (auto const& [id, image] : ready) {
+      if (image.isNull()) {
+        failed_.insert(id);
+      } else {
+        upload(id, image);
+      }
+    }
+
+    if (more) {
+      wake_();
+    }
+  }
+
+  //
+  // Texture cache
+  //
+
+  void VirtualTexture::upload(TileId const& id, QImage const& image) {
+    auto texture = acquireTexture();
+    if (!texture) {
+      // every slot is on screen; the tile will be asked for again
+      return;
+    }
+
+    texture->bind();
+    gl_.glTexSubImage2D(GL_TEXTURE_2D,
+                        0,
+                        0,
+                        0,
+                        image.width(),
+                        image.height(),
+                        GL_RGBA,
+                        GL_UNSIGNED_BYTE,
+                        image.constBits());
+
+    resident_[id] = Slot{std::move(texture), frame_};
+  }
+
+  std::unique_ptr<QOpenGLTexture> VirtualTexture::acquireTexture() {
+    if (resident_.size() < options_.cacheTiles) {
+      auto texture = std::make_unique<QOpenGLTexture>(QOpenGLTexture::Target2D);
+      texture->setSize(textureSize, textureSize);
+      texture->setFormat(QOpenGLTexture::RGBA8_UNorm);
+      texture->setMipLevels(1);
+      texture->allocateStorage(QOpenGLTexture::RGBA, QOpenGLTexture::UInt8);
+      texture->setMinificationFilter(QOpenGLTexture::Linear);
+      texture->setMagnificationFilter(QOpenGLTexture::Linear);
+      texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+      return texture;
+    }
+
+    auto lru = std::min_element(
+      resident_.begin(), resident_.end(), [](auto const& a, auto const& b) {
+        return a.second.lastUsed < b.second.lastUsed;
+      });
+    if (lru == resident_.end() || lru->second.lastUsed >= frame_) {
+      return nullptr;
+    }
+
+    auto texture = std::move(lru->second.texture);
+    resident_.erase(lru);
+    return texture;
+  }
+
+  auto VirtualTexture::findSlot(TileId const& id) -> Slot* {
+    auto it = resident_.find(id);
+    if (it == resident_.end()) {
+      return nullptr;
+    }
+    it->second.lastUsed = frame_;
+    return &it->second;
+  }
+
+  Quad VirtualTexture::makeQuad(TileId const& id,
+                                TileId const& from,
+                                Slot& slot) const {
+    auto pos = source_->levelToImage(id.level, QRectF(source_->tileCore(id)));
+
+    // where that lands in the texture of the tile drawn from
+    auto texel = source_->imageToLevel(from.level, pos);
+    auto area = source_->tileArea(from);
+    texel.translate(-area.left(), -area.top());
+
+    QRectF texRect{texel.x() / textureSize,
+                   texel.y() / textureSize,
+                   texel.width() / textureSize,
+                   texel.height() / textureSize};
+
+    return {slot.texture.get(), pos, texRect};
+  }
+
+  //
+  // Workers
+  //
+
+  void VirtualTexture::workLoop() {
+    while (true) {
+      TileId id;
+      {
+        std::unique_lock lock{mutex_};
+        queueReady_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+        if (stopping_) {
+          return;
+        }
+        id = queue_.front();
+        queue_.pop_front();
+        inFlight_.insert(id);
+      }
+
+      QImage image = padEdges(source_->decode(id));
+
+      {
+        std::lock_guard lock{mutex_};
+        inFlight_.erase(id);
+        decoded_.emplace_back(id, std::move(image));
+      }
+      wake_();
+    }
+  }
+}
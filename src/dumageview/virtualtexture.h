@@ -0,0 +1,118 @@
+#ifndef DUMAGEVIEW_VIRTUALTEXTURE_H_
+#define DUMAGEVIEW_VIRTUALTEXTURE_H_
+
+#include "dumageview/quadbatch.h"
+#include "dumageview/tilesource.h"
+
+#include <QImage>
+#include <QOpenGLTexture>
+#include <QRectF>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class QOpenGLFunctions_2_1;
+
+namespace dumageview::virtualtexture {
+  struct Options {
+    std::size_t cacheTiles{384};  // bounds texture memory
+    unsigned numThreads{4};
+    int uploadsPerFrame{16};
+  };
+
+  /**
+   * Draws a TileSource as a pyramid of tiles decoded on demand.
+   *
+   * Each frame, the tiles covering the visible rect at the level matching
+   * the view scale are queued for decoding on worker threads, and finished
+   * tiles are uploaded into a fixed number of GPU textures with LRU reuse.
+   * Tiles that are not ready yet are drawn from the nearest coarser level
+   * that is.
+   */
+  class VirtualTexture {
+   public:
+    /**
+     * Starts the decode workers. wake is called from those workers when a
+     * tile is ready, so it must be thread-safe.
+     */
+    VirtualTexture(QOpenGLFunctions_2_1& gl,
+                   std::shared_ptr<TileSource const> source,
+                   std::function<void()> wake,
+                   Options const& options = {});
+
+    /**
+     * Stops the workers and releases textures. The context must be current.
+     */
+    ~VirtualTexture();
+
+    /**
+     * Most texture memory the cache will use.
+     */
+    std::size_t getTextureBytes() const;
+
+    /**
+     * Uploads decoded tiles, queues the ones needed for visible at scale
+     * (screen pixels per image pixel), and appends what can be drawn now.
+     * The context must be current.
+     */
+    void update(QRectF const& visible, double scale, std::vector<Quad>& quads);
+
+   private:
+    VirtualTexture(VirtualTexture const&) = delete;
+    VirtualTexture& operator=(VirtualTexture const&) = delete;
+
+    struct Slot {
+      std::unique_ptr<QOpenGLTexture> texture;
+      std::uint64_t lastUsed{0};
+    };
+
+    void uploadDecoded();
+    void upload(TileId const& id, QImage const& image);
+    std::unique_ptr<QOpenGLTexture> acquireTexture();
+
+    Slot* findSlot(TileId const& id);
+    Quad makeQuad(TileId const& id, TileId const& from, Slot& slot) const;
+
+    void workLoop();
+
+    //
+    // Private data
+    //
+
+    QOpenGLFunctions_2_1& gl_;
+    std::shared_ptr<TileSource const> source_;
+    std::function<void()> wake_;
+    Options options_;
+
+    // GUI thread only
+    std::map<TileId, Slot> resident_;
+    std::set<TileId> failed_;
+    std::uint64_t frame_ = 0;
+
+    // shared with workers
+    std::mutex mutex_;
+    std::condition_variable queueReady_;
+    std::deque<TileId> queue_;  // replaced every frame
+    std::set<TileId> inFlight_;
+    std::vector<std::pair<TileId, QImage>> decoded_;
+    bool stopping_ = false;
+
+    std::vector<std::thread> workers_;
+  };
+}
+
+namespace dumageview {
+  using virtualtexture::VirtualTexture;
+}
+
+#endif  // DUMAGEVIEW_VIRTUALTEXTURE_H_
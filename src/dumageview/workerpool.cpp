@@ -0,0 +1,98 @@
+#include "dumageview/workerpool.h"
+
+#include <algorithm>
+
+namespace dumageview::workerpool {
+  WorkerPool::WorkerPool(unsigned numThreads) {
+    if (numThreads == 0) {
+      numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    for (unsigned i = 1; i < numThreads; ++i) {
+      workers_.emplace_back([this] { workLoop(); });
+    }
+  }
+
+  WorkerPool::~WorkerPool() {
+    {
+      std::lock_guard lock{mutex_};
+      stopping_ = true;
+    }
+    wakeup_.notify_all();
+
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  void WorkerPool::forBands(int count, int minPerBand, BandFunc const& func) {
+    int numBands = std::clamp(static_cast<int>(getNumThreads()),
+                              1,
+                              std::max(count / std::max(minPerBand, 1), 1));
+    if (numBands == 1) {
+      if (count > 0) {
+        func(0, count);
+      }
+      return;
+    }
+
+    std::lock_guard call{callMutex_};
+
+    std::uint64_t generation;
+    {
+      std::lock_guard lock{mutex_};
+      job_ = {&func, count, (count + numBands - 1) / numBands, numBands};
+      generation = ++generation_;
+      nextBand_ = 0;
+      pendingBands_ = numBands;
+    }
+    wakeup_.notify_all();
+
+    runBands(generation);
+
+    std::unique_lock lock{mutex_};
+    done_.wait(lock, [this] { return pendingBands_ == 0; });
+  }
+
+  void WorkerPool::workLoop() {
+    std::uint64_t seen = 0;
+    while (true) {
+      {
+        std::unique_lock lock{mutex_};
+        wakeup_.wait(lock,
+                     [&] { return stopping_ || generation_ != seen; });
+        if (stopping_) {
+          return;
+        }
+        seen = generation_;
+      }
+      runBands(seen);
+    }
+  }
+
+  void WorkerPool::runBands(std::uint64_t generation) {
+    while (true) {
+      Job job;
+      int band;
+      {
+        // a worker that woke late may find a later job, or none
+        std::lock_guard lock{mutex_};
+        if (generation_ != generation || nextBand_ >= job_.numBands) {
+          return;
+        }
+        job = job_;
+        band = nextBand_++;
+      }
+
+      int begin = band * job.bandSize;
+      int end = std::min(begin + job.bandSize, job.count);
+      if (begin < end) {
+        (*job.func)(begin, end);
+      }
+
+      std::lock_guard lock{mutex_};
+      if (--pendingBands_ == 0) {
+        done_.notify_all();
+      }
+    }
+  }
+}
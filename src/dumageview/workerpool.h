@@ -0,0 +1,78 @@
+#ifndef DUMAGEVIEW_WORKERPOOL_H_
+#define DUMAGEVIEW_WORKERPOOL_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dumageview::workerpool {
+  /**
+   * Threads kept waiting to split loops over rows, so that each frame does
+   * not pay for starting and joining threads of its own.
+   */
+  class WorkerPool {
+   public:
+    using BandFunc = std::function<void(int begin, int end)>;
+
+    /**
+     * Splits work numThreads ways, counting the calling thread, so starts
+     * one fewer. Zero means one per hardware thread.
+     */
+    explicit WorkerPool(unsigned numThreads = 0);
+
+    ~WorkerPool();
+
+    unsigned getNumThreads() const {
+      return static_cast<unsigned>(workers_.size()) + 1;
+    }
+
+    /**
+     * Calls func over [0, count) in bands of at least minPerBand, one per
+     * thread at most, and returns once all are done. The calling thread
+     * takes bands too. Calls from several threads take turns.
+     */
+    void forBands(int count, int minPerBand, BandFunc const& func);
+
+   private:
+    WorkerPool(WorkerPool const&) = delete;
+    WorkerPool& operator=(WorkerPool const&) = delete;
+
+    struct Job {
+      BandFunc const* func = nullptr;
+      int count = 0;
+      int bandSize = 0;
+      int numBands = 0;
+    };
+
+    void workLoop();
+
+    void runBands(std::uint64_t generation);
+
+    //
+    // Private data
+    //
+
+    std::mutex callMutex_;  // one job at a time
+
+    // guarded by mutex_
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    std::condition_variable done_;
+    Job job_;
+    std::uint64_t generation_ = 0;  // of job_
+    int nextBand_ = 0;
+    int pendingBands_ = 0;
+    bool stopping_ = false;
+
+    std::vector<std::thread> workers_;
+  };
+}
+
+namespace dumageview {
+  using workerpool::WorkerPool;
+}
+
+#endif  // DUMAGEVIEW_WORKERPOOL_H_
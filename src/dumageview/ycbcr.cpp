@@ -0,0 +1,288 @@
+#include "dumageview/ycbcr.h"
+
+#include "dumageview/log.h"
+#include "dumageview/scopeguard.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#if defined(DUMAGEVIEW_HAVE_LIBJPEG)
+#include <csetjmp>
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+#include <jpeglib.h>
+#endif
+
+namespace dumageview::ycbcr {
+  namespace {
+    uchar clampByte(int value) {
+      return static_cast<uchar>(std::clamp(value, 0, 255));
+    }
+
+#if defined(DUMAGEVIEW_HAVE_LIBJPEG)
+    struct ErrorManager : jpeg_error_mgr {
+      std::jmp_buf jump;  // set by whichever helper is calling libjpeg
+    };
+
+    /**
+     * libjpeg state. Plain data, so it is still sound after a longjmp.
+     */
+    struct Decoder {
+      jpeg_decompress_struct info;
+      ErrorManager errors;
+    };
+
+    extern "C" void onJpegError(j_common_ptr info) {
+      char message[JMSG_LENGTH_MAX];
+      (*info->err->format_message)(info, message);
+      log::warn("Could not decode JPEG planes: {}", message);
+
+      std::longjmp(static_cast<ErrorManager*>(info->err)->jump, 1);
+    }
+
+    extern "C" void onJpegMessage(j_common_ptr) {
+      // corrupt-data warnings; QImageReader does not report them either
+    }
+
+    /**
+     * Puts together an ICC profile from the APP2 markers it is split
+     * across. Empty if there is none, or pieces are missing.
+     */
+    QByteArray readIccProfile(jpeg_decompress_struct const& info) {
+      // then a sequence number from 1, and the number of pieces
+      constexpr char tag[] = "ICC_PROFILE";
+      constexpr std::size_t headerSize = sizeof(tag) + 2;
+
+      std::map<int, QByteArray> pieces;
+      int count = 0;
+      for (auto* marker = info.marker_list; marker; marker = marker->next) {
+        if (marker->marker != JPEG_APP0 + 2
+            || marker->data_length <= headerSize
+            || std::memcmp(marker->data, tag, sizeof(tag)) != 0) {
+          continue;
+        }
+        count = marker->data[sizeof(tag) + 1];
+        pieces[marker->data[sizeof(tag)]] = QByteArray(
+          reinterpret_cast<char const*>(marker->data + headerSize),
+          static_cast<int>(marker->data_length - headerSize));
+      }
+
+      bool complete = count > 0
+                      && pieces.size() == static_cast<std::size_t>(count)
+                      && pieces.begin()->first == 1
+                      && pieces.rbegin()->first == count;
+      if (!complete) {
+        return {};
+      }
+
+      QByteArray profile;
+      for (auto const& [sequence, piece] : pieces) {
+        profile += piece;
+      }
+      return profile;
+    }
+
+    /**
+     * A Grayscale8 image over a buffer with room for the whole blocks
+     * libjpeg writes past its right and bottom edges.
+     */
+    QImage makePlane(int width, int height, int bufWidth, int bufHeight) {
+      auto bytes = static_cast<std::size_t>(bufWidth)
+                   * static_cast<std::size_t>(bufHeight);
+      auto* data = static_cast<uchar*>(std::malloc(bytes));
+      if (!data) {
+        return {};
+      }
+      return QImage(data,
+                    width,
+                    height,
+                    bufWidth,
+                    QImage::Format_Grayscale8,
+                    [](void* p) { std::free(p); },
+                    data);
+    }
+
+    /**
+     * Reads the header and, if the JPEG is one the planes can hold, starts
+     * decoding it raw. libjpeg errors jump back here, so nothing but plain
+     * data may live in this frame.
+     */
+    bool startRaw(Decoder& decoder,
+                  unsigned char const* data,
+                  unsigned long size) {
+      auto& info = decoder.info;
+      if (setjmp(decoder.errors.jump)) {
+        return false;
+      }
+
+      jpeg_create_decompress(&info);
+      jpeg_mem_src(&info, data, size);
+      jpeg_save_markers(&info, JPEG_APP0 + 2, 0xffff);
+      jpeg_read_header(&info, TRUE);
+
+      auto const* comps = info.comp_info;
+      bool supported =
+        info.jpeg_color_space == JCS_YCbCr && info.num_components == 3
+        && comps[0].h_samp_factor == info.max_h_samp_factor
+        && comps[0].v_samp_factor == info.max_v_samp_factor
+        && comps[1].h_samp_factor == comps[2].h_samp_factor
+        && comps[1].v_samp_factor == comps[2].v_samp_factor
+        && info.max_h_samp_factor % comps[1].h_samp_factor == 0
+        && info.max_v_samp_factor % comps[1].v_samp_factor == 0;
+      if (!supported) {
+        return false;
+      }
+
+      info.out_color_space = JCS_YCbCr;
+      info.raw_data_out = TRUE;
+      jpeg_start_decompress(&info);
+      return true;
+    }
+
+    /**
+     * Decodes into three buffers with room for whole blocks, a row of iMCUs
+     * at a time. Like startRaw(), keeps only plain data in its frame.
+     */
+    bool readRaw(Decoder& decoder,
+                 uchar* const (&bits)[3],
+                 std::size_t const (&strides)[3]) {
+      auto& info = decoder.info;
+      JSAMPROW rows[3][MAX_SAMP_FACTOR * DCTSIZE];
+      JSAMPARRAY buffers[] = {rows[0], rows[1], rows[2]};
+
+      if (setjmp(decoder.errors.jump)) {
+        return false;
+      }
+
+      auto rowsPerCall =
+        static_cast<JDIMENSION>(info.max_v_samp_factor * DCTSIZE);
+
+      for (JDIMENSION iMcuRow = 0; iMcuRow < info.total_iMCU_rows;
+           ++iMcuRow) {
+        for (int c = 0; c < 3; ++c) {
+          auto compRows = static_cast<std::size_t>(
+            info.comp_info[c].v_samp_factor * DCTSIZE);
+          auto first = iMcuRow * compRows;
+          for (std::size_t r = 0; r < compRows; ++r) {
+            rows[c][r] = bits[c] + (first + r) * strides[c];
+          }
+        }
+        jpeg_read_raw_data(&info, buffers, rowsPerCall);
+      }
+
+      jpeg_finish_decompress(&info);
+      return true;
+    }
+#endif
+  }
+
+  QSizeF Planes::chromaScale() const {
+    return {static_cast<double>(y.width())
+              / (subsampling.width() * cb.width()),
+            static_cast<double>(y.height())
+              / (subsampling.height() * cb.height())};
+  }
+
+  QImage Planes::toRgb() const {
+    // JFIF: full-range BT.601, in 16.16 fixed point
+    constexpr int crToR = 91881;  // 1.402
+    constexpr int cbToG = 22554;  // 0.344136
+    constexpr int crToG = 46802;  // 0.714136
+    constexpr int cbToB = 116130;  // 1.772
+    constexpr int half = 1 << 15;
+
+    QImage rgb(y.size(), QImage::Format_RGB32);
+    if (rgb.isNull()) {
+      return rgb;
+    }
+
+    for (int row = 0; row < y.height(); ++row) {
+      int chromaRow = std::min(row / subsampling.height(), cb.height() - 1);
+      auto const* yRow = y.constScanLine(row);
+      auto const* cbRow = cb.constScanLine(chromaRow);
+      auto const* crRow = cr.constScanLine(chromaRow);
+      auto* out = reinterpret_cast<QRgb*>(rgb.scanLine(row));
+
+      for (int col = 0; col < y.width(); ++col) {
+        int chromaCol = std::min(col / subsampling.width(), cb.width() - 1);
+        int luma = yRow[col];
+        int u = cbRow[chromaCol] - 128;
+        int v = crRow[chromaCol] - 128;
+
+        int r = luma + ((crToR * v + half) >> 16);
+        int g = luma - ((cbToG * u + crToG * v + half) >> 16);
+        int b = luma + ((cbToB * u + half) >> 16);
+        out[col] = qRgb(clampByte(r), clampByte(g), clampByte(b));
+      }
+    }
+    return rgb;
+  }
+
+  bool isAvailable() {
+#if defined(DUMAGEVIEW_HAVE_LIBJPEG)
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  std::optional<Planes> decodeJpeg(QByteArray const& data) {
+#if defined(DUMAGEVIEW_HAVE_LIBJPEG)
+    Decoder decoder{};
+    decoder.info.err = jpeg_std_error(&decoder.errors);
+    decoder.errors.error_exit = onJpegError;
+    decoder.errors.output_message = onJpegMessage;
+
+    // the jump point is gone once a helper returns, so only they call
+    // anything that can fail
+    auto destroy =
+      ScopeGuard{[&] { jpeg_destroy_decompress(&decoder.info); }};
+
+    if (!startRaw(decoder,
+                  reinterpret_cast<unsigned char const*>(data.constData()),
+                  static_cast<unsigned long>(data.size()))) {
+      return std::nullopt;
+    }
+
+    auto const& info = decoder.info;
+    auto const* comps = info.comp_info;
+
+    Planes planes;
+    planes.iccProfile = readIccProfile(info);
+    planes.subsampling = {info.max_h_samp_factor / comps[1].h_samp_factor,
+                          info.max_v_samp_factor / comps[1].v_samp_factor};
+
+    // raw data comes in whole blocks, past the planes' right and bottom
+    int iMcuRows = static_cast<int>(info.total_iMCU_rows);
+    int mcuCols = static_cast<int>(info.MCUs_per_row);
+    QImage* targets[] = {&planes.y, &planes.cb, &planes.cr};
+    uchar* bits[3];
+    std::size_t strides[3];
+
+    for (int c = 0; c < 3; ++c) {
+      *targets[c] =
+        makePlane(static_cast<int>(comps[c].downsampled_width),
+                  static_cast<int>(comps[c].downsampled_height),
+                  mcuCols * comps[c].h_samp_factor * DCTSIZE,
+                  iMcuRows * comps[c].v_samp_factor * DCTSIZE);
+      if (targets[c]->isNull()) {
+        return std::nullopt;
+      }
+
+      // bits(), not scanLine(), so rows past height() can be reached
+      bits[c] = targets[c]->bits();
+      strides[c] = static_cast<std::size_t>(targets[c]->bytesPerLine());
+    }
+
+    if (!readRaw(decoder, bits, strides)) {
+      return std::nullopt;
+    }
+    return planes;
+#else
+    Q_UNUSED(data);
+    return std::nullopt;
+#endif
+  }
+}
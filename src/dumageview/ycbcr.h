@@ -0,0 +1,53 @@
+#ifndef DUMAGEVIEW_YCBCR_H_
+#define DUMAGEVIEW_YCBCR_H_
+
+#include <QByteArray>
+#include <QImage>
+#include <QSize>
+#include <QSizeF>
+
+#include <optional>
+
+namespace dumageview::ycbcr {
+  /**
+   * A JPEG decoded without color conversion or chroma upsampling.
+   * Each plane is Grayscale8; the shader turns them into RGB.
+   */
+  struct Planes {
+    QImage y;  // full size
+    QImage cb;
+    QImage cr;
+    QSize subsampling{1, 1};  // luma samples per chroma sample
+    QByteArray iccProfile;  // embedded, if any; the planes are as stored
+
+    /**
+     * Chroma texture coordinates per luma texture coordinate. Not quite the
+     * inverse of the subsampling factor when the image size is odd.
+     */
+    QSizeF chromaScale() const;
+
+    /**
+     * Converts to RGB32 on the CPU, for when the planes cannot be drawn as
+     * they are, or are saved.
+     */
+    QImage toRgb() const;
+  };
+
+  /**
+   * Whether decodeJpeg() can do anything in this build.
+   */
+  bool isAvailable();
+
+  /**
+   * Decodes a baseline or progressive YCbCr JPEG whose chroma planes share
+   * one sampling factor. Returns nothing for anything else, or on errors,
+   * so the caller can fall back to QImageReader.
+   */
+  std::optional<Planes> decodeJpeg(QByteArray const& data);
+}
+
+namespace dumageview {
+  using YCbCrPlanes = ycbcr::Planes;
+}
+
+#endif  // DUMAGEVIEW_YCBCR_H_